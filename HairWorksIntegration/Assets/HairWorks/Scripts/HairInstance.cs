@@ -39,6 +39,7 @@ namespace GameWorks
         Hwi.HShader m_hshader = Hwi.HShader.NullHandle;
         Hwi.HAsset m_hasset = Hwi.HAsset.NullHandle;
         Hwi.HInstance m_hinstance = Hwi.HInstance.NullHandle;
+        int m_asset_revision;
 
         public Transform[] m_bones;
         Matrix4x4[] m_inv_bindpose;
@@ -101,6 +102,9 @@ namespace GameWorks
         private ReflectionProbe[] reflectionProbes;
         private List<ReflectionProbe> probeInstances;
         private float probeBlendAmount;
+        private Hwi.Environment m_env;          // lighting environment of this instance
+        private Hwi.Environment m_env_sent;     // the last one sent to the plugin
+        private bool m_env_sent_valid = false;
 
         // The UpdateBones() method is very expensive. Optimized by updating fixed amount per second. Not per frame. 
         private float accumTime = 0;
@@ -143,7 +147,9 @@ namespace GameWorks
             RepaintWindow();
         }
 
-        public void LoadHairAsset(string path_to_apx, bool reset_params = true)
+        // async: the file is read in the background. the instance starts rendering once the asset is loaded,
+        // reset_params has to be false then as the default descriptor isn't known yet.
+        public void LoadHairAsset(string path_to_apx, bool reset_params = true, bool async = false)
         {
             // release existing instance & asset
             if (m_hinstance)
@@ -158,10 +164,13 @@ namespace GameWorks
             }
 
             // load & create instance
-            if (m_hasset = Hwi.hwAssetLoadFromFile(Application.streamingAssetsPath + "/" + path_to_apx, unit))
+            var path = Application.streamingAssetsPath + "/" + path_to_apx;
+            if (m_hasset = async ? Hwi.hwAssetLoadFromFileAsync(path, unit, null, IntPtr.Zero) : Hwi.hwAssetLoadFromFile(path, unit))
             {
                 m_hair_asset = path_to_apx;
                 m_hinstance = Hwi.hwInstanceCreate(m_hasset);
+                m_asset_revision = Hwi.hwAssetGetRevision(m_hasset);
+                m_env_sent_valid = false;
                 if (reset_params)
                 {
                     Hwi.hwAssetGetDefaultDescriptor(m_hasset, ref m_params);
@@ -183,12 +192,10 @@ namespace GameWorks
 #endif
         }
 
+        // the reloaded asset is swapped in by a later hwBeginFrame(). Update() takes its default descriptor then
         public void ReloadHairAsset()
         {
             Hwi.hwAssetReload(m_hasset);
-            Hwi.hwAssetGetDefaultDescriptor(m_hasset, ref m_params);
-            Hwi.hwInstanceSetDescriptor(m_hinstance, ref m_params);
-            RepaintWindow();
         }
 
         public void AssignTexture(Hwi.TextureType type, Texture2D tex)
@@ -371,6 +378,36 @@ namespace GameWorks
             }
         }
 
+        void SetReflectionProbes(IntPtr probe1, IntPtr probe2)
+        {
+            m_env.probe1 = probe1;
+            m_env.probe2 = probe2;
+        }
+
+        // the plugin keeps the environment per instance, so it is only sent when it changes
+        void UpdateEnvironment()
+        {
+            GetReflectionProbeData();
+
+            UpdateLightProbes();
+
+            m_env.shAr = avCoeff[0];
+            m_env.shAg = avCoeff[1];
+            m_env.shAb = avCoeff[2];
+            m_env.shBr = avCoeff[3];
+            m_env.shBg = avCoeff[4];
+            m_env.shBb = avCoeff[5];
+            m_env.shC = avCoeff[6];
+            m_env.gi_params = new Vector4(lightProbeIntensity, reflectionProbeIntensity, reflectionProbeSpecularity, probeBlendAmount);
+
+            if (!m_env_sent_valid || !m_env.Equals(ref m_env_sent))
+            {
+                Hwi.hwInstanceSetEnvironment(m_hinstance, ref m_env);
+                m_env_sent = m_env;
+                m_env_sent_valid = true;
+            }
+        }
+
         Texture GetProbeTexture(ReflectionProbe probe)
         {
             if (probe.customBakedTexture != null)
@@ -403,7 +440,7 @@ namespace GameWorks
             // If no active reflection probes in scene then return
             if (probeInstances.Count <= 0 || !useReflectionProbes)
             {
-                Hwi.hwSetReflectionProbe(IntPtr.Zero, IntPtr.Zero);
+                SetReflectionProbes(IntPtr.Zero, IntPtr.Zero);
                 return;
             }
 
@@ -415,7 +452,7 @@ namespace GameWorks
                 if (!probePointers.ContainsKey(probeInstances[0]))
                     probePointers.Add(probeInstances[0], GetProbeTexture(probeInstances[0]).GetNativeTexturePtr());
 
-                Hwi.hwSetReflectionProbe(probePointers[probeInstances[0]], probePointers[probeInstances[0]]);
+                SetReflectionProbes(probePointers[probeInstances[0]], probePointers[probeInstances[0]]);
 
 
                 return;
@@ -437,12 +474,12 @@ namespace GameWorks
 
                 if (dist2 > dist1)
                 {
-                    Hwi.hwSetReflectionProbe(probePointers[probeInstances[0]], probePointers[probeInstances[1]]);
+                    SetReflectionProbes(probePointers[probeInstances[0]], probePointers[probeInstances[1]]);
                     probeBlendAmount = 0.5f * (1.0f / (dist2 / (dist1 + 0.01f)));
                 }
                 else
                 {
-                    Hwi.hwSetReflectionProbe(probePointers[probeInstances[1]], probePointers[probeInstances[0]]);
+                    SetReflectionProbes(probePointers[probeInstances[1]], probePointers[probeInstances[0]]);
                     probeBlendAmount = 0.5f * (1.0f / (dist1 / (dist2 + 0.01f)));
                 }
 
@@ -532,12 +569,12 @@ namespace GameWorks
             //send probes
             if (dist2 > dist1)
             {
-                Hwi.hwSetReflectionProbe(probePointers[probe1], probePointers[probe2]);
+                SetReflectionProbes(probePointers[probe1], probePointers[probe2]);
                 probeBlendAmount = 0.5f * (1.0f / (dist2 / (dist1 + 0.01f)));
             }
             else
             {
-                Hwi.hwSetReflectionProbe(probePointers[probe2], probePointers[probe1]);
+                SetReflectionProbes(probePointers[probe2], probePointers[probe1]);
                 probeBlendAmount = 0.5f * (1.0f / (dist1 / (dist2 + 0.01f)));
             }
         }
@@ -590,7 +627,7 @@ namespace GameWorks
         void Start()
         {
             LoadHairShader(m_hair_shader);
-            LoadHairAsset(m_hair_asset, false);
+            LoadHairAsset(m_hair_asset, false, true);
             AssignAllTextures();
         }
 
@@ -598,6 +635,16 @@ namespace GameWorks
         {
             if (!m_hasset) { return; }
 
+            // the asset has been reloaded, by ReloadHairAsset() or because the file changed
+            int revision = Hwi.hwAssetGetRevision(m_hasset);
+            if (revision != m_asset_revision)
+            {
+                m_asset_revision = revision;
+                Hwi.hwAssetGetDefaultDescriptor(m_hasset, ref m_params);
+                Hwi.hwInstanceSetDescriptor(m_hinstance, ref m_params);
+                RepaintWindow();
+            }
+
             if (accumTime + Time.deltaTime > stepsize)
             {
                 accumTime = 0;
@@ -636,14 +683,7 @@ namespace GameWorks
             if (m_skinning_matrices != null)
                 Hwi.hwInstanceUpdateSkinningMatrices(m_hinstance, m_skinning_matrices.Length, m_skinning_matrices_ptr);
 
-            GetReflectionProbeData();
-
-            UpdateLightProbes();
-
-            Hwi.hwSetSphericalHarmonics(ref avCoeff[0], ref avCoeff[1], ref avCoeff[2], ref avCoeff[3], ref avCoeff[4], ref avCoeff[5], ref avCoeff[6]);
-
-            Vector4 giparams = new Vector4(lightProbeIntensity, reflectionProbeIntensity, reflectionProbeSpecularity, probeBlendAmount);
-            Hwi.hwSetGIParameters(ref giparams);
+            UpdateEnvironment();
 
             HairWorksManager.Render(Camera.current, this);
         }
@@ -11,9 +11,21 @@ using GameWorks;
 [ExecuteAlways]
 public class HairWorksManager : MonoBehaviour
 {
-    static CommandBuffer    CmdBuffer_HairRender;
- 
-    static HashSet<Camera> s_cameras = new HashSet<Camera>();
+    // each camera gets its own view ID and command buffer, so its render event only flushes what was recorded for it
+    class CameraView
+    {
+        public int              id;
+        public CameraEvent      timing;
+        public CommandBuffer    cmd;
+        public List<HairInstance> instances = new List<HairInstance>(); // to render before the next submit
+    }
+
+    static Dictionary<Camera, CameraView> s_views = new Dictionary<Camera, CameraView>();
+    static int s_next_view_id = 1;                          // the lowest ID never handed out
+    static Stack<int> s_free_view_ids = new Stack<int>();   // of the views of destroyed cameras
+    static List<KeyValuePair<Camera, CameraView>> s_destroyed_views = new List<KeyValuePair<Camera, CameraView>>();
+    static bool s_out_of_views_logged = false;
+    static Hwi.HInstance[] s_batch = new Hwi.HInstance[16];
 
     public static bool HairWorksEnabled = true;
 
@@ -35,6 +47,7 @@ public class HairWorksManager : MonoBehaviour
         HairWorksEnabled = true;
 
         Hwi.hwSetLogCallback();
+        Camera.onPreRender += OnCameraPreRender;
     }
 
     // Use this for initialization
@@ -46,12 +59,124 @@ public class HairWorksManager : MonoBehaviour
 
     void LateUpdate()
     {
+        // stamp everything recorded from here on with this frame, and make the render events flush only this frame
+        int frame = Time.frameCount;
+        Hwi.hwBeginFrame(frame);
+        PruneViews();
+        foreach (var v in s_views.Values)
+        {
+            v.cmd.Clear();
+            v.cmd.IssuePluginEvent(Hwi.hwGetRenderEventFunc(), Hwi.hwGetFlushEventID(frame, v.id));
+        }
+
         Hwi.hwStepSimulation(Time.deltaTime);
     }
 
     void OnDisable()
     {
         HairWorksEnabled = false;
+        Camera.onPreRender -= OnCameraPreRender;
+    }
+
+    // called after all OnWillRenderObject() of the camera. everything recorded since the last submit belongs to it.
+    static void OnCameraPreRender(Camera cam)
+    {
+        CameraView view;
+        if (s_views.TryGetValue(cam, out view))
+        {
+            RenderInstances(cam, view);
+            Hwi.hwSubmit(view.id);
+        }
+    }
+
+    // each instance carries its own lighting environment, so the instances of a camera are drawn
+    // with one batch per shader instead of one draw each
+    static void RenderInstances(Camera cam, CameraView view)
+    {
+        var instances = view.instances;
+        if (instances.Count == 0)
+            return;
+
+        Matrix4x4 V = cam.worldToCameraMatrix;
+        Matrix4x4 P = GL.GetGPUProjectionMatrix(cam.projectionMatrix, DoesRenderToTexture(cam));
+        float fov   = cam.fieldOfView;
+        Hwi.hwSetViewProjection(ref V, ref P, fov);
+        HairLight.AssignLightData();
+
+        Hwi.hwBeginScene();
+
+        instances.Sort((a, b) => a.shader_id.CompareTo(b.shader_id));
+        if (s_batch.Length < instances.Count)
+        {
+            s_batch = new Hwi.HInstance[Mathf.NextPowerOfTwo(instances.Count)];
+        }
+        for (int begin = 0; begin < instances.Count; )
+        {
+            uint shader = instances[begin].shader_id;
+            int count = 0;
+            while (begin + count < instances.Count && instances[begin + count].shader_id == shader)
+            {
+                s_batch[count] = instances[begin + count].instance_id;
+                ++count;
+            }
+            Hwi.hwSetShader(shader);
+            Hwi.hwRenderBatch(count, s_batch);
+            begin += count;
+        }
+
+        Hwi.hwEndScene();
+        instances.Clear();
+    }
+
+    // the views of destroyed cameras give their IDs back. a camera compares equal to null once it is destroyed
+    static void PruneViews()
+    {
+        foreach (var kv in s_views)
+        {
+            if (kv.Key == null)
+                s_destroyed_views.Add(kv);
+        }
+        foreach (var kv in s_destroyed_views)
+        {
+            kv.Value.cmd.Release();
+            s_free_view_ids.Push(kv.Value.id);
+            s_views.Remove(kv.Key);
+        }
+        s_destroyed_views.Clear();
+    }
+
+    // null if every view ID is taken
+    static CameraView GetView(Camera cam)
+    {
+        CameraView view;
+        if (!s_views.TryGetValue(cam, out view))
+        {
+            // view 0 is reserved for commands shared by all cameras
+            int id;
+            if (s_free_view_ids.Count > 0)
+                id = s_free_view_ids.Pop();
+            else if (s_next_view_id < Hwi.MaxViews)
+                id = s_next_view_id++;
+            else
+            {
+                if (!s_out_of_views_logged)
+                {
+                    Debug.LogWarning("HairWorksManager: more than " + (Hwi.MaxViews - 1) + " cameras render hair. the others draw it immediately.");
+                    s_out_of_views_logged = true;
+                }
+                return null;
+            }
+
+            view        = new CameraView();
+            view.id     = id;
+            view.timing = IsDeferred(cam) ? CameraEvent.BeforeImageEffects : CameraEvent.AfterImageEffectsOpaque;
+            view.cmd    = new CommandBuffer();
+            view.cmd.name = "Hair";
+            view.cmd.IssuePluginEvent(Hwi.hwGetRenderEventFunc(), Hwi.hwGetFlushEventID(Time.frameCount, view.id));
+            cam.AddCommandBuffer(view.timing, view.cmd);
+            s_views.Add(cam, view);
+        }
+        return view;
     }
 
     void OnApplicationQuit()
@@ -79,40 +204,15 @@ public class HairWorksManager : MonoBehaviour
 
     public static void Render( Camera CameraToAdd, HairInstance instance )
     {
-        if (CmdBuffer_HairRender == null)
-        {
-            CmdBuffer_HairRender      = new CommandBuffer();
-            CmdBuffer_HairRender.name = "Hair";
-            CmdBuffer_HairRender.IssuePluginEvent( Hwi.hwGetRenderEventFunc(), 0); 
-        }
-
         if (!HairWorksEnabled)
             return;
 
-        if ( CameraToAdd != null )
+        // drawn along with the other instances of the camera when it is about to render
+        var view = CameraToAdd != null ? GetView(CameraToAdd) : null;
+        if ( view != null )
         {
-            CameraEvent s_timing;
-
-            if (IsDeferred(CameraToAdd))
-            {
-                s_timing = CameraEvent.BeforeImageEffects;
-            }
-            else
-            {
-                s_timing = CameraEvent.AfterImageEffectsOpaque;
-            }
-
-            Matrix4x4 V = CameraToAdd.worldToCameraMatrix;
-            Matrix4x4 P = GL.GetGPUProjectionMatrix(CameraToAdd.projectionMatrix, DoesRenderToTexture(CameraToAdd));
-            float fov   = CameraToAdd.fieldOfView;
-            Hwi.hwSetViewProjection(ref V, ref P, fov);
-            HairLight.AssignLightData();
-
-            if (!s_cameras.Contains(CameraToAdd))
-            { 
-                CameraToAdd.AddCommandBuffer(s_timing, CmdBuffer_HairRender);
-                s_cameras.Add(CameraToAdd);
-            }
+            view.instances.Add(instance);
+            return;
         }
 
         Hwi.hwBeginScene();
@@ -124,20 +224,17 @@ public class HairWorksManager : MonoBehaviour
 
     static public void ClearCommandBuffer()
     {
-        foreach (var c in s_cameras)
+        foreach (var kv in s_views)
         {
-            if (c != null)
+            if (kv.Key != null)
             {
-                if (IsDeferred(c))
-                {
-                    c.RemoveCommandBuffer(CameraEvent.BeforeImageEffects, CmdBuffer_HairRender);
-                }
-                else
-                {
-                    c.RemoveCommandBuffer(CameraEvent.AfterImageEffectsOpaque, CmdBuffer_HairRender);
-                }
+                kv.Key.RemoveCommandBuffer(kv.Value.timing, kv.Value.cmd);
             }
+            kv.Value.cmd.Release();
         }
-        s_cameras.Clear();
+        s_views.Clear();
+        s_next_view_id = 1;
+        s_free_view_ids.Clear();
+        s_out_of_views_logged = false;
     }
 }
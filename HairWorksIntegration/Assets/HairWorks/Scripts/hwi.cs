@@ -449,6 +449,85 @@ namespace GameWorks
             int pad5, pad6, pad7;
         }
 
+        // lighting environment of an instance. must match hwEnvironmentData.
+        public struct Environment
+        {
+            public Vector4 shAr, shAg, shAb, shBr, shBg, shBb, shC;
+            public Vector4 gi_params;   // x: light probe intensity y: reflection probe intensity z: specular strength w: probe blend amount
+            public IntPtr probe1;
+            public IntPtr probe2;
+
+            public bool Equals(ref Environment o)
+            {
+                return shAr == o.shAr && shAg == o.shAg && shAb == o.shAb && shBr == o.shBr && shBg == o.shBg && shBb == o.shBb && shC == o.shC &&
+                    gi_params == o.gi_params && probe1 == o.probe1 && probe2 == o.probe2;
+            }
+        }
+
+
+        public const int MaxViews = 128;
+
+        public enum StaleFramePolicy
+        {
+            Drop,       // discard commands of frames that were never flushed
+            Coalesce,   // apply their state and simulation commands, skip their draws
+        }
+
+        public enum AssetStatus
+        {
+            Invalid,    // not an asset handle, or released
+            Loading,
+            Ready,
+            Failed,
+        }
+
+        public enum SortMode
+        {
+            None,           // draw in the order hwRender() was called
+            StateFirst,     // group by shader and asset, then front to back
+            BackToFront,    // back to front, for blended hair
+        }
+
+        [System.Serializable]
+        public struct Stats
+        {
+            public int frames_executed;
+            public int frames_dropped;
+            public int frames_coalesced;
+            public int commands_eliminated; // redundant state commands dropped in the last frame
+            public int bytes_uploaded;      // constant buffer bytes uploaded in the last frame
+            public int views;               // SRVs/RTVs alive in the view cache
+            public int views_referenced;    // ones of them in use
+            public int views_created;
+            public int views_evicted;
+            public int view_cache_memory;   // bytes
+            public int shaders;             // alive
+            public int assets;              //
+            public int instances;           //
+            public int handle_slots;        // slots of the shader, asset and instance pools, used or free
+            public int handles_allocated;
+            public int handles_freed;
+            public int stale_handles;       // calls made with the handle of a released object
+            public int instances_culled;    // draws skipped in the last frame because the instance was outside the view frustum
+            public int dedup_hits;          // shader and asset loads that shared the contents of another file
+            public int dedup_bytes_saved;   // file bytes of the shaders and assets alive that share another one's contents
+            public int shader_variants;     // alive
+            public int shader_fallbacks;    // draws in the last frame with a shader that has variants but none that covered them. they used the uber shader
+        }
+
+        // counted by the null backend only (see hwInitializeNull)
+        [System.Serializable]
+        public struct BackendStats
+        {
+            public int calls;
+            public int objects_created;
+            public int objects_alive;       // non-zero after hwFinalize() means a leak
+            public int binds;
+            public int uploads;
+            public int bytes_uploaded;
+            public int draws;
+            public int sdk_calls;
+        }
 
         public enum UpAxis
         {
@@ -505,22 +584,37 @@ namespace GameWorks
 
 
         public delegate void hwLogCallback(System.IntPtr cstr);
+        // called on the main thread. keep the delegate alive until it has been called
+        public delegate void hwAssetLoadCallback(HAsset asset, AssetStatus status, System.IntPtr userdata);
 
 
         [DllImport("HairWorksIntegration")] public static extern int hwGetSDKVersion();
         [DllImport("HairWorksIntegration")] public static extern Bool hwLoadHairWorks();
+        [DllImport("HairWorksIntegration")] public static extern Bool hwInitializeNull(int latency_us);
         [DllImport("HairWorksIntegration")] public static extern void hwUnloadHairWorks();
 
         [DllImport("HairWorksIntegration")] public static extern IntPtr hwGetRenderEventFunc();
+        [DllImport("HairWorksIntegration")] public static extern int hwGetFlushEventID(int frame, int view);
         [DllImport("HairWorksIntegration")] public static extern void hwSetLogCallback(hwLogCallback cb);
 
         [DllImport("HairWorksIntegration")] public static extern HShader hwShaderLoadFromFile(string path);
+        [DllImport("HairWorksIntegration")] public static extern HShader hwShaderLoadFromMemory(byte[] data, int size);
         [DllImport("HairWorksIntegration")] public static extern Bool hwShaderRelease(HShader sid);
         [DllImport("HairWorksIntegration")] public static extern Bool hwShaderReload(HShader sid);
 
         [DllImport("HairWorksIntegration")] public static extern HAsset hwAssetLoadFromFile(string path, float unit);
+        [DllImport("HairWorksIntegration")] public static extern HAsset hwAssetLoadFromFileAsync(string path, float unit, hwAssetLoadCallback cb, IntPtr userdata);
+        [DllImport("HairWorksIntegration")] public static extern HAsset hwAssetLoadFromMemory(byte[] data, int size, float unit);
+        [DllImport("HairWorksIntegration")] public static extern AssetStatus hwAssetGetStatus(HAsset aid);
+        // cooked assets are written to and looked up in dir. null or empty disables the cache
+        [DllImport("HairWorksIntegration")] public static extern void hwSetAssetCacheDirectory(string dir);
+        // shaders and assets loaded from files are reloaded when the files are written. swapped in by hwBeginFrame()
+        [DllImport("HairWorksIntegration")] public static extern void hwSetFileWatching(Bool enabled);
+        [DllImport("HairWorksIntegration")] public static extern Bool hwAssetCook(string path, float unit);
         [DllImport("HairWorksIntegration")] public static extern Bool hwAssetRelease(HAsset aid);
         [DllImport("HairWorksIntegration")] public static extern Bool hwAssetReload(HAsset aid);
+        // changes when a reload has been swapped in by hwBeginFrame(), which may bring a new default descriptor
+        [DllImport("HairWorksIntegration")] public static extern int hwAssetGetRevision(HAsset aid);
         [DllImport("HairWorksIntegration")] public static extern int hwAssetGetNumBones(HAsset aid);
         [DllImport("HairWorksIntegration")] private static extern IntPtr hwAssetGetBoneName(HAsset aid, int nth);
         public static string hwAssetGetBoneNameString(HAsset aid, int nth) { return Marshal.PtrToStringAnsi(hwAssetGetBoneName(aid, nth)); }
@@ -537,6 +631,7 @@ namespace GameWorks
         [DllImport("HairWorksIntegration")] public static extern void hwInstanceGetBounds(HInstance iid, ref Vector3 o_min, ref Vector3 o_max);
         [DllImport("HairWorksIntegration")] public static extern void hwInstanceGetDescriptor(HInstance iid, ref Descriptor desc);
         [DllImport("HairWorksIntegration")] public static extern void hwInstanceSetDescriptor(HInstance iid, ref Descriptor desc);
+        [DllImport("HairWorksIntegration")] public static extern void hwInstanceSetEnvironment(HInstance iid, ref Environment env);
         [DllImport("HairWorksIntegration")] public static extern void hwInstanceSetTexture(HInstance iid, TextureType type, IntPtr tex);
         [DllImport("HairWorksIntegration")] public static extern void hwInstanceUpdateSkinningMatrices(HInstance iid, int num_bones, IntPtr matrices);
         [DllImport("HairWorksIntegration")] public static extern void hwInstanceUpdateSkinningDQs(HInstance iid, int num_bones, IntPtr dqs);
@@ -555,7 +650,19 @@ namespace GameWorks
         [DllImport("HairWorksIntegration")] public static extern void hwSetGIParameters(ref Vector4 Params);
         [DllImport("HairWorksIntegration")] public static extern void hwRender(HInstance iid);
         [DllImport("HairWorksIntegration")] public static extern void hwRenderShadow(HInstance iid);
+        [DllImport("HairWorksIntegration")] public static extern void hwRenderBatch(int count, HInstance[] handles);
+        [DllImport("HairWorksIntegration")] public static extern void hwRenderShadowBatch(int count, HInstance[] handles);
         [DllImport("HairWorksIntegration")] public static extern void hwStepSimulation(float dt);
+        [DllImport("HairWorksIntegration")] public static extern void hwBeginFrame(int frame);
+        [DllImport("HairWorksIntegration")] public static extern void hwSubmit(int view);
+        [DllImport("HairWorksIntegration")] public static extern void hwSetStaleFramePolicy(StaleFramePolicy policy);
+        [DllImport("HairWorksIntegration")] public static extern void hwSetSortMode(SortMode mode);
+        [DllImport("HairWorksIntegration")] public static extern void hwGetStats(ref Stats o_stats);
+        [DllImport("HairWorksIntegration")] public static extern void hwGetBackendStats(ref BackendStats o_stats);
+
+        [DllImport("HairWorksIntegration")] public static extern Bool hwCaptureBegin(string path);
+        [DllImport("HairWorksIntegration")] public static extern void hwCaptureEnd();
+        [DllImport("HairWorksIntegration")] public static extern Bool hwCaptureReplay(string path, Bool realtime);
 
         static void LogCallback(System.IntPtr cstr)
         {
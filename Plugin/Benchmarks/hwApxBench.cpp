@@ -0,0 +1,254 @@
+﻿// reading APX files without the SDK (hwApxRead()) and cooking them, the way the asset cache does.
+// prints the best time of the repeats and what the cooked file weighs against the XML. for comparison, the time
+// strtof()/strtoul() take for the numbers of the same arrays, which is how they were read before hwApxRead() had
+// a number parser of its own.
+//
+//   hwApxBench <file.apx>... [--repeat <n>] [--workers <n>] [--check] [--scale <k>] [--fuzz <n>] [--save <path>]
+#include "pch.h"
+#include "hwInternal.h"
+#include "hwApxReader.h"
+#include "hwCookedAsset.h"
+#include "hwWorkerPool.h"
+#include <random>
+#include <cmath>
+
+typedef std::chrono::steady_clock hwClock;
+
+static double hwElapsedMS(hwClock::time_point begin)
+{
+    return std::chrono::duration<double, std::milli>(hwClock::now() - begin).count();
+}
+
+static void hwPrintUsage()
+{
+    printf("usage: hwApxBench <file.apx>... [--repeat <n>] [--workers <n>] [--check] [--scale <k>] [--fuzz <n>] [--save <path>]\n"
+        "  --repeat     reads of each file, the best is printed (default 50)\n"
+        "  --workers    also read with a worker pool of n threads, which parses large arrays in chunks\n"
+        "  --check      compare every float of the float arrays with what strtof() makes of its text\n"
+        "  --scale      repeat the vertices k times (k times the guide hairs' worth of text, for the chunked path)\n"
+        "  --fuzz       replace the vertices with n random ones, written in mixed formats\n"
+        "  --save       write the file as read (after --scale or --fuzz) to path. only with a single file\n");
+}
+
+struct hwApxText
+{
+    size_t begin, end;  // of the text between <array ...> and </array>
+    size_t size_attr;   // of the value of size=""
+};
+
+// the text of array name of the HairAssetDescriptor
+static bool hwFindArray(const std::string &data, const char *name, hwApxText &o)
+{
+    size_t at = data.find("className=\"HairAssetDescriptor\"");
+    if (at == std::string::npos) { return false; }
+    at = data.find(std::string("<array name=\"") + name + "\"", at);
+    if (at == std::string::npos) { return false; }
+    size_t tag_end = data.find('>', at);
+    o.size_attr = data.find("size=\"", at);
+    if (tag_end == std::string::npos || o.size_attr == std::string::npos || o.size_attr > tag_end) { return false; }
+    o.size_attr += 6;
+    o.begin = tag_end + 1;
+    o.end = data.find("</array>", o.begin);
+    return o.end != std::string::npos;
+}
+
+static void hwReplaceArray(std::string &data, const hwApxText &t, size_t count, const std::string &text)
+{
+    data.replace(t.begin, t.end - t.begin, text);
+    size_t len = data.find('"', t.size_attr) - t.size_attr;
+    data.replace(t.size_attr, len, std::to_string(count));
+}
+
+static bool hwIsApxSeparator(char c) { return c == ' ' || c == ',' || c == '\n' || c == '\r' || c == '\t'; }
+
+// text: what a number is made of. the formats an APX writer or a hand edit could produce, over the float range
+static std::string hwRandomNumber(std::mt19937 &rng)
+{
+    char buf[64];
+    int sign = rng() & 1 ? -1 : 1;
+    switch (rng() % 4) {
+    case 0: sprintf(buf, "%.*f", (int)(rng() % 8), sign * std::uniform_real_distribution<double>(0.0, 1000.0)(rng)); break;
+    case 1: sprintf(buf, "%.*e", (int)(rng() % 9), sign * std::uniform_real_distribution<double>(1.0, 10.0)(rng) * std::pow(10.0, (int)(rng() % 75) - 37)); break;
+    case 2: sprintf(buf, "%de%d", sign * (int)(rng() % 99999 + 1), (int)(rng() % 70) - 40); break;
+    default: sprintf(buf, "%.*g", (int)(rng() % 9) + 1, sign * std::uniform_real_distribution<double>(0.0, 1e7)(rng)); break;
+    }
+    return buf;
+}
+
+// every number of the arrays' text through strtof()/strtoul(). returns the milliseconds it took
+static double hwParseArraysStdC(const std::string &data, size_t &o_count)
+{
+    static const char *float_arrays[] = { "vertices", "faceUVs", "boneIndices", "boneWeights", "bindPoses" };
+    static const char *int_arrays[] = { "endIndices", "faceIndices", "boneParents" };
+    std::vector<hwApxText> floats, ints;
+    hwApxText t;
+    for (auto *name : float_arrays) { if (hwFindArray(data, name, t)) { floats.push_back(t); } }
+    for (auto *name : int_arrays) { if (hwFindArray(data, name, t)) { ints.push_back(t); } }
+
+    volatile float fsum = 0.0f;
+    volatile unsigned long isum = 0;
+    o_count = 0;
+    auto begin = hwClock::now();
+    for (int type = 0; type < 2; ++type) {
+        for (auto &a : type == 0 ? floats : ints) {
+            const char *p = data.data() + a.begin, *end = data.data() + a.end;
+            for (;;) {
+                while (p < end && hwIsApxSeparator(*p)) { ++p; }
+                if (p >= end) { break; }
+                char *next;
+                if (type == 0) { fsum = fsum + strtof(p, &next); }
+                else { isum = isum + strtoul(p, &next, 10); }
+                if (next == p) { break; }
+                p = next;
+                ++o_count;
+            }
+        }
+    }
+    return hwElapsedMS(begin);
+}
+
+// the floats of array name that differ from strtof() of their text, bit for bit
+static size_t hwCheckFloats(const std::string &data, const char *name, const float *values, size_t count)
+{
+    hwApxText t;
+    if (!hwFindArray(data, name, t)) { return 0; }
+    const char *p = data.data() + t.begin;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; ++i) {
+        while (hwIsApxSeparator(*p)) { ++p; }
+        char *next;
+        float expected = strtof(p, &next);
+        if (memcmp(&expected, &values[i], sizeof(float)) != 0) {
+            if (mismatches < 4) {
+                printf("    %s[%zu]: \"%.*s\" is %.9g, strtof() makes %.9g\n", name, i, (int)(next - p), p, values[i], expected);
+            }
+            ++mismatches;
+        }
+        p = next;
+    }
+    return mismatches;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<const char*> paths;
+    const char *save_path = nullptr;
+    int repeat = 50, num_workers = 0, scale = 1, fuzz = 0;
+    bool check = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) { repeat = std::max<int>(atoi(argv[++i]), 1); }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) { num_workers = std::max<int>(atoi(argv[++i]), 0); }
+        else if (strcmp(argv[i], "--check") == 0) { check = true; }
+        else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) { scale = std::max<int>(atoi(argv[++i]), 1); }
+        else if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc) { fuzz = std::max<int>(atoi(argv[++i]), 1); }
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) { save_path = argv[++i]; }
+        else if (argv[i][0] != '-') { paths.push_back(argv[i]); }
+        else {
+            hwPrintUsage();
+            return 2;
+        }
+    }
+    if (paths.empty() || (save_path && paths.size() != 1)) {
+        hwPrintUsage();
+        return 2;
+    }
+
+    hwWorkerPool workers;
+    workers.setNumThreads(num_workers);
+    std::mt19937 rng(12345);
+
+    int ret = 0;
+    for (auto *path : paths) {
+        std::string data;
+        if (!hwFileToString(data, path)) {
+            printf("%s: can't read\n", path);
+            ret = 1;
+            continue;
+        }
+
+        hwApxText vertices;
+        if ((scale > 1 || fuzz > 0) && !hwFindArray(data, "vertices", vertices)) {
+            printf("%s: no vertices to --scale or --fuzz\n", path);
+            ret = 1;
+            continue;
+        }
+        if (fuzz > 0) {
+            std::string text;
+            for (int v = 0; v < fuzz; ++v) {
+                text += hwRandomNumber(rng) + " " + hwRandomNumber(rng) + " " + hwRandomNumber(rng) + (v + 1 < fuzz ? ", " : "\n");
+            }
+            hwReplaceArray(data, vertices, fuzz, text);
+        }
+        else if (scale > 1) {
+            // the number of vertices isn't checked against the guide hairs
+            std::string text = data.substr(vertices.begin, vertices.end - vertices.begin), scaled;
+            while (!text.empty() && (text.back() == ' ' || text.back() == '\n' || text.back() == '\r')) { text.pop_back(); }
+            size_t count = strtoul(data.c_str() + vertices.size_attr, nullptr, 10);
+            for (int k = 0; k < scale; ++k) { scaled += text + (k + 1 < scale ? ",\n" : "\n"); }
+            hwReplaceArray(data, vertices, count * scale, scaled);
+        }
+        if (save_path) {
+            std::ofstream out(save_path, std::ios::binary);
+            out.write(data.data(), data.size());
+            if (!out) {
+                printf("%s: can't write\n", save_path);
+                return 1;
+            }
+        }
+
+        // 0: on the calling thread, 1: with the pool
+        hwApxAsset apx;
+        double best[2] = {};
+        bool ok = true;
+        for (int pass = 0; pass < (num_workers > 0 ? 2 : 1) && ok; ++pass) {
+            for (int r = 0; r < repeat && ok; ++r) {
+                hwApxAsset a;
+                auto begin = hwClock::now();
+                ok = hwApxRead(data.data(), data.size(), a, pass == 1 ? &workers : nullptr);
+                double ms = hwElapsedMS(begin);
+                if (r == 0 || ms < best[pass]) { best[pass] = ms; }
+                apx = std::move(a);
+            }
+        }
+        if (!ok) {
+            printf("%s: hwApxRead() failed\n", path);
+            ret = 1;
+            continue;
+        }
+
+        size_t num_numbers = 0;
+        double stdc = 0.0;
+        for (int r = 0; r < repeat; ++r) {
+            double ms = hwParseArraysStdC(data, num_numbers);
+            if (r == 0 || ms < stdc) { stdc = ms; }
+        }
+
+        std::string cooked;
+        auto begin = hwClock::now();
+        hwCookAsset(apx, apx.materials.empty() ? nullptr : &apx.materials[0], 0, 0, 0, data.size(), cooked);
+        double cook_ms = hwElapsedMS(begin);
+
+        printf("%s: %.2f MB\n", path, data.size() / 1e6);
+        printf("  hwApxRead:   %7.2f ms, %6.1f MB/s (best of %d)\n", best[0], data.size() / best[0] / 1e3, repeat);
+        if (num_workers > 0) {
+            printf("  %d workers:   %7.2f ms, %6.1f MB/s\n", num_workers, best[1], data.size() / best[1] / 1e3);
+        }
+        printf("  strtof:      %7.2f ms, %6.1f MB/s for the %zu numbers of the arrays alone\n", stdc, data.size() / stdc / 1e3, num_numbers);
+        printf("  hwCookAsset: %7.2f ms, %.2f MB cooked (%.0f%% of the XML)\n", cook_ms, cooked.size() / 1e6, 100.0 * cooked.size() / data.size());
+        printf("  %u guide hairs, %zu vertices, %zu faces, %zu bones, %zu materials\n",
+            apx.num_guide_hairs, apx.vertices.size(), apx.face_indices.size() / 3, apx.bind_poses.size(), apx.materials.size());
+
+        if (check) {
+            size_t checked = apx.vertices.size() * 3 + apx.face_uvs.size() * 2 + apx.bone_weights.size() * 4 + apx.bind_poses.size() * 16;
+            size_t mismatches =
+                hwCheckFloats(data, "vertices", (const float*)apx.vertices.data(), apx.vertices.size() * 3) +
+                hwCheckFloats(data, "faceUVs", (const float*)apx.face_uvs.data(), apx.face_uvs.size() * 2) +
+                hwCheckFloats(data, "boneWeights", (const float*)apx.bone_weights.data(), apx.bone_weights.size() * 4) +
+                hwCheckFloats(data, "bindPoses", (const float*)apx.bind_poses.data(), apx.bind_poses.size() * 16);
+            printf("  check: %zu of %zu floats differ from strtof()\n", mismatches, checked);
+            if (mismatches) { ret = 1; }
+        }
+    }
+    workers.finalize();
+    return ret;
+}
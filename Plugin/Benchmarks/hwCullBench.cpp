@@ -0,0 +1,82 @@
+﻿// the passes the render thread makes over the instance store, with 10000 instances by default:
+// frustum culling, bounds updates on the null backend, and taking a new version of the game thread's store.
+//
+//   hwCullBench [instances] [iterations]
+#include "pch.h"
+#include "hwInternal.h"
+#include "hwBackend.h"
+#include "hwInstanceStore.h"
+#include <cmath>
+
+typedef std::chrono::steady_clock hwClock;
+
+static double hwElapsedNS(hwClock::time_point begin)
+{
+    return std::chrono::duration<double, std::nano>(hwClock::now() - begin).count();
+}
+
+// column major, as hwSetViewProjection() takes them
+static void hwSetElement(hwMatrix &m, int r, int c, float v) { ((float*)&m)[c * 4 + r] = v; }
+
+int main(int argc, char *argv[])
+{
+    int num_instances = argc > 1 ? std::max<int>(atoi(argv[1]), 1) : 10000;
+    int iterations = argc > 2 ? std::max<int>(atoi(argv[2]), 1) : 1000;
+
+    // camera at the origin looking down -z, 60 degrees vertical fov
+    hwMatrix view, proj;
+    memset(&view, 0, sizeof(view));
+    memset(&proj, 0, sizeof(proj));
+    for (int i = 0; i < 4; ++i) { hwSetElement(view, i, i, 1.0f); }
+    float f = 1.0f / std::tan(30.0f * 3.14159265f / 180.0f), znear = 0.1f, zfar = 1000.0f;
+    hwSetElement(proj, 0, 0, f / (16.0f / 9.0f));
+    hwSetElement(proj, 1, 1, f);
+    hwSetElement(proj, 2, 2, (zfar + znear) / (znear - zfar));
+    hwSetElement(proj, 2, 3, 2.0f * zfar * znear / (znear - zfar));
+    hwSetElement(proj, 3, 2, -1.0f);
+
+    // instances of 2 units scattered around the camera, about half of them in view
+    hwInstanceStore game;
+    uint32_t seed = 12345;
+    auto rnd = [&seed](float lo, float hi) {
+        seed = seed * 1664525u + 1013904223u;
+        return lo + (hi - lo) * (float)(seed >> 8) / (float)(1 << 24);
+    };
+    for (int i = 0; i < num_instances; ++i) {
+        uint32_t idx = game.add((hwHInstance)i, (hwInstanceID)i, hwNullHandle);
+        hwFloat3 c = { rnd(-200.0f, 200.0f), rnd(-100.0f, 100.0f), rnd(-300.0f, 100.0f) };
+        game.bounds[idx].bmin = { c.x - 1.0f, c.y - 1.0f, c.z - 1.0f };
+        game.bounds[idx].bmax = { c.x + 1.0f, c.y + 1.0f, c.z + 1.0f };
+        game.flags[idx] |= hwEInstanceFlag_BoundsValid;
+    }
+
+    // publishing copies the game thread's store, merging builds the render thread's from it
+    hwInstanceStore published, render;
+    auto begin = hwClock::now();
+    for (int i = 0; i < iterations; ++i) {
+        published = game;
+        render.merge(published);
+    }
+    double merge_ns = hwElapsedNS(begin) / iterations;
+
+    int culled = 0;
+    begin = hwClock::now();
+    for (int i = 0; i < iterations; ++i) {
+        culled = render.cull(view, proj);
+    }
+    double cull_ns = hwElapsedNS(begin) / iterations;
+
+    hwBackend *backend = hwCreateBackendNull(0);
+    begin = hwClock::now();
+    for (int i = 0; i < iterations; ++i) {
+        render.updateBounds(backend);
+    }
+    double bounds_ns = hwElapsedNS(begin) / iterations;
+    delete backend;
+
+    printf("%d instances, %d iterations\n", num_instances, iterations);
+    printf("  cull:          %8.1f us per pass, %5.2f ns per instance. %d culled\n", cull_ns / 1000.0, cull_ns / num_instances, culled);
+    printf("  updateBounds:  %8.1f us per pass, %5.2f ns per instance (null backend)\n", bounds_ns / 1000.0, bounds_ns / num_instances);
+    printf("  publish+merge: %8.1f us per pass, %5.2f ns per instance\n", merge_ns / 1000.0, merge_ns / num_instances);
+    return 0;
+}
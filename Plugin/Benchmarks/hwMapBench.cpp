@@ -0,0 +1,158 @@
+﻿// reading an APX file copied into memory (hwFileToString()) against reading it mapped (hwMappedFile), as asset loads
+// do: the time of the read plus hwApxRead(), and on Linux the anonymous memory the process has while the data is alive.
+// mapped pages are file-backed: they are shared with the page cache and can be reclaimed, copied ones can't.
+// memory is measured in a child process per read, forked before anything else has been read, so neither reuses what
+// an earlier read freed. both include the asset read.
+//
+//   hwMapBench <file.apx>... [--repeat <n>]
+//
+// a large file to try: hwApxBench Manjaladon_wFur.apx --scale 20 --save big.apx
+#include "pch.h"
+#include "hwInternal.h"
+#include "hwApxReader.h"
+#include "hwReadStream.h"
+#ifdef __linux__
+#include <sys/wait.h>
+#endif
+
+typedef std::chrono::steady_clock hwClock;
+
+static double hwElapsedMS(hwClock::time_point begin)
+{
+    return std::chrono::duration<double, std::milli>(hwClock::now() - begin).count();
+}
+
+// kB of a line of /proc/self/status ("RssAnon:", "RssFile:"). -1 where there is none
+static long hwProcStatus(const char *key)
+{
+#ifdef __linux__
+    std::ifstream f("/proc/self/status");
+    std::string line;
+    size_t len = strlen(key);
+    while (std::getline(f, line)) {
+        if (line.compare(0, len, key) == 0) { return atol(line.c_str() + len); }
+    }
+#endif
+    return -1;
+}
+
+struct hwMapResult
+{
+    double ms = 0.0;    // best of the repeats
+    long anon_kb = -1;  // RssAnon added while the data and the asset read from it are alive
+    long file_kb = -1;  // RssFile added
+    bool ok = true;
+};
+
+// read(sample) reads the file and calls sample() while the data is alive. false if it couldn't
+template<class Read>
+static void hwMeasureMemory(hwMapResult &r, const Read &read)
+{
+#ifdef __linux__
+    int fds[2];
+    if (pipe(fds) == 0) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            long kb[2] = { hwProcStatus("RssAnon:"), hwProcStatus("RssFile:") };
+            read([&]() {
+                kb[0] = hwProcStatus("RssAnon:") - kb[0];
+                kb[1] = hwProcStatus("RssFile:") - kb[1];
+            });
+            ssize_t written = write(fds[1], kb, sizeof(kb));
+            _exit(written == sizeof(kb) ? 0 : 1);
+        }
+        long kb[2];
+        if (pid > 0 && ::read(fds[0], kb, sizeof(kb)) == sizeof(kb)) {
+            r.anon_kb = kb[0];
+            r.file_kb = kb[1];
+        }
+        if (pid > 0) { waitpid(pid, nullptr, 0); }
+        close(fds[0]);
+        close(fds[1]);
+    }
+#endif
+}
+
+template<class Read>
+static void hwMeasureTime(hwMapResult &r, int repeat, const Read &read)
+{
+    for (int i = 0; i < repeat && r.ok; ++i) {
+        auto begin = hwClock::now();
+        r.ok = read([]() {});
+        double ms = hwElapsedMS(begin);
+        if (i == 0 || ms < r.ms) { r.ms = ms; }
+    }
+}
+
+static void hwPrintResult(const char *what, const hwMapResult &r)
+{
+    if (r.anon_kb >= 0) {
+        printf("  %-8s %7.2f ms, RssAnon +%.1f MB, RssFile +%.1f MB\n", what, r.ms, r.anon_kb / 1024.0, r.file_kb / 1024.0);
+    }
+    else {
+        printf("  %-8s %7.2f ms\n", what, r.ms);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<const char*> paths;
+    int repeat = 20;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) { repeat = std::max<int>(atoi(argv[++i]), 1); }
+        else if (argv[i][0] != '-') { paths.push_back(argv[i]); }
+        else { paths.clear(); break; }
+    }
+    if (paths.empty()) {
+        printf("usage: hwMapBench <file.apx>... [--repeat <n>]\n"
+            "  --repeat     reads of each file, the best time is printed (default 20). memory is of the first\n");
+        return 2;
+    }
+
+    int ret = 0;
+    for (auto *path : paths) {
+        // the first read of a file pays for the page cache. both read it warm
+        {
+            hwMappedFile warm;
+            if (!warm.open(path)) {
+                printf("%s: can't read\n", path);
+                ret = 1;
+                continue;
+            }
+            volatile char sum = 0;
+            for (size_t i = 0; i < warm.size(); i += 4096) { sum = sum + warm.data()[i]; }
+        }
+
+        auto read_copied = [&](const std::function<void()> &sample) {
+            std::string data;
+            hwApxAsset apx;
+            if (!hwFileToString(data, path) || !hwApxRead(data.data(), data.size(), apx)) { return false; }
+            sample();
+            return true;
+        };
+        auto read_mapped = [&](const std::function<void()> &sample) {
+            hwMappedFile file;
+            hwApxAsset apx;
+            if (!file.open(path) || !hwApxRead(file.data(), file.size(), apx)) { return false; }
+            sample();
+            return true;
+        };
+        hwMapResult copied, mapped;
+        hwMeasureMemory(copied, read_copied);
+        hwMeasureMemory(mapped, read_mapped);
+        hwMeasureTime(copied, repeat, read_copied);
+        hwMeasureTime(mapped, repeat, read_mapped);
+        if (!copied.ok || !mapped.ok) {
+            printf("%s: hwApxRead() failed\n", path);
+            ret = 1;
+            continue;
+        }
+
+        hwMappedFile file;
+        file.open(path);
+        printf("%s: %.2f MB, read and hwApxRead() (best of %d)\n", path, file.size() / 1e6, repeat);
+        hwPrintResult("copied:", copied);
+        hwPrintResult("mapped:", mapped);
+    }
+    return ret;
+}
@@ -0,0 +1,141 @@
+﻿// loading one APX file with several conversion settings, the way a groom used at several scene scales is: the
+// variants of one path, which share the parsed source of the file (hwAssetSource), against as many copies of the
+// file, which are read and parsed one by one as every variant of a path used to be. loads go through the null
+// backend, whose parse stands in for the SDK's (see hwBackendNull::loadAsset()). the asset cache is off.
+// prints the best time of the repeats, synchronous loads one after the other and asynchronous ones all at once.
+//
+//   hwVariantBench <file.apx>... [--variants <n>] [--repeat <n>]
+#include "pch.h"
+#include "hwInternal.h"
+#include "hwContext.h"
+#ifndef hwWindows
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+typedef std::chrono::steady_clock hwClock;
+
+static double hwElapsedMS(hwClock::time_point begin)
+{
+    return std::chrono::duration<double, std::milli>(hwClock::now() - begin).count();
+}
+
+// the context logs every load to stdout. hidden while loads are measured
+class hwQuietStdout
+{
+public:
+    hwQuietStdout()
+    {
+        fflush(stdout);
+#ifndef hwWindows
+        m_saved = dup(1);
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, 1);
+            close(null);
+        }
+#endif
+    }
+    ~hwQuietStdout()
+    {
+        fflush(stdout);
+#ifndef hwWindows
+        if (m_saved >= 0) {
+            dup2(m_saved, 1);
+            close(m_saved);
+        }
+#endif
+    }
+
+private:
+    int m_saved = -1;
+};
+
+// loads paths[i] with the scene unit i + 1 on a new context, and releases them. returns the milliseconds the loads
+// took, -1 if one failed
+static double hwLoadVariants(const std::vector<std::string> &paths, bool async)
+{
+    hwQuietStdout quiet;
+    if (!hwInitializeNull(0)) { return -1.0; }
+
+    std::vector<hwHAsset> assets;
+    bool ok = true;
+    auto begin = hwClock::now();
+    for (size_t i = 0; i < paths.size(); ++i) {
+        float unit = (float)(i + 1);
+        assets.push_back(async ? hwAssetLoadFromFileAsync(paths[i].c_str(), unit, nullptr, nullptr) : hwAssetLoadFromFile(paths[i].c_str(), unit));
+    }
+    for (hwHAsset ha : assets) {
+        int status;
+        while ((status = hwAssetGetStatus(ha)) == hwEAssetStatus_Loading) { std::this_thread::yield(); }
+        ok = ok && status == hwEAssetStatus_Ready;
+    }
+    double ms = hwElapsedMS(begin);
+
+    for (hwHAsset ha : assets) { hwAssetRelease(ha); }
+    hwFinalize();
+    return ok ? ms : -1.0;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<const char*> paths;
+    int variants = 4, repeat = 10;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--variants") == 0 && i + 1 < argc) { variants = std::max<int>(atoi(argv[++i]), 1); }
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) { repeat = std::max<int>(atoi(argv[++i]), 1); }
+        else if (argv[i][0] != '-') { paths.push_back(argv[i]); }
+        else { paths.clear(); break; }
+    }
+    if (paths.empty()) {
+        printf("usage: hwVariantBench <file.apx>... [--variants <n>] [--repeat <n>]\n"
+            "  --variants   conversion settings each file is loaded with (default 4)\n"
+            "  --repeat     loads of the variants, the best is printed (default 10)\n");
+        return 2;
+    }
+
+    int ret = 0;
+    for (auto *path : paths) {
+        std::string data;
+        if (!hwFileToString(data, path)) {
+            printf("%s: can't read\n", path);
+            ret = 1;
+            continue;
+        }
+
+        // the copies go next to the file, and are removed after
+        std::vector<std::string> shared(variants, path), copies;
+        bool written = true;
+        for (int i = 0; i < variants; ++i) {
+            copies.push_back(std::string(path) + ".variant" + std::to_string(i) + ".apx");
+            std::ofstream out(copies.back(), std::ios::binary);
+            out.write(data.data(), data.size());
+            written = written && !!out;
+        }
+
+        printf("%s: %.1f MB, %d variants\n", path, data.size() / (1024.0 * 1024.0), variants);
+        if (written) {
+            for (int async = 0; async < 2; ++async) {
+                double best[2] = { -1.0, -1.0 }; // shared, copies
+                for (int r = 0; r < repeat; ++r) {
+                    for (int k = 0; k < 2; ++k) {
+                        double ms = hwLoadVariants(k == 0 ? shared : copies, async != 0);
+                        if (ms >= 0.0 && (best[k] < 0.0 || ms < best[k])) { best[k] = ms; }
+                    }
+                }
+                if (best[0] < 0.0 || best[1] < 0.0) {
+                    printf("  %-5s failed to load\n", async ? "async" : "sync");
+                    ret = 1;
+                    continue;
+                }
+                printf("  %-5s shared source %8.2f ms, copies %8.2f ms (%.2fx)\n", async ? "async" : "sync", best[0], best[1], best[1] / best[0]);
+            }
+        }
+        else {
+            printf("  can't write the copies next to the file\n");
+            ret = 1;
+        }
+        for (auto &c : copies) { remove(c.c_str()); }
+    }
+    return ret;
+}
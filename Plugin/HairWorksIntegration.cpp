@@ -1,18 +1,26 @@
 ﻿#include "pch.h"
 #include "hwInternal.h"
 #include "hwContext.h"
+#include "hwBackend.h"
 
 struct hwPluginContext
 {
+#ifdef hwWithD3D11
 	IUnityInterfaces* unity_interface;
 	IUnityGraphics* unity_graphics;
 	IUnityGraphicsD3D11* unity_graphics_d3d11;
+#endif // hwWithD3D11
 	ID3D11Device* d3d11_device;
 	hwContext* hw_ctx;
 	hwLogCallback       log_callback;
 
+#ifdef hwWithD3D11
 	hwPluginContext() : unity_interface(nullptr), unity_graphics(nullptr), unity_graphics_d3d11(nullptr), d3d11_device(nullptr), hw_ctx(nullptr), log_callback(nullptr)
 	{}
+#else // hwWithD3D11
+	hwPluginContext() : d3d11_device(nullptr), hw_ctx(nullptr), log_callback(nullptr)
+	{}
+#endif // hwWithD3D11
 };
 hwPluginContext g_ctx;
 
@@ -23,6 +31,9 @@ hwPluginContext g_ctx;
 #define g_hw_ctx                g_ctx.hw_ctx
 #define g_log_callback          g_ctx.log_callback
 
+// the Unity plugin interface and the DLL glue only exist with the D3D11 backend.
+// headless builds drive the context through the exports directly (see hwInitializeNull()).
+#ifdef hwWithD3D11
 
 static void UNITY_INTERFACE_API UnityOnGraphicsDeviceEvent(UnityGfxDeviceEventType eventType)
 {
@@ -38,6 +49,11 @@ static void UNITY_INTERFACE_API UnityRenderEvent(int eventID)
 			ctx->flush();
 		}
 	}
+	else if (eventID & hwFlushEventFlag) {
+		if (auto ctx = hwGetContext()) {
+			ctx->flush(eventID & hwFrameIndexMask, (eventID >> hwViewIndexShift) & hwViewIndexMask);
+		}
+	}
 }
 
 extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API
@@ -68,6 +84,8 @@ hwGetRenderEventFunc()
 	return UnityRenderEvent;
 }
 
+#endif // hwWithD3D11
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 // PatchLibrary 用のコンテキスト移動処理群
 
@@ -77,6 +95,8 @@ hwExport hwPluginContext* hwGetPluginContext()
 }
 typedef hwPluginContext* (*hwGetPluginContextT)();
 
+#ifdef hwWithD3D11
+
 // PatchLibrary で突っ込まれたモジュールは UnityPluginLoad() が呼ばれないので、
 // DLL_PROCESS_ATTACH のタイミングで先にロードされているモジュールからコンテキストを移管して同等の処理を行う。
 BOOL WINAPI DllMain(HINSTANCE module_handle, DWORD reason_for_call, LPVOID reserved)
@@ -113,6 +133,8 @@ extern "C" { int __afxForceUSRDLL; }
 extern "C" { int _afxForceUSRDLL; }
 #endif
 
+#endif // hwWithD3D11
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
@@ -128,7 +150,7 @@ void hwLogImpl(const char* fmt, ...)
 #ifdef hwWindows
 	::OutputDebugStringA(buf);
 #else // hwWindows
-	printf(buf);
+	fputs(buf, stdout);
 #endif // hwWindows
 	if (g_log_callback) { g_log_callback(buf); }
 
@@ -172,6 +194,24 @@ extern "C" {
 		}
 	}
 
+	// headless context for benchmarks and tests: the null backend stands in for D3D11 and the SDK,
+	// which is never loaded. hwFinalize() first if a context already exists.
+	hwExport bool hwInitializeNull(int latency_us)
+	{
+		if (g_hw_ctx != nullptr) {
+			return false;
+		}
+
+		g_hw_ctx = new hwContext();
+		if (g_hw_ctx->initialize(hwCreateBackendNull(latency_us))) {
+			return true;
+		}
+		else {
+			hwFinalize();
+			return false;
+		}
+	}
+
 	hwExport void hwFinalize()
 	{
 		delete g_hw_ctx;
@@ -186,6 +226,11 @@ extern "C" {
 
 
 
+	hwExport int hwGetFlushEventID(int frame, int view)
+	{
+		return hwFlushEventFlag | ((view & hwViewIndexMask) << hwViewIndexShift) | (frame & hwFrameIndexMask);
+	}
+
 	hwExport void hwSetLogCallback(hwLogCallback cb)
 	{
 		g_log_callback = cb;
@@ -199,6 +244,14 @@ extern "C" {
 		}
 		return hwNullHandle;
 	}
+	hwExport hwHShader hwShaderLoadFromMemory(const void* data, int size)
+	{
+		if (data == nullptr || size <= 0) { return hwNullHandle; }
+		if (auto ctx = hwGetContext()) {
+			return ctx->shaderLoadFromMemory(data, (size_t)size);
+		}
+		return hwNullHandle;
+	}
 	hwExport void hwShaderRelease(hwHShader sid)
 	{
 		if (auto ctx = hwGetContext()) {
@@ -214,20 +267,78 @@ extern "C" {
 	}
 
 
+	static hwConversionSettings hwMakeConversionSettings(float unit)
+	{
+		hwConversionSettings settings;
+		ZeroMemory(&settings, sizeof(settings));
+		settings.m_targetUpAxisHint = NvHair::AxisHint::Y_UP;
+		// Allow user to specify scale
+		settings.m_targetSceneUnit = unit;
+		settings.m_targetHandednessHint = NvHair::HandednessHint::RIGHT;
+		return settings;
+	}
+
 	hwExport hwHAsset hwAssetLoadFromFile(const char* path, float unit)
 	{
 		if (path == nullptr || path[0] == '\0') { return hwNullHandle; }
 		if (auto ctx = hwGetContext()) {
-			hwConversionSettings settings;
-			ZeroMemory(&settings, sizeof(settings));
-			settings.m_targetUpAxisHint = NvHair::AxisHint::Y_UP;
-			// Allow user to specify scale
-			settings.m_targetSceneUnit = unit;
-			settings.m_targetHandednessHint = NvHair::HandednessHint::RIGHT;
+			hwConversionSettings settings = hwMakeConversionSettings(unit);
 			return ctx->assetLoadFromFile(path, &settings);
 		}
 		return hwNullHandle;
 	}
+
+	hwExport hwHAsset hwAssetLoadFromFileAsync(const char* path, float unit, hwAssetLoadCallback cb, void* userdata)
+	{
+		if (path == nullptr || path[0] == '\0') { return hwNullHandle; }
+		if (auto ctx = hwGetContext()) {
+			hwConversionSettings settings = hwMakeConversionSettings(unit);
+			return ctx->assetLoadFromFileAsync(path, &settings, cb, userdata);
+		}
+		return hwNullHandle;
+	}
+
+	hwExport hwHAsset hwAssetLoadFromMemory(const void* data, int size, float unit)
+	{
+		if (data == nullptr || size <= 0) { return hwNullHandle; }
+		if (auto ctx = hwGetContext()) {
+			hwConversionSettings settings = hwMakeConversionSettings(unit);
+			return ctx->assetLoadFromMemory(data, (size_t)size, &settings);
+		}
+		return hwNullHandle;
+	}
+
+	hwExport int hwAssetGetStatus(hwHAsset aid)
+	{
+		if (auto ctx = hwGetContext()) {
+			return ctx->assetGetStatus(aid);
+		}
+		return hwEAssetStatus_Invalid;
+	}
+
+	hwExport void hwSetAssetCacheDirectory(const char* dir)
+	{
+		if (auto ctx = hwGetContext()) {
+			ctx->setAssetCacheDirectory(dir ? dir : "");
+		}
+	}
+
+	hwExport void hwSetFileWatching(bool enabled)
+	{
+		if (auto ctx = hwGetContext()) {
+			ctx->setFileWatching(enabled);
+		}
+	}
+
+	hwExport bool hwAssetCook(const char* path, float unit)
+	{
+		if (path == nullptr || path[0] == '\0') { return false; }
+		if (auto ctx = hwGetContext()) {
+			hwConversionSettings settings = hwMakeConversionSettings(unit);
+			return ctx->assetCook(path, &settings);
+		}
+		return false;
+	}
 	hwExport void hwAssetRelease(hwHAsset aid)
 	{
 		if (auto ctx = hwGetContext()) {
@@ -242,6 +353,14 @@ extern "C" {
 		}
 	}
 
+	hwExport int hwAssetGetRevision(hwHAsset aid)
+	{
+		if (auto ctx = hwGetContext()) {
+			return ctx->assetGetRevision(aid);
+		}
+		return 0;
+	}
+
 	hwExport int hwAssetGetNumBones(hwHAsset aid)
 	{
 		if (auto ctx = hwGetContext()) {
@@ -324,6 +443,13 @@ extern "C" {
 			ctx->instanceSetTexture(iid, type, tex);
 		}
 	}
+	hwExport void hwInstanceSetEnvironment(hwHInstance iid, const hwEnvironmentData* env)
+	{
+		if (env == nullptr) { return; }
+		if (auto ctx = hwGetContext()) {
+			ctx->instanceSetEnvironment(iid, *env);
+		}
+	}
 	hwExport void hwInstanceUpdateSkinningMatrices(hwHInstance iid, int num_bones, hwMatrix* matrices)
 	{
 		if (auto ctx = hwGetContext()) {
@@ -435,6 +561,20 @@ extern "C" {
 		}
 	}
 
+	hwExport void hwRenderBatch(int count, const hwHInstance* handles)
+	{
+		if (auto ctx = hwGetContext()) {
+			ctx->renderBatch(count, handles);
+		}
+	}
+
+	hwExport void hwRenderShadowBatch(int count, const hwHInstance* handles)
+	{
+		if (auto ctx = hwGetContext()) {
+			ctx->renderShadowBatch(count, handles);
+		}
+	}
+
 	hwExport void hwStepSimulation(float dt)
 	{
 		if (auto ctx = hwGetContext()) {
@@ -442,4 +582,74 @@ extern "C" {
 		}
 	}
 
+	hwExport void hwBeginFrame(int frame)
+	{
+		if (auto ctx = hwGetContext()) {
+			ctx->beginFrame(frame);
+		}
+	}
+
+	hwExport void hwSubmit(int view)
+	{
+		if (auto ctx = hwGetContext()) {
+			ctx->submit(view);
+		}
+	}
+
+	hwExport void hwSetStaleFramePolicy(int policy)
+	{
+		if (auto ctx = hwGetContext()) {
+			ctx->setStaleFramePolicy((hwEStaleFramePolicy)policy);
+		}
+	}
+
+	hwExport void hwSetSortMode(int mode)
+	{
+		if (auto ctx = hwGetContext()) {
+			ctx->setSortMode((hwESortMode)mode);
+		}
+	}
+
+	hwExport void hwGetStats(hwStats* o_stats)
+	{
+		if (o_stats == nullptr) { return; }
+		if (auto ctx = hwGetContext()) {
+			ctx->getStats(*o_stats);
+		}
+	}
+
+	hwExport void hwGetBackendStats(hwBackendStats* o_stats)
+	{
+		if (o_stats == nullptr) { return; }
+		if (auto ctx = hwGetContext()) {
+			ctx->getBackendStats(*o_stats);
+		}
+	}
+
+	hwExport bool hwCaptureBegin(const char* path)
+	{
+		if (path == nullptr || path[0] == '\0') { return false; }
+		if (auto ctx = hwGetContext()) {
+			return ctx->captureBegin(path);
+		}
+		return false;
+	}
+
+	hwExport void hwCaptureEnd()
+	{
+		if (auto ctx = hwGetContext()) {
+			ctx->captureEnd();
+		}
+	}
+
+	// replays on the calling thread, flushes included. meant for a standalone harness rather than a running Unity session.
+	hwExport bool hwCaptureReplay(const char* path, bool realtime)
+	{
+		if (path == nullptr || path[0] == '\0') { return false; }
+		if (auto ctx = hwGetContext()) {
+			return hwReplayCaptureFile(*ctx, path, realtime);
+		}
+		return false;
+	}
+
 } // extern "C"
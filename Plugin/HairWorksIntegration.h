@@ -1,11 +1,18 @@
 ﻿#pragma once
 
-#ifdef _WIN32
+#if defined(hwHeadless)
+#define hwExport // linked statically (see CMakeLists.txt)
+#elif defined(_WIN32)
 #ifdef hwImpl
 #define hwExport __declspec(dllexport)
 #else
 #define hwExport __declspec(dllimport)
 #endif
+#else
+#define hwExport __attribute__((visibility("default")))
+#endif
+#ifndef _WIN32
+#define __stdcall
 #endif
 
 typedef NvHair::Sdk                   hwSDK;
@@ -13,6 +20,7 @@ typedef NvHair::AssetId               hwAssetID;
 typedef NvHair::InstanceId            hwInstanceID;
 typedef NvHair::InstanceDescriptor    hwHairDescriptor;
 typedef NvHair::ConversionSettings    hwConversionSettings;
+typedef NvHair::AssetDescriptor       hwAssetDescriptor;
 typedef NvHair::TextureType::Enum     hwTextureType;
 
 typedef gfsdk_float3            hwFloat3;
@@ -29,16 +37,30 @@ typedef ID3D11ShaderResourceView        hwSRV;
 typedef ID3D11RenderTargetView          hwRTV;
 
 typedef void(__stdcall* hwLogCallback)(const char*);
+typedef void(__stdcall* hwAssetLoadCallback)(hwHAsset ha, int status, void *userdata); // status: hwEAssetStatus
 #define hwNullAssetID       NvHair::ASSET_ID_NULL
 #define hwNullInstanceID    NvHair::INSTANCE_ID_NULL
 #define hwNullHandle        0xFFFFFFFF
 #define hwMaxLights         8
 
+// render event IDs. 0 flushes everything submitted so far.
+// hwGetFlushEventID(frame, view) flushes only the commands submitted for that view in that frame (see hwBeginFrame() and hwSubmit()).
+// view 0 (hwSharedView) is for commands that are not bound to a camera, like simulation. they run once per frame.
+#define hwFlushEventFlag    0x40000000
+#define hwFrameIndexMask    0x007FFFFF
+#define hwViewIndexShift    23
+#define hwViewIndexMask     0x7F
+#define hwMaxViews          (hwViewIndexMask + 1)
+#define hwSharedView        0
+
 
 struct  hwShaderData;
 struct  hwAssetData;
 struct  hwInstanceData;
 struct  hwLightData;
+struct  hwEnvironmentData;
+struct  hwStats;
+struct  hwBackendStats;
 class   hwContext;
 
 
@@ -50,18 +72,27 @@ extern "C"
 	hwExport void           hwUnloadHairWorks();
 
 	hwExport bool           hwInitialize();
+	hwExport bool           hwInitializeNull(int latency_us);
 	hwExport void           hwFinalize();
 	hwExport hwContext* hwGetContext();
-	hwExport int            hwGetFlushEventID();
+	hwExport int            hwGetFlushEventID(int frame, int view);
 	hwExport void           hwSetLogCallback(hwLogCallback cb);
 
 	hwExport hwHShader      hwShaderLoadFromFile(const char* path);
+	hwExport hwHShader      hwShaderLoadFromMemory(const void* data, int size);
 	hwExport void           hwShaderRelease(hwHShader sid);
 	hwExport void           hwShaderReload(hwHShader sid);
 
 	hwExport hwHAsset       hwAssetLoadFromFile(const char* path, float unit);
+	hwExport hwHAsset       hwAssetLoadFromFileAsync(const char* path, float unit, hwAssetLoadCallback cb, void* userdata);
+	hwExport hwHAsset       hwAssetLoadFromMemory(const void* data, int size, float unit);
+	hwExport int            hwAssetGetStatus(hwHAsset aid);
+	hwExport void           hwSetAssetCacheDirectory(const char* dir);
+	hwExport void           hwSetFileWatching(bool enabled);
+	hwExport bool           hwAssetCook(const char* path, float unit);
 	hwExport void           hwAssetRelease(hwHAsset aid);
 	hwExport void           hwAssetReload(hwHAsset aid);
+	hwExport int            hwAssetGetRevision(hwHAsset aid);
 	hwExport int            hwAssetGetNumBones(hwHAsset aid);
 	hwExport const char* hwAssetGetBoneName(hwHAsset aid, int nth);
 	hwExport void           hwAssetGetBoneIndices(hwHAsset aid, hwFloat4& o_indices);
@@ -76,6 +107,7 @@ extern "C"
 	hwExport void           hwInstanceGetDescriptor(hwHInstance iid, hwHairDescriptor* o_desc);
 	hwExport void           hwInstanceSetDescriptor(hwHInstance iid, const hwHairDescriptor* desc);
 	hwExport void           hwInstanceSetTexture(hwHInstance iid, hwTextureType type, hwTexture* tex);
+	hwExport void           hwInstanceSetEnvironment(hwHInstance iid, const hwEnvironmentData* env);
 	hwExport void           hwInstanceUpdateSkinningMatrices(hwHInstance iid, int num_bones, hwMatrix* matrices);
 	hwExport void           hwInstanceUpdateSkinningDQs(hwHInstance iid, int num_bones, hwDQuaternion* dqs);
 
@@ -93,5 +125,17 @@ extern "C"
 	hwExport void			hwSetGIParameters(const hwFloat4* Params);
 	hwExport void           hwRender(hwHInstance iid);
 	hwExport void           hwRenderShadow(hwHInstance iid);
+	hwExport void           hwRenderBatch(int count, const hwHInstance* handles);
+	hwExport void           hwRenderShadowBatch(int count, const hwHInstance* handles);
 	hwExport void           hwStepSimulation(float dt);
+	hwExport void           hwBeginFrame(int frame);
+	hwExport void           hwSubmit(int view);
+	hwExport void           hwSetStaleFramePolicy(int policy);
+	hwExport void           hwSetSortMode(int mode);
+	hwExport void           hwGetStats(hwStats* o_stats);
+	hwExport void           hwGetBackendStats(hwBackendStats* o_stats);
+
+	hwExport bool           hwCaptureBegin(const char* path);
+	hwExport void           hwCaptureEnd();
+	hwExport bool           hwCaptureReplay(const char* path, bool realtime);
 } // extern "C"
@@ -2,6 +2,21 @@
 
 #define MaxLights               8
 
+// features a variant is compiled with: the code of the others is left out. hwEShaderFeature bits, see hwContext.h.
+// the variants are DefaultHairShader_fXX.hlsl, which define HW_SHADER_FEATURES to XX. without it this is the uber shader,
+// which has them all and is used for draws no variant covers.
+#define HW_FEATURE_LIGHTS               0x01
+#define HW_FEATURE_MANY_LIGHTS          0x02    // more than one
+#define HW_FEATURE_LOCAL_LIGHTS         0x04    // point or spot lights
+#define HW_FEATURE_SHADOWS              0x08
+#define HW_FEATURE_PROBES               0x10
+#define HW_FEATURE_GLINT                0x20
+#define HW_FEATURE_SPECULAR_TEXTURE     0x40
+#ifndef HW_SHADER_FEATURES
+    #define HW_SHADER_FEATURES          0x7F
+#endif
+#define HW_HAS(Feature)                 ((HW_SHADER_FEATURES & HW_FEATURE_##Feature) != 0)
+
 #define LightType_Spot          0
 #define LightType_Directional   1
 #define LightType_Point         2
@@ -40,7 +55,15 @@ Texture2D g_shadowTexture : register(t11);
 // Shadow Matrices
 StructuredBuffer<ShadowParams> shadowParams : register(t12);
 
+// lights. uploaded only when they change
 cbuffer cbPerFrame : register(b0)
+{
+    int4 g_numLights; // x: num lights
+    LightData g_lights[MaxLights];
+}
+
+// lighting environment and hair constants of the instance being rendered
+cbuffer cbPerInstance : register(b1)
 {
     // Spherical Harmonics Data
     float4 shAr;
@@ -53,8 +76,6 @@ cbuffer cbPerFrame : register(b0)
 
     float4 gi_params; //	x: light probe intensity y: reflection probe intensity z: specular strength  w: probe blend amount
 
-    int4 g_numLights; // x: num lights
-    LightData g_lights[MaxLights];
     NvHair_ConstantBuffer g_hairConstantBuffer;
 }
 
@@ -174,9 +195,11 @@ float4 ps_main(NvHair_PixelShaderInput input) : SV_Target
     // Get Material
     NvHair_Material mat = g_hairConstantBuffer.defaultMaterial;
 
+#if HW_HAS(SPECULAR_TEXTURE)
     // if using specular sample spec texture
     if (g_hairConstantBuffer.useSpecularTexture)
         mat.specularColor.rgb = g_specularTexture.SampleLevel(texSampler, attr.texcoords.xy, 0).rgb;
+#endif
 
     // init output to black
     float4 r = float4(0, 0, 0, 1);
@@ -190,6 +213,8 @@ float4 ps_main(NvHair_PixelShaderInput input) : SV_Target
     // sample hair color
     float3 hairColor = NvHair_SampleHairColorStrandTex(g_hairConstantBuffer, mat, texSampler, g_rootHairColorTexture, g_tipHairColorTexture, g_strandTexture, attr.texcoords).rgb;
 
+#if HW_HAS(LIGHTS)
+#if HW_HAS(SHADOWS)
     // convert worldspace coordinates to shadowmap uv coordinates
     float4 cascadeWeights = getCascadeWeights_splitSpheres(attr.P.xyz);
     float4 shadowCoords = getShadowCoord(float4(attr.P.xyz, 1), cascadeWeights);
@@ -197,15 +222,28 @@ float4 ps_main(NvHair_PixelShaderInput input) : SV_Target
     // sample shadow map and perform pcf filtering
     float filteredDepth = NvHair_ShadowFilterDepth(g_shadowTexture, shadowSampler, shadowCoords.xy, shadowCoords.z, 1.0);
     float shadow = NvHair_ShadowLitFactor(g_hairConstantBuffer, mat, filteredDepth);
+#else
+    float shadow = 1.0;
+#endif
+
+#if HW_HAS(MANY_LIGHTS)
+    int numLights = g_numLights.x;
+#else
+    const int numLights = 1;
+#endif
 
     // for each light
-    for (int i = 0; i < g_numLights.x; i++)
+    for (int i = 0; i < numLights; i++)
     {
         // init some values
         float3 Lcolor = g_lights[i].color.rgb;
         float3 Ldir = float3(0, 0, 0);
         float atten = 1.0;
 
+#if !HW_HAS(LOCAL_LIGHTS)
+        Ldir = g_lights[i].direction.xyz;
+        Lcolor *= shadow;
+#else
         // if directional light
         if (g_lights[i].type.x == LightType_Directional)
         {
@@ -244,6 +282,7 @@ float4 ps_main(NvHair_PixelShaderInput input) : SV_Target
                 }
             }
         }
+#endif
 
         // calc diffuse lighting
         float diffuse = NvHair_ComputeHairDiffuseShading(Ldir, attr.T, attr.N, mat.diffuseScale, mat.diffuseBlend);
@@ -253,6 +292,7 @@ float4 ps_main(NvHair_PixelShaderInput input) : SV_Target
         // add some glint to ambient light
         float GlintAmbient = 0;
 
+#if HW_HAS(GLINT)
         // if using glint
         if (mat.glintStrength > 0)
         {
@@ -264,10 +304,12 @@ float4 ps_main(NvHair_PixelShaderInput input) : SV_Target
             float Luminance = dot(Lcolor, float3(0.3, 0.5, 0.2)); // Copied from HairWorks viewer.
             GlintAmbient = mat.glintStrength * glint * Luminance;
         }
+#endif
 
         // add direct plus ambient light to output
         r.rgb += ((hairColor.rgb * diffuse) + (specular * mat.specularColor.rgb)) * Lcolor.rgb * atten + GlintAmbient * atten * hairColor.rgb;
     }
+#endif
 
     // calc transparency
     r.a = NvHair_ComputeAlpha(g_hairConstantBuffer, mat, attr);
@@ -275,6 +317,7 @@ float4 ps_main(NvHair_PixelShaderInput input) : SV_Target
     // add spherical harmonics or light probes
     r.rgb += (hairColor * ShadeSH9(shAr, shAg, shAb, shBr, shBg, shBb, shC, float4(attr.N, 1)) * gi_params.x);
 
+#if HW_HAS(PROBES)
     // calc mip level to use
     float mip = GetSpecPowToMip(mat.specularColor.rgb * gi_params.z);
 
@@ -284,6 +327,7 @@ float4 ps_main(NvHair_PixelShaderInput input) : SV_Target
 
     // add reflection probes contribution
     r.rgb += (hairColor * lerp(probe1, probe2, gi_params.w) * gi_params.y);
+#endif
     
     return r;
 }
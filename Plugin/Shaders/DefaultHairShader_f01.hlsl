@@ -0,0 +1,3 @@
+// variant of DefaultHairShader.hlsl: one directional light
+#define HW_SHADER_FEATURES 0x01
+#include "DefaultHairShader.hlsl"
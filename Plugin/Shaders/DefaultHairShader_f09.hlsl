@@ -0,0 +1,3 @@
+// variant of DefaultHairShader.hlsl: one directional light with shadows
+#define HW_SHADER_FEATURES 0x09
+#include "DefaultHairShader.hlsl"
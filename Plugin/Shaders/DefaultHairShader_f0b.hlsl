@@ -0,0 +1,3 @@
+// variant of DefaultHairShader.hlsl: directional lights with shadows
+#define HW_SHADER_FEATURES 0x0B
+#include "DefaultHairShader.hlsl"
@@ -0,0 +1,3 @@
+// variant of DefaultHairShader.hlsl: any lights with shadows
+#define HW_SHADER_FEATURES 0x0F
+#include "DefaultHairShader.hlsl"
@@ -0,0 +1,3 @@
+// variant of DefaultHairShader.hlsl: one directional light with shadows and reflection probes
+#define HW_SHADER_FEATURES 0x19
+#include "DefaultHairShader.hlsl"
@@ -0,0 +1,3 @@
+// variant of DefaultHairShader.hlsl: one directional light with shadows and glint
+#define HW_SHADER_FEATURES 0x29
+#include "DefaultHairShader.hlsl"
@@ -0,0 +1,3 @@
+// variant of DefaultHairShader.hlsl: one directional light with shadows and a specular texture
+#define HW_SHADER_FEATURES 0x49
+#include "DefaultHairShader.hlsl"
@@ -0,0 +1,3 @@
+// variant of DefaultHairShader.hlsl: one directional light with shadows, glint and a specular texture
+#define HW_SHADER_FEATURES 0x69
+#include "DefaultHairShader.hlsl"
@@ -0,0 +1,71 @@
+﻿// producer/consumer stress test of hwSPSCQueue: one thread pushes a sequence, another pops it and checks that
+// every item arrives once, in order and whole. the queue is kept small so both sides keep hitting full and empty.
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "hwSPSCQueue.h"
+
+struct hwTestItem
+{
+    uint64_t seq;
+    uint64_t check; // ~seq. a torn copy doesn't match
+    uint64_t pad[2];
+};
+
+template<size_t Capacity>
+static bool hwTestQueue(uint64_t count)
+{
+    hwSPSCQueue<hwTestItem, Capacity> queue;
+    std::atomic<bool> failed = { false };
+
+    std::thread producer([&]() {
+        for (uint64_t i = 0; i < count && !failed; ) {
+            hwTestItem item = { i, ~i, { i, i } };
+            if (queue.push(item)) { ++i; }
+            else { std::this_thread::yield(); }
+        }
+    });
+
+    uint64_t expected = 0;
+    while (expected < count && !failed) {
+        hwTestItem peeked, item;
+        if (!queue.peek(peeked)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (!queue.pop(item)) {
+            printf("capacity %d: pop() failed after peek() succeeded\n", (int)Capacity);
+            failed = true;
+            break;
+        }
+        if (item.seq != expected || item.check != ~expected || peeked.seq != item.seq) {
+            printf("capacity %d: expected %llu, got %llu (peeked %llu)\n", (int)Capacity,
+                (unsigned long long)expected, (unsigned long long)item.seq, (unsigned long long)peeked.seq);
+            failed = true;
+            break;
+        }
+        ++expected;
+    }
+    producer.join();
+
+    if (!failed && !queue.empty()) {
+        printf("capacity %d: items left after the producer finished\n", (int)Capacity);
+        failed = true;
+    }
+    return !failed;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000000;
+
+    bool ok = true;
+    ok = hwTestQueue<1>(count / 16) && ok;
+    ok = hwTestQueue<2>(count / 4) && ok;
+    ok = hwTestQueue<16>(count) && ok;  // as many as the command pages
+    ok = hwTestQueue<256>(count) && ok;
+    printf("hwSPSCQueue: %s (%llu items)\n", ok ? "passed" : "FAILED", (unsigned long long)count);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+﻿// writer/reader stress test of hwTripleBuffer: the writer publishes numbered versions, the reader checks that the
+// versions it acquires only go forward and that each one arrives whole.
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "hwTripleBuffer.h"
+
+int main(int argc, char *argv[])
+{
+    uint64_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+
+    // a vector, like the instance stores handed over with it: every element holds the version
+    hwTripleBuffer<std::vector<uint64_t>> buffer;
+    std::atomic<bool> done = { false };
+
+    std::thread writer([&]() {
+        for (uint64_t v = 1; v <= count; ++v) {
+            auto &back = buffer.back();
+            back.assign(8 + (size_t)(v % 8), v);
+            buffer.publish();
+        }
+        done = true;
+    });
+
+    bool ok = true;
+    uint64_t last = 0, acquired = 0;
+    for (;;) {
+        bool finished = done; // read before acquire(): the last version is taken after the writer is done
+        if (buffer.acquire()) {
+            auto &front = buffer.front();
+            uint64_t v = front.empty() ? 0 : front[0];
+            bool whole = front.size() == 8 + (size_t)(v % 8);
+            for (auto e : front) { whole = whole && e == v; }
+            if (!whole || v <= last) {
+                printf("hwTripleBuffer: got version %llu after %llu%s\n", (unsigned long long)v, (unsigned long long)last, whole ? "" : ", torn");
+                ok = false;
+                break;
+            }
+            last = v;
+            ++acquired;
+        }
+        else if (finished) {
+            break;
+        }
+    }
+    writer.join();
+
+    if (ok && last != count) {
+        printf("hwTripleBuffer: the last version acquired is %llu, not %llu\n", (unsigned long long)last, (unsigned long long)count);
+        ok = false;
+    }
+    printf("hwTripleBuffer: %s (%llu versions, %llu acquired)\n", ok ? "passed" : "FAILED", (unsigned long long)count, (unsigned long long)acquired);
+    return ok ? 0 : 1;
+}
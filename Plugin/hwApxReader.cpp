@@ -0,0 +1,649 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwHash.h"
+#include "hwApxReader.h"
+#include "hwWorkerPool.h"
+
+namespace {
+
+// arrays with more text than this are split into chunks of about this size
+const size_t hwApxChunkSize = 64 * 1024;
+const size_t hwApxMaxChunks = 64;
+
+// [begin, end) of the text of an element
+struct hwApxRange
+{
+    const char *begin;
+    const char *end;
+};
+
+// value of attribute name in the tag starting at tag. empty if it has none
+hwApxRange hwApxAttribute(const char *tag, const char *tag_end, const char *name)
+{
+    size_t len = strlen(name);
+    for (const char *p = tag; p + len + 2 < tag_end; ++p) {
+        if (p[-1] == ' ' && memcmp(p, name, len) == 0 && p[len] == '=' && p[len + 1] == '"') {
+            const char *b = p + len + 2;
+            const char *e = (const char*)memchr(b, '"', tag_end - b);
+            if (e) { return { b, e }; }
+        }
+    }
+    return { tag_end, tag_end };
+}
+
+bool hwApxEquals(const hwApxRange &r, const char *s)
+{
+    size_t len = strlen(s);
+    return (size_t)(r.end - r.begin) == len && memcmp(r.begin, s, len) == 0;
+}
+
+// ',' separates elements of vector types and is skipped like spaces
+inline bool hwApxIsSeparator(char c)
+{
+    return c == ' ' || c == ',' || c == '\n' || c == '\r' || c == '\t';
+}
+
+
+// number parsing. digits are read 8 at a time as one 64 bit word (SWAR), which covers the mantissas of
+// the numbers the exporter writes ("-12.6443024") in one or two steps.
+// anything the fast path does not handle exactly (more than 19 digits, large exponents, inf, nan) goes to strtof().
+
+inline bool hwApxIsEightDigits(uint64_t v)
+{
+    return (((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull);
+}
+
+// v: 8 ascii digits, the first one in the lowest byte
+inline uint32_t hwApxEightDigits(uint64_t v)
+{
+    const uint64_t mask = 0x000000FF000000FFull;
+    const uint64_t mul1 = 100 + (1000000ull << 32);
+    const uint64_t mul2 = 1 + (10000ull << 32);
+    v -= 0x3030303030303030ull;
+    v = (v * 10) + (v >> 8);
+    v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+    return (uint32_t)v;
+}
+
+// appends the digits at p to v. o_num_digits is increased by how many there were.
+// v is only meaningful while o_num_digits is 19 or less
+inline const char* hwApxReadDigits(const char *p, const char *end, uint64_t &v, int &num_digits)
+{
+    while (end - p >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        if (!hwApxIsEightDigits(w)) { break; }
+        v = v * 100000000 + hwApxEightDigits(w);
+        num_digits += 8;
+        p += 8;
+    }
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        v = v * 10 + (unsigned)(*p - '0');
+        ++num_digits;
+        ++p;
+    }
+    return p;
+}
+
+const double hwApxPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// p is at the first character of the number. returns the character after it, or nullptr if there is no number
+inline const char* hwApxParseNumber(const char *p, const char *end, float &o_v)
+{
+    const char *start = p;
+    bool neg = *p == '-';
+    if (neg || *p == '+') { ++p; }
+
+    uint64_t m = 0;
+    int num_digits = 0;
+    p = hwApxReadDigits(p, end, m, num_digits);
+    int e10 = 0;
+    if (p < end && *p == '.') {
+        int int_digits = num_digits;
+        p = hwApxReadDigits(p + 1, end, m, num_digits);
+        e10 = int_digits - num_digits;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *e = p + 1;
+        bool eneg = e < end && *e == '-';
+        if (e < end && (*e == '-' || *e == '+')) { ++e; }
+        uint64_t ev = 0;
+        int num_edigits = 0;
+        e = hwApxReadDigits(e, end, ev, num_edigits);
+        if (num_edigits > 0 && num_edigits < 4) {
+            e10 += eneg ? -(int)ev : (int)ev;
+            p = e;
+        }
+        else {
+            num_digits = 0; // let strtof() sort it out
+        }
+    }
+
+    if (num_digits > 0 && num_digits <= 19 && m <= (1ull << 53) && e10 >= -22 && e10 <= 22 &&
+        (p == end || hwApxIsSeparator(*p)))
+    {
+        // m and 10^|e10| are exact doubles, so d is correctly rounded. rounding it again to float can in theory
+        // be one ulp off from strtof(), but has not been on the sample assets
+        double d = (double)m;
+        d = e10 < 0 ? d / hwApxPow10[-e10] : d * hwApxPow10[e10];
+        o_v = (float)(neg ? -d : d);
+        return p;
+    }
+
+    char *next;
+    o_v = strtof(start, &next);
+    return next == start ? nullptr : next;
+}
+
+template<class T>
+inline const char* hwApxParseNumber(const char *p, const char *end, T &o_v)
+{
+    bool neg = *p == '-';
+    if (neg || *p == '+') { ++p; }
+
+    uint64_t v = 0;
+    int num_digits = 0;
+    p = hwApxReadDigits(p, end, v, num_digits);
+    if (num_digits == 0 || num_digits > 10) { return nullptr; }
+    o_v = (T)(neg ? -(int64_t)v : (int64_t)v);
+    return p;
+}
+
+// parses count numbers from [p, end)
+template<class T>
+bool hwApxParseNumbers(const char *p, const char *end, T *dst, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        while (p < end && hwApxIsSeparator(*p)) { ++p; }
+        if (p >= end) { return false; }
+
+        p = hwApxParseNumber(p, end, dst[i]);
+        if (!p) { return false; }
+    }
+    return true;
+}
+
+// number of numbers in [p, end): characters that are not separators and follow a separator.
+// 16 characters are classified at a time with SSE2
+size_t hwApxCountNumbers(const char *p, const char *end, bool prev_is_separator)
+{
+    static const uint8_t bit_counts[256] = {
+#define B2(n) n, n + 1, n + 1, n + 2
+#define B4(n) B2(n), B2(n + 1), B2(n + 1), B2(n + 2)
+#define B6(n) B4(n), B4(n + 1), B4(n + 1), B4(n + 2)
+        B6(0), B6(1), B6(1), B6(2)
+#undef B6
+#undef B4
+#undef B2
+    };
+
+    size_t n = 0;
+    uint32_t carry = prev_is_separator ? 1 : 0;
+    const __m128i space = _mm_set1_epi8(' '), comma = _mm_set1_epi8(','), lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r'), tab = _mm_set1_epi8('\t');
+    for (; end - p >= 16; p += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)p);
+        __m128i sep = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, space), _mm_cmpeq_epi8(c, comma)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, lf), _mm_cmpeq_epi8(c, cr)), _mm_cmpeq_epi8(c, tab)));
+        uint32_t sep_bits = (uint32_t)_mm_movemask_epi8(sep);
+        uint32_t starts = ~sep_bits & ((sep_bits << 1) | carry) & 0xFFFF;
+        n += bit_counts[starts & 0xFF] + bit_counts[starts >> 8];
+        carry = sep_bits >> 15;
+    }
+    for (; p < end; ++p) {
+        uint32_t s = hwApxIsSeparator(*p) ? 1 : 0;
+        n += (s ^ 1) & carry;
+        carry = s;
+    }
+    return n;
+}
+
+// parses count numbers from text. big texts are cut into chunks at separators. each chunk's numbers are counted,
+// which tells where in dst the chunk starts, and then the chunks are parsed. both passes run on the workers.
+template<class T>
+bool hwApxParseText(const hwApxRange &text, T *dst, size_t count, hwWorkerPool *workers)
+{
+    size_t len = text.end - text.begin;
+    if (!workers || len < hwApxChunkSize * 2) {
+        return hwApxParseNumbers(text.begin, text.end, dst, count);
+    }
+
+    size_t num_chunks = std::min<size_t>(len / hwApxChunkSize, hwApxMaxChunks);
+    std::vector<hwApxRange> chunks(num_chunks);
+    const char *p = text.begin;
+    for (size_t i = 0; i < num_chunks; ++i) {
+        const char *e = i + 1 == num_chunks ? text.end : std::max(p, text.begin + len * (i + 1) / num_chunks);
+        while (e < text.end && !hwApxIsSeparator(*e)) { ++e; }
+        chunks[i] = { p, e };
+        p = e;
+    }
+
+    // chunks start at a separator or at the start of the text, so every number is counted by the chunk it begins in
+    std::vector<size_t> offsets(num_chunks + 1);
+    workers->parallelFor(num_chunks, [&](size_t i) {
+        offsets[i + 1] = hwApxCountNumbers(chunks[i].begin, chunks[i].end, true);
+    });
+    for (size_t i = 0; i < num_chunks; ++i) { offsets[i + 1] += offsets[i]; }
+    if (offsets[num_chunks] < count) { return false; }
+
+    std::atomic_bool ok(true);
+    workers->parallelFor(num_chunks, [&](size_t i) {
+        size_t b = std::min(offsets[i], count);
+        size_t e = std::min(offsets[i + 1], count);
+        if (b < e && !hwApxParseNumbers(chunks[i].begin, chunks[i].end, dst + b, e - b)) { ok = false; }
+    });
+    return ok;
+}
+
+// element type and how many numbers of it make one array element
+template<class T> struct hwApxScalar;
+template<> struct hwApxScalar<hwFloat3>         { typedef float type; static const int count = 3; };
+template<> struct hwApxScalar<hwFloat4>         { typedef float type; static const int count = 4; };
+template<> struct hwApxScalar<gfsdk_float2>     { typedef float type; static const int count = 2; };
+template<> struct hwApxScalar<hwMatrix>         { typedef float type; static const int count = 16; };
+template<> struct hwApxScalar<uint32_t>         { typedef uint32_t type; static const int count = 1; };
+template<> struct hwApxScalar<int32_t>          { typedef int32_t type; static const int count = 1; };
+template<> struct hwApxScalar<char>             { typedef char type; static const int count = 1; };
+
+template<class T>
+bool hwApxParseArray(const hwApxRange &text, size_t size, std::vector<T> &dst, hwWorkerPool *workers)
+{
+    typedef typename hwApxScalar<T>::type S;
+    dst.resize(size);
+    return hwApxParseText<S>(text, (S*)dst.data(), size * hwApxScalar<T>::count, workers);
+}
+
+// boneSphereIndex(I32),boneSphereRadius(F32),boneSphereLocalPos(Vec3)
+bool hwApxParseSpheres(const hwApxRange &text, size_t size, std::vector<hwApxBoneSphere> &dst)
+{
+    std::vector<float> v(size * 5);
+    if (!hwApxParseNumbers(text.begin, text.end, v.data(), v.size())) { return false; }
+
+    dst.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+        const float *s = &v[i * 5];
+        dst[i].bone = (int32_t)s[0];
+        dst[i].radius = s[1];
+        dst[i].local_pos = { s[2], s[3], s[4] };
+    }
+    return true;
+}
+
+
+// HairInstanceDescriptor material values and the hwHairDescriptor fields they go to.
+// the number of floats of a Float field is taken from its size, so Vec3 and Vec4 values need no type of their own.
+enum hwApxFieldType
+{
+    hwApxField_Bool,
+    hwApxField_Int,
+    hwApxField_Float,
+};
+
+struct hwApxField
+{
+    const char *name;
+    size_t offset;
+    size_t size;
+    hwApxFieldType type;
+};
+
+#define hwApxFieldDef(Name, Member, Type) { Name, offsetof(hwHairDescriptor, Member), sizeof(((hwHairDescriptor*)0)->Member), hwApxField_##Type }
+#define hwApxTextureChannel(Name, Texture) hwApxFieldDef(Name, m_textureChannels[NvHair::TextureType::Texture], Int)
+
+// in the order the exporter writes them, which makes lookups start at the right place (see hwApxFindField())
+const hwApxField hwApxMaterialFields[] = {
+    hwApxTextureChannel("densityTextureChan",           DENSITY),
+    hwApxTextureChannel("widthTextureChan",             WIDTH),
+    hwApxTextureChannel("clumpScaleTextureChan",        CLUMP_SCALE),
+    hwApxTextureChannel("clumpRoundnessTextureChan",    CLUMP_ROUNDNESS),
+    hwApxTextureChannel("waveScaleTextureChan",         WAVE_SCALE),
+    hwApxTextureChannel("waveFreqTextureChan",          WAVE_FREQ),
+    hwApxTextureChannel("lengthTextureChan",            LENGTH),
+    hwApxTextureChannel("stiffnessTextureChan",         STIFFNESS),
+    hwApxTextureChannel("rootStiffnessTextureChan",     ROOT_STIFFNESS),
+    hwApxFieldDef("splineMultiplier",           m_splineMultiplier,             Int),
+    hwApxFieldDef("width",                      m_width,                        Float),
+    hwApxFieldDef("widthNoise",                 m_widthNoise,                   Float),
+    hwApxFieldDef("clumpNoise",                 m_clumpNoise,                   Float),
+    hwApxFieldDef("clumpRoundness",             m_clumpRoundness,               Float),
+    hwApxFieldDef("clumpScale",                 m_clumpScale,                   Float),
+    hwApxFieldDef("density",                    m_density,                      Float),
+    hwApxFieldDef("lengthNoise",                m_lengthNoise,                  Float),
+    hwApxFieldDef("lengthScale",                m_lengthScale,                  Float),
+    hwApxFieldDef("widthRootScale",             m_widthRootScale,               Float),
+    hwApxFieldDef("widthTipScale",              m_widthTipScale,                Float),
+    hwApxFieldDef("waveRootStraighten",         m_waveRootStraighten,           Float),
+    hwApxFieldDef("waveScale",                  m_waveScale,                    Float),
+    hwApxFieldDef("waveScaleNoise",             m_waveScaleNoise,               Float),
+    hwApxFieldDef("waveFreq",                   m_waveFreq,                     Float),
+    hwApxFieldDef("waveFreqNoise",              m_waveFreqNoise,                Float),
+    hwApxFieldDef("waveScaleStrand",            m_waveScaleStrand,              Float),
+    hwApxFieldDef("waveScaleClump",             m_waveScaleClump,               Float),
+    hwApxFieldDef("enableDistanceLOD",          m_enableDistanceLOD,            Bool),
+    hwApxFieldDef("distanceLODStart",           m_distanceLODStart,             Float),
+    hwApxFieldDef("distanceLODEnd",             m_distanceLODEnd,               Float),
+    hwApxFieldDef("distanceLODFadeStart",       m_distanceLODFadeStart,         Float),
+    hwApxFieldDef("distanceLODDensity",         m_distanceLODDensity,           Float),
+    hwApxFieldDef("distanceLODWidth",           m_distanceLODWidth,             Float),
+    hwApxFieldDef("enableDetailLOD",            m_enableDetailLOD,              Bool),
+    hwApxFieldDef("detailLODStart",             m_detailLODStart,               Float),
+    hwApxFieldDef("detailLODEnd",               m_detailLODEnd,                 Float),
+    hwApxFieldDef("detailLODDensity",           m_detailLODDensity,             Float),
+    hwApxFieldDef("detailLODWidth",             m_detailLODWidth,               Float),
+    hwApxFieldDef("colorizeLODOption",          m_colorizeMode,                 Int),
+    hwApxFieldDef("useViewfrustrumCulling",     m_useViewfrustrumCulling,       Bool),
+    hwApxFieldDef("useBackfaceCulling",         m_useBackfaceCulling,           Bool),
+    hwApxFieldDef("backfaceCullingThreshold",   m_backfaceCullingThreshold,     Float),
+    hwApxFieldDef("usePixelDensity",            m_usePixelDensity,              Bool),
+    hwApxFieldDef("strandBlendScale",           m_strandBlendScale,             Float),
+    hwApxFieldDef("diffuseBlend",               m_diffuseBlend,                 Float),
+    hwApxFieldDef("diffuseHairNormalWeight",    m_hairNormalWeight,             Float),
+    hwApxFieldDef("diffuseBoneIndex",           m_hairNormalBoneIndex,          Int),
+    hwApxFieldDef("rootColor",                  m_rootColor,                    Float),
+    hwApxFieldDef("tipColor",                   m_tipColor,                     Float),
+    hwApxFieldDef("glintStrength",              m_glintStrength,                Float),
+    hwApxFieldDef("glintCount",                 m_glintCount,                   Float),
+    hwApxFieldDef("glintExponent",              m_glintExponent,                Float),
+    hwApxFieldDef("rootAlphaFalloff",           m_rootAlphaFalloff,             Float),
+    hwApxFieldDef("rootTipColorWeight",         m_rootTipColorWeight,           Float),
+    hwApxFieldDef("rootTipColorFalloff",        m_rootTipColorFalloff,          Float),
+    hwApxFieldDef("shadowSigma",                m_shadowSigma,                  Float),
+    hwApxFieldDef("specularColor",              m_specularColor,                Float),
+    hwApxFieldDef("specularPrimary",            m_specularPrimary,              Float),
+    hwApxFieldDef("specularNoiseScale",         m_specularNoiseScale,           Float),
+    hwApxFieldDef("specularEnvScale",           m_specularEnvScale,             Float),
+    hwApxFieldDef("specularPrimaryBreakup",     m_specularPrimaryBreakup,       Float),
+    hwApxFieldDef("specularSecondary",          m_specularSecondary,            Float),
+    hwApxFieldDef("specularSecondaryOffset",    m_specularSecondaryOffset,      Float),
+    hwApxFieldDef("specularPowerPrimary",       m_specularPowerPrimary,         Float),
+    hwApxFieldDef("specularPowerSecondary",     m_specularPowerSecondary,       Float),
+    hwApxFieldDef("strandBlendMode",            m_strandBlendMode,              Int),
+    hwApxFieldDef("shadowDensityScale",         m_shadowDensityScale,           Float),
+    hwApxFieldDef("castShadows",                m_castShadows,                  Bool),
+    hwApxFieldDef("receiveShadows",             m_receiveShadows,               Bool),
+    hwApxFieldDef("backStopRadius",             m_backStopRadius,               Float),
+    hwApxFieldDef("bendStiffness",              m_bendStiffness,                Float),
+    hwApxFieldDef("interactionStiffness",       m_interactionStiffness,         Float),
+    hwApxFieldDef("pinStiffness",               m_pinStiffness,                 Float),
+    hwApxFieldDef("useCollision",               m_useCollision,                 Bool),
+    hwApxFieldDef("useDynamicPin",              m_useDynamicPin,                Bool),
+    hwApxFieldDef("damping",                    m_damping,                      Float),
+    hwApxFieldDef("friction",                   m_friction,                     Float),
+    hwApxFieldDef("massScale",                  m_massScale,                    Float),
+    hwApxFieldDef("gravity",                    m_gravityDir,                   Float),
+    hwApxFieldDef("inertiaScale",               m_inertiaScale,                 Float),
+    hwApxFieldDef("inertiaLimit",               m_inertiaLimit,                 Float),
+    hwApxFieldDef("rootStiffness",              m_rootStiffness,                Float),
+    hwApxFieldDef("tipStiffness",               m_tipStiffness,                 Float),
+    hwApxFieldDef("simulate",                   m_simulate,                     Bool),
+    hwApxFieldDef("stiffness",                  m_stiffness,                    Float),
+    hwApxFieldDef("stiffnessStrength",          m_stiffnessStrength,            Float),
+    hwApxFieldDef("stiffnessDamping",           m_stiffnessDamping,             Float),
+    hwApxFieldDef("stiffnessCurve",             m_stiffnessCurve,               Float),
+    hwApxFieldDef("stiffnessStrengthCurve",     m_stiffnessStrengthCurve,       Float),
+    hwApxFieldDef("stiffnessDampingCurve",      m_stiffnessDampingCurve,        Float),
+    hwApxFieldDef("bendStiffnessCurve",         m_bendStiffnessCurve,           Float),
+    hwApxFieldDef("interactionStiffnessCurve",  m_interactionStiffnessCurve,    Float),
+    hwApxFieldDef("wind",                       m_wind,                         Float),
+    hwApxFieldDef("windNoise",                  m_windNoise,                    Float),
+    hwApxFieldDef("visualizeBones",             m_visualizeBones,               Bool),
+    hwApxFieldDef("visualizeBoundingBox",       m_visualizeBoundingBox,         Bool),
+    hwApxFieldDef("visualizeCapsules",          m_visualizeCapsules,            Bool),
+    hwApxFieldDef("visualizeControlVertices",   m_visualizeControlVertices,     Bool),
+    hwApxFieldDef("visualizeCullSphere",        m_visualizeCullSphere,          Bool),
+    hwApxFieldDef("visualizeDiffuseBone",       m_visualizeShadingNormalBone,   Bool),
+    hwApxFieldDef("visualizeFrames",            m_visualizeFrames,              Bool),
+    hwApxFieldDef("visualizeGrowthMesh",        m_visualizeGrowthMesh,          Bool),
+    hwApxFieldDef("visualizeGuideHairs",        m_visualizeGuideHairs,          Bool),
+    hwApxFieldDef("visualizeHairInteractions",  m_visualizeHairInteractions,    Bool),
+    hwApxFieldDef("visualizeHairSkips",         m_visualizeHairSkips,           Int),
+    hwApxFieldDef("visualizeLocalPos",          m_visualizeLocalPos,            Bool),
+    hwApxFieldDef("visualizePinConstraints",    m_visualizePinConstraints,      Bool),
+    hwApxFieldDef("visualizeShadingNormals",    m_visualizeShadingNormals,      Bool),
+    hwApxFieldDef("visualizeSkinnedGuideHairs", m_visualizeSkinnedGuideHairs,   Bool),
+    hwApxFieldDef("drawRenderHairs",            m_drawRenderHairs,              Bool),
+    hwApxFieldDef("enable",                     m_enable,                       Bool),
+};
+const size_t hwApxNumMaterialFields = sizeof(hwApxMaterialFields) / sizeof(hwApxMaterialFields[0]);
+
+#undef hwApxTextureChannel
+#undef hwApxFieldDef
+
+// starts at the field after the last one found, so a material written in table order is one compare per value
+const hwApxField* hwApxFindField(const hwApxRange &name, size_t &cursor)
+{
+    for (size_t n = 0; n < hwApxNumMaterialFields; ++n) {
+        size_t i = (cursor + n) % hwApxNumMaterialFields;
+        if (hwApxEquals(name, hwApxMaterialFields[i].name)) {
+            cursor = i + 1;
+            return &hwApxMaterialFields[i];
+        }
+    }
+    return nullptr;
+}
+
+bool hwApxParseField(const hwApxField &f, const hwApxRange &text, hwHairDescriptor &dst)
+{
+    char *field = (char*)&dst + f.offset;
+    // NvParameters writes limits by name
+    if (f.type == hwApxField_Int && f.size == sizeof(int32_t)) {
+        int32_t v = 0;
+        if (hwApxEquals(text, "NV_MAX_U32"))        { v = (int32_t)0xFFFFFFFFu; }
+        else if (hwApxEquals(text, "NV_MAX_I32"))   { v = INT32_MAX; }
+        else if (hwApxEquals(text, "NV_MIN_I32"))   { v = INT32_MIN; }
+        if (v != 0) {
+            memcpy(field, &v, sizeof(v));
+            return true;
+        }
+    }
+
+    switch (f.type) {
+    case hwApxField_Bool:
+        if (f.size != sizeof(bool)) { return false; }
+        *(bool*)field = hwApxEquals(text, "true") || hwApxEquals(text, "1");
+        return true;
+    case hwApxField_Int:
+    {
+        int32_t v;
+        if (f.size != sizeof(v) || !hwApxParseNumbers(text.begin, text.end, &v, 1)) { return false; }
+        memcpy(field, &v, sizeof(v));
+        return true;
+    }
+    case hwApxField_Float:
+    {
+        float v[16];
+        size_t n = f.size / sizeof(float);
+        if (n == 0 || n > 16 || !hwApxParseNumbers(text.begin, text.end, v, n)) { return false; }
+        memcpy(field, v, n * sizeof(float));
+        return true;
+    }
+    }
+    return false;
+}
+
+
+enum hwApxElementType
+{
+    hwApxElement_Value,
+    hwApxElement_Array,
+    hwApxElement_Struct,    // only the opening tag is visited. elements inside it follow
+};
+
+struct hwApxElement
+{
+    hwApxElementType type;
+    hwApxRange name;
+    size_t size;    // of arrays
+    hwApxRange text;
+};
+
+// calls f(const hwApxElement&) for the value, array and struct elements in [p, end) until it returns false.
+// returns false if it did
+template<class F>
+bool hwApxEachElement(const char *p, const char *end, const F &f)
+{
+    for (;;) {
+        p = (const char*)memchr(p, '<', end - p);
+        if (!p) { break; }
+        const char *tag = p + 1;
+        const char *tag_end = (const char*)memchr(tag, '>', end - tag);
+        if (!tag_end) { break; }
+        p = tag_end + 1;
+
+        hwApxElement e = {};
+        if (strncmp(tag, "value ", 6) == 0)         { e.type = hwApxElement_Value; }
+        else if (strncmp(tag, "array ", 6) == 0)    { e.type = hwApxElement_Array; }
+        else if (strncmp(tag, "struct", 6) == 0)    { e.type = hwApxElement_Struct; }
+        else { continue; }
+        e.name = hwApxAttribute(tag, tag_end, "name");
+
+        if (e.type != hwApxElement_Struct && tag_end[-1] != '/') {
+            // escaped text has no '<', so the text runs up to the closing tag
+            const char *text_end = (const char*)memchr(p, '<', end - p);
+            if (!text_end) { text_end = end; }
+            e.text = { p, text_end };
+            p = text_end;
+        }
+        else {
+            e.text = { p, p };
+        }
+        if (e.type == hwApxElement_Array) {
+            hwApxRange size = hwApxAttribute(tag, tag_end, "size");
+            e.size = strtoul(std::string(size.begin, size.end).c_str(), nullptr, 10);
+        }
+
+        if (!f(e)) { return false; }
+    }
+    return true;
+}
+
+// first s in [p, end), end if there is none. searching for the first character with memchr() is what makes this fast:
+// the needles here start with letters, and the bulk of a file is array text of digits and separators
+const char* hwApxSearch(const char *p, const char *end, const std::string &s)
+{
+    while (end - p >= (ptrdiff_t)s.size()) {
+        p = (const char*)memchr(p, s[0], end - p - s.size() + 1);
+        if (!p) { break; }
+        if (memcmp(p, s.data(), s.size()) == 0) { return p; }
+        ++p;
+    }
+    return end;
+}
+
+// [begin, end) of the Ref value of class name. empty if the file has none
+hwApxRange hwApxFindClass(const char *data, const char *end, const char *name)
+{
+    const char *p = hwApxSearch(data, end, std::string("className=\"") + name + "\"");
+    if (p == end) { return { end, end }; }
+    // the class ends at the next Ref
+    return { p, hwApxSearch(p, end, "type=\"Ref\"") };
+}
+
+} // namespace
+
+
+bool hwApxRead(const char *data, size_t size, hwApxAsset &o, hwWorkerPool *workers)
+{
+    const char *end = data + size;
+    hwApxRange asset = hwApxFindClass(data, end, "HairAssetDescriptor");
+    if (asset.begin == end) { return false; }
+
+    bool ok = hwApxEachElement(asset.begin, asset.end, [&](const hwApxElement &e) {
+        auto &name = e.name;
+        auto &text = e.text;
+        size_t n = e.size;
+        if (e.type == hwApxElement_Value) {
+            if (hwApxEquals(name, "numGuideHairs"))     { return hwApxParseNumbers(text.begin, text.end, &o.num_guide_hairs, 1); }
+            else if (hwApxEquals(name, "sceneUnit"))    { return hwApxParseNumbers(text.begin, text.end, &o.scene_unit, 1); }
+            else if (hwApxEquals(name, "upAxis"))       { return hwApxParseNumbers(text.begin, text.end, &o.up_axis, 1); }
+            else if (hwApxEquals(name, "handedness"))   { return hwApxParseNumbers(text.begin, text.end, &o.handedness, 1); }
+        }
+        else if (e.type == hwApxElement_Array) {
+            if (hwApxEquals(name, "vertices"))                  { return hwApxParseArray(text, n, o.vertices, workers); }
+            else if (hwApxEquals(name, "endIndices"))           { return hwApxParseArray(text, n, o.end_indices, workers); }
+            else if (hwApxEquals(name, "faceIndices"))          { return hwApxParseArray(text, n, o.face_indices, workers); }
+            else if (hwApxEquals(name, "faceUVs"))              { return hwApxParseArray(text, n, o.face_uvs, workers); }
+            else if (hwApxEquals(name, "boneIndices"))          { return hwApxParseArray(text, n, o.bone_indices, workers); }
+            else if (hwApxEquals(name, "boneWeights"))          { return hwApxParseArray(text, n, o.bone_weights, workers); }
+            else if (hwApxEquals(name, "boneNames"))            { return hwApxParseArray(text, n, o.bone_names, workers); }
+            else if (hwApxEquals(name, "bindPoses"))            { return hwApxParseArray(text, n, o.bind_poses, workers); }
+            else if (hwApxEquals(name, "boneParents"))          { return hwApxParseArray(text, n, o.bone_parents, workers); }
+            else if (hwApxEquals(name, "boneSpheres"))          { return hwApxParseSpheres(text, n, o.bone_spheres); }
+            else if (hwApxEquals(name, "boneCapsuleIndices"))   { return hwApxParseArray(text, n, o.bone_capsule_indices, workers); }
+            else if (hwApxEquals(name, "pinConstraints"))       { return hwApxParseSpheres(text, n, o.pin_constraints); }
+            // boneNameList holds the same names as boneNames
+        }
+        return true;
+    });
+    if (!ok) {
+        hwLog("hwApxRead(): malformed HairAssetDescriptor.\n");
+        return false;
+    }
+    if (o.num_guide_hairs == 0) { o.num_guide_hairs = (uint32_t)o.end_indices.size(); }
+
+    if (!hwApxReadMaterials(data, size, o.materials)) { return false; }
+    return !o.vertices.empty() && o.end_indices.size() == o.num_guide_hairs;
+}
+
+bool hwApxReadMaterials(const char *data, size_t size, std::vector<hwHairDescriptor> &o_materials)
+{
+    // each struct of the materials array is one material. values outside the array are not material fields
+    hwApxRange instance = hwApxFindClass(data, data + size, "HairInstanceDescriptor");
+    bool in_materials = false;
+    size_t cursor = 0;
+    bool ok = hwApxEachElement(instance.begin, instance.end, [&](const hwApxElement &e) {
+        if (e.type == hwApxElement_Array) {
+            in_materials = hwApxEquals(e.name, "materials");
+        }
+        else if (e.type == hwApxElement_Struct) {
+            if (in_materials) {
+                o_materials.push_back(hwHairDescriptor());
+                cursor = 0;
+            }
+        }
+        else if (in_materials && !o_materials.empty()) {
+            if (const hwApxField *f = hwApxFindField(e.name, cursor)) {
+                return hwApxParseField(*f, e.text, o_materials.back());
+            }
+        }
+        return true;
+    });
+    if (!ok) {
+        hwLog("hwApxReadMaterials(): malformed HairInstanceDescriptor.\n");
+        return false;
+    }
+    return true;
+}
+
+void hwApxCopyMaterial(const hwHairDescriptor &src, hwHairDescriptor &dst)
+{
+    for (auto &f : hwApxMaterialFields) {
+        memcpy((char*)&dst + f.offset, (const char*)&src + f.offset, f.size);
+    }
+}
+
+bool hwApxHashSections(const char *data, size_t size, hwApxSectionHashes &o)
+{
+    const char *end = data + size;
+    o = hwApxSectionHashes();
+    hwApxRange asset = hwApxFindClass(data, end, "HairAssetDescriptor");
+    if (asset.begin == end) { return false; }
+
+    // geometry is everything but these, in file order
+    hwApxRange cut[2] = {
+        hwApxFindClass(data, end, "HairWorksInfo"),
+        hwApxFindClass(asset.end, end, "HairInstanceDescriptor"),
+    };
+    if (cut[0].begin > cut[1].begin) { std::swap(cut[0], cut[1]); }
+    const char *p = data;
+    for (auto &c : cut) {
+        if (c.begin == end) { continue; }
+        o.geometry = hwHashContent(p, c.begin - p, o.geometry);
+        p = c.end;
+    }
+    o.geometry = hwHashContent(p, end - p, o.geometry);
+    o.materials = hwHashContent(cut[1].begin, cut[1].end - cut[1].begin);
+    return true;
+}
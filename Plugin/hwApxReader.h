@@ -0,0 +1,56 @@
+﻿#pragma once
+
+// reads the HairAssetDescriptor and HairInstanceDescriptor of an APX (XML NvParameters) file without the SDK,
+// for cooking (see hwCookedAsset.h). arrays are kept as the file has them: no unit or axis conversion is applied.
+
+class hwWorkerPool;
+
+struct hwApxBoneSphere
+{
+    int32_t bone;
+    float radius;
+    hwFloat3 local_pos;
+};
+
+struct hwApxAsset
+{
+    uint32_t num_guide_hairs = 0;
+    std::vector<hwFloat3>           vertices;
+    std::vector<uint32_t>           end_indices;        // index of the last vertex of each guide hair
+    std::vector<uint32_t>           face_indices;       // 3 per face
+    std::vector<gfsdk_float2>       face_uvs;           // 1 per face index
+    std::vector<hwFloat4>           bone_indices;       // 1 per guide hair
+    std::vector<hwFloat4>           bone_weights;       //
+    std::vector<char>               bone_names;         // zero terminated names, one after another
+    std::vector<hwMatrix>           bind_poses;
+    std::vector<int32_t>            bone_parents;
+    std::vector<hwApxBoneSphere>    bone_spheres;
+    std::vector<uint32_t>           bone_capsule_indices; // 2 per capsule, into bone_spheres
+    std::vector<hwApxBoneSphere>    pin_constraints;
+    float scene_unit = 1.0f;
+    uint32_t up_axis = 0;
+    uint32_t handedness = 0;
+
+    // HairInstanceDescriptor materials. the first one is what the SDK gives as the asset's default descriptor.
+    // fields the APX has no value for (m_enableLOD, m_modelToWorld, the cull sphere, asset type, priority and group)
+    // are left as hwHairDescriptor() has them.
+    std::vector<hwHairDescriptor>   materials;
+};
+
+// hashes of the parts of an APX that can change independently, to tell a reload that only has new material values.
+// neither covers the HairWorksInfo, which only has the authoring tool and dates and changes every time the file is saved.
+struct hwApxSectionHashes
+{
+    uint64_t geometry = 0;      // everything else: the HairAssetDescriptor, HairSceneDescriptor etc. the SDK asset is made of it
+    uint64_t materials = 0;     // the HairInstanceDescriptor
+};
+
+// false if there is no HairAssetDescriptor or an array of it is malformed.
+// large arrays are split into chunks that are parsed on workers, if given.
+bool hwApxRead(const char *data, size_t size, hwApxAsset &o_asset, hwWorkerPool *workers = nullptr);
+// only the HairInstanceDescriptor materials (see hwApxAsset::materials). false if they are malformed
+bool hwApxReadMaterials(const char *data, size_t size, std::vector<hwHairDescriptor> &o_materials);
+// copies the fields an APX material has values for from src to dst. the others of dst are left as they are
+void hwApxCopyMaterial(const hwHairDescriptor &src, hwHairDescriptor &dst);
+// false if there is no HairAssetDescriptor
+bool hwApxHashSections(const char *data, size_t size, hwApxSectionHashes &o);
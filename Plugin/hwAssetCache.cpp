@@ -0,0 +1,102 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwHash.h"
+#include "hwPathRegistry.h"
+#include "hwCookedAsset.h"
+#include "hwReadStream.h"
+#include "hwAssetCache.h"
+
+void hwAssetCache::setDirectory(const std::string &dir)
+{
+    m_dir = dir;
+    if (m_dir.empty()) { return; }
+
+    if (m_dir.back() != '/' && m_dir.back() != '\\') { m_dir += '/'; }
+#ifdef hwWindows
+    ::CreateDirectoryA(m_dir.c_str(), nullptr);
+#else
+    ::mkdir(m_dir.c_str(), 0755);
+#endif
+}
+
+std::string hwAssetCache::getCookedPath(const std::string &path, uint64_t tag) const
+{
+    std::string npath = hwPathRegistry::normalize(path);
+    char name[32];
+    sprintf(name, "%016llx.hwc", (unsigned long long)hwHash64(npath.data(), npath.size(), hwHash64(&tag, sizeof(tag))));
+    return m_dir + name;
+}
+
+bool hwAssetCache::getFileInfo(const std::string &path, uint64_t &o_mtime, uint64_t &o_size)
+{
+#ifdef hwWindows
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0) { return false; }
+#else
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) { return false; }
+#endif
+    o_mtime = (uint64_t)st.st_mtime;
+    o_size = (uint64_t)st.st_size;
+    return true;
+}
+
+bool hwAssetCache::writeFile(const std::string &path, const std::string &data)
+{
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary);
+        if (!f || !f.write(data.data(), data.size())) { return false; }
+    }
+#ifdef hwWindows
+    return ::MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+#endif
+}
+
+bool hwAssetCache::load(const std::string &path, uint64_t tag, hwMappedFile &o_cooked) const
+{
+    if (!enabled()) { return false; }
+
+    uint64_t mtime, size;
+    if (!getFileInfo(path, mtime, size)) { return false; }
+
+    std::string cooked_path = getCookedPath(path, tag);
+    if (!o_cooked.open(cooked_path.c_str())) { return false; }
+
+    hwCookedAsset c;
+    if (!hwReadCookedAsset(o_cooked.data(), o_cooked.size(), c)) {
+        hwLog("hwAssetCache: %s is broken. cooking again.\n", cooked_path.c_str());
+        o_cooked.close();
+        return false;
+    }
+    if (c.header->source_mtime == mtime && c.header->source_size == size) { return true; }
+
+    // touched but maybe not changed (checked out again, copied)
+    hwMappedFile src;
+    if (c.header->source_size != size || !src.open(path.c_str()) || hwHashContent(src.data(), src.size()) != c.header->source_hash) {
+        o_cooked.close();
+        return false;
+    }
+
+    // remember the new mtime so the next load doesn't hash the source again. the mapping is read-only and
+    // has to be gone before the file is replaced
+    std::string cooked(o_cooked.data(), o_cooked.size());
+    ((hwCookedHeader*)&cooked[0])->source_mtime = mtime;
+    o_cooked.close();
+    writeFile(cooked_path, cooked);
+    return o_cooked.open(cooked_path.c_str());
+}
+
+bool hwAssetCache::store(const std::string &path, uint64_t tag, const std::string &cooked) const
+{
+    if (!enabled()) { return false; }
+
+    std::string cooked_path = getCookedPath(path, tag);
+    if (!writeFile(cooked_path, cooked)) {
+        hwLog("hwAssetCache: failed to write %s.\n", cooked_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+﻿#pragma once
+
+// directory of cooked assets (see hwCookedAsset.h), checked before an APX file is parsed.
+// a cooked file is named after the hash of the normalized source path and a tag for what else it depends on (the
+// conversion settings, which the default instance descriptor in it was converted with). it is up to date if the source's mtime and size
+// are the ones it was cooked from, or, when they are not, if the source's contents still hash the same.
+// load() and store() only read m_dir, so copies can be used by workers while the game thread loads.
+
+class hwMappedFile;
+
+class hwAssetCache
+{
+public:
+    // empty disables the cache. the directory is created if it doesn't exist
+    void setDirectory(const std::string &dir);
+    bool enabled() const { return !m_dir.empty(); }
+
+    // o_cooked: the cooked asset of path, mapped, if the cache has an up to date one
+    bool load(const std::string &path, uint64_t tag, hwMappedFile &o_cooked) const;
+    // writes through a temporary file, so a concurrent load() never sees a partial one
+    bool store(const std::string &path, uint64_t tag, const std::string &cooked) const;
+    std::string getCookedPath(const std::string &path, uint64_t tag) const;
+
+    static bool getFileInfo(const std::string &path, uint64_t &o_mtime, uint64_t &o_size);
+    static bool writeFile(const std::string &path, const std::string &data);
+
+private:
+    std::string m_dir;  // with a trailing '/'
+};
@@ -0,0 +1,89 @@
+﻿#pragma once
+
+// everything hwContext asks of the GPU and the HairWorks SDK goes through hwBackend.
+// hwBackendD3D11 forwards to D3D11 and the SDK. hwBackendNull does nothing but count calls and bytes (and optionally
+// burn time like a driver would), so the CPU side - handle tables, command pages, sorting, caches - can run and be
+// measured without a GPU or the SDK dll.
+//
+// objects are handed around as the D3D11 interface pointers, but callers never call through them:
+// the null backend's objects are its own records. create*() return nullptr on failure, SDK calls return their result.
+
+struct hwBackendStats
+{
+    int calls;              // all calls made to the backend
+    int objects_created;
+    int objects_alive;      // created and not released yet. non-zero after hwContext::finalize() means a leak
+    int binds;              // set*()
+    int uploads;            // updateBuffer()
+    int bytes_uploaded;
+    int draws;              // renderHairs()
+    int sdk_calls;          // other HairWorks SDK calls
+};
+
+class hwBackend
+{
+public:
+    virtual ~hwBackend() {}
+    virtual const char* getName() const = 0;
+    virtual void getStats(hwBackendStats &o_stats) const = 0; // all zero if the backend doesn't count
+
+    // device
+    virtual ID3D11PixelShader*          createPixelShader(const void *bytecode, size_t size) = 0;
+    virtual ID3D11Buffer*               createBuffer(const D3D11_BUFFER_DESC &desc) = 0;
+    virtual ID3D11ShaderResourceView*   createSRV(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC &desc) = 0;
+    virtual ID3D11RenderTargetView*     createRTV(ID3D11Resource *resource, const D3D11_RENDER_TARGET_VIEW_DESC &desc) = 0;
+    virtual ID3D11SamplerState*         createSampler(const D3D11_SAMPLER_DESC &desc) = 0;
+    virtual ID3D11DepthStencilState*    createDepthStencil(const D3D11_DEPTH_STENCIL_DESC &desc) = 0;
+    virtual ID3D11RasterizerState*      createRasterizer(const D3D11_RASTERIZER_DESC &desc) = 0;
+    virtual ID3D11BlendState*           createBlend(const D3D11_BLEND_DESC &desc) = 0;
+    virtual void                        release(ID3D11DeviceChild *obj) = 0; // objects created above. null is ignored
+
+    // resources come from the caller (Unity). getResourceRefs() returns -1 if the count can't be known.
+    virtual bool    getTextureDesc(ID3D11Resource *resource, D3D11_TEXTURE2D_DESC &o_desc) = 0;
+    virtual int     getResourceRefs(ID3D11Resource *resource) = 0;
+    virtual void    getViewDesc(ID3D11ShaderResourceView *view, D3D11_SHADER_RESOURCE_VIEW_DESC &o_desc, ID3D11Resource *&o_resource) = 0;
+    virtual void    getViewDesc(ID3D11RenderTargetView *view, D3D11_RENDER_TARGET_VIEW_DESC &o_desc, ID3D11Resource *&o_resource) = 0;
+
+    // immediate context
+    virtual bool    updateBuffer(ID3D11Buffer *buf, const void *data, size_t size) = 0; // whole buffer, discarding the old contents
+    virtual void    setPixelShader(ID3D11PixelShader *shader) = 0;
+    virtual void    setConstantBuffers(int slot, int num, ID3D11Buffer *const *buffers) = 0;
+    virtual void    setSamplers(int slot, int num, ID3D11SamplerState *const *samplers) = 0;
+    virtual void    setShaderResources(int slot, int num, ID3D11ShaderResourceView *const *views) = 0;
+    virtual void    setDepthStencil(ID3D11DepthStencilState *state) = 0;
+
+    // HairWorks SDK
+    virtual NvResult loadAsset(NvCo::ReadStream *stream, hwAssetID &o_aid, const hwConversionSettings &settings) = 0;
+    virtual NvResult createAsset(const hwAssetDescriptor &desc, hwAssetID &o_aid, const hwConversionSettings &settings) = 0; // from cooked data
+    virtual NvResult freeAsset(hwAssetID aid) = 0;
+    virtual int      getNumBones(hwAssetID aid) = 0;
+    virtual NvResult getBoneName(hwAssetID aid, int nth, char *o_name) = 0;
+    virtual NvResult getBoneIndices(hwAssetID aid, hwFloat4 *o_indices) = 0;
+    virtual NvResult getBoneWeights(hwAssetID aid, hwFloat4 *o_weights) = 0;
+    virtual NvResult getBindPose(hwAssetID aid, int nth, hwMatrix *o_mat) = 0;
+    virtual NvResult getInstanceDescriptorFromAsset(hwAssetID aid, hwHairDescriptor &o_desc) = 0;
+
+    virtual NvResult createInstance(hwAssetID aid, hwInstanceID &o_iid) = 0;
+    virtual NvResult freeInstance(hwInstanceID iid) = 0;
+    virtual NvResult getBounds(hwInstanceID iid, hwFloat3 &o_min, hwFloat3 &o_max) = 0;
+    virtual NvResult getInstanceDescriptor(hwInstanceID iid, hwHairDescriptor &o_desc) = 0;
+    virtual NvResult updateInstanceDescriptor(hwInstanceID iid, const hwHairDescriptor &desc) = 0;
+    virtual NvResult setTexture(hwInstanceID iid, hwTextureType type, ID3D11ShaderResourceView *srv) = 0; // null unsets
+    virtual NvResult updateSkinningMatrices(hwInstanceID iid, int num_bones, const hwMatrix *matrices) = 0;
+    virtual NvResult updateSkinningDQs(hwInstanceID iid, int num_bones, const hwDQuaternion *dqs) = 0;
+
+    virtual NvResult setViewProjection(const hwMatrix &view, const hwMatrix &proj, float fov) = 0; // with the current viewport
+    virtual NvResult stepSimulation(float dt) = 0;
+    virtual void     preRender(float interpolation) = 0;
+    virtual NvResult prepareShaderConstantBuffer(hwInstanceID iid, NvHair::ShaderConstantBuffer &o_cb) = 0;
+    virtual NvResult getShaderResources(hwInstanceID iid, ID3D11ShaderResourceView **o_srvs) = 0; // NvHair::ShaderResourceType::COUNT_OF of them
+    virtual NvResult getTextures(hwInstanceID iid, const hwTextureType *types, int num, ID3D11ShaderResourceView **o_srvs) = 0;
+    virtual NvResult renderHairs(hwInstanceID iid, const NvHair::ShaderSettings &settings) = 0;
+    virtual NvResult renderVisualization(hwInstanceID iid) = 0;
+};
+
+// sdk must have been loaded by hwContext::loadSDK(). returns nullptr if the SDK can't use the device.
+hwBackend* hwCreateBackendD3D11(ID3D11Device *d3ddev, hwSDK *sdk);
+
+// latency_us: time spent in each buffer upload and draw, to stand in for the driver
+hwBackend* hwCreateBackendNull(int latency_us);
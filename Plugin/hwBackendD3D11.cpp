@@ -0,0 +1,211 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwBackend.h"
+
+class hwBackendD3D11 : public hwBackend
+{
+public:
+    hwBackendD3D11(ID3D11Device *d3ddev, hwSDK *sdk);
+    ~hwBackendD3D11() override;
+    bool initialize();
+
+    const char* getName() const override { return "D3D11"; }
+    void getStats(hwBackendStats &o_stats) const override { memset(&o_stats, 0, sizeof(o_stats)); }
+
+    ID3D11PixelShader* createPixelShader(const void *bytecode, size_t size) override
+    {
+        ID3D11PixelShader *ret = nullptr;
+        return SUCCEEDED(m_d3ddev->CreatePixelShader(bytecode, size, nullptr, &ret)) ? ret : nullptr;
+    }
+    ID3D11Buffer* createBuffer(const D3D11_BUFFER_DESC &desc) override
+    {
+        ID3D11Buffer *ret = nullptr;
+        return SUCCEEDED(m_d3ddev->CreateBuffer(&desc, nullptr, &ret)) ? ret : nullptr;
+    }
+    ID3D11ShaderResourceView* createSRV(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC &desc) override
+    {
+        ID3D11ShaderResourceView *ret = nullptr;
+        return SUCCEEDED(m_d3ddev->CreateShaderResourceView(resource, &desc, &ret)) ? ret : nullptr;
+    }
+    ID3D11RenderTargetView* createRTV(ID3D11Resource *resource, const D3D11_RENDER_TARGET_VIEW_DESC &desc) override
+    {
+        ID3D11RenderTargetView *ret = nullptr;
+        return SUCCEEDED(m_d3ddev->CreateRenderTargetView(resource, &desc, &ret)) ? ret : nullptr;
+    }
+    ID3D11SamplerState* createSampler(const D3D11_SAMPLER_DESC &desc) override
+    {
+        ID3D11SamplerState *ret = nullptr;
+        return SUCCEEDED(m_d3ddev->CreateSamplerState(&desc, &ret)) ? ret : nullptr;
+    }
+    ID3D11DepthStencilState* createDepthStencil(const D3D11_DEPTH_STENCIL_DESC &desc) override
+    {
+        ID3D11DepthStencilState *ret = nullptr;
+        return SUCCEEDED(m_d3ddev->CreateDepthStencilState(&desc, &ret)) ? ret : nullptr;
+    }
+    ID3D11RasterizerState* createRasterizer(const D3D11_RASTERIZER_DESC &desc) override
+    {
+        ID3D11RasterizerState *ret = nullptr;
+        return SUCCEEDED(m_d3ddev->CreateRasterizerState(&desc, &ret)) ? ret : nullptr;
+    }
+    ID3D11BlendState* createBlend(const D3D11_BLEND_DESC &desc) override
+    {
+        ID3D11BlendState *ret = nullptr;
+        return SUCCEEDED(m_d3ddev->CreateBlendState(&desc, &ret)) ? ret : nullptr;
+    }
+    void release(ID3D11DeviceChild *obj) override
+    {
+        if (obj) { obj->Release(); }
+    }
+
+    bool getTextureDesc(ID3D11Resource *resource, D3D11_TEXTURE2D_DESC &o_desc) override
+    {
+        ID3D11Texture2D *tex = nullptr;
+        resource->QueryInterface(&tex);
+        if (!tex) { return false; }
+        tex->GetDesc(&o_desc);
+        tex->Release();
+        return true;
+    }
+    // the count Release() returns is meant for diagnostics, but D3D11 keeps it exact
+    int getResourceRefs(ID3D11Resource *resource) override
+    {
+        resource->AddRef();
+        return (int)resource->Release();
+    }
+    void getViewDesc(ID3D11ShaderResourceView *view, D3D11_SHADER_RESOURCE_VIEW_DESC &o_desc, ID3D11Resource *&o_resource) override
+    {
+        view->GetDesc(&o_desc);
+        view->GetResource(&o_resource);
+        if (o_resource) { o_resource->Release(); }
+    }
+    void getViewDesc(ID3D11RenderTargetView *view, D3D11_RENDER_TARGET_VIEW_DESC &o_desc, ID3D11Resource *&o_resource) override
+    {
+        view->GetDesc(&o_desc);
+        view->GetResource(&o_resource);
+        if (o_resource) { o_resource->Release(); }
+    }
+
+    bool updateBuffer(ID3D11Buffer *buf, const void *data, size_t size) override
+    {
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if (FAILED(m_d3dctx->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) { return false; }
+        memcpy(mapped.pData, data, size);
+        m_d3dctx->Unmap(buf, 0);
+        return true;
+    }
+    void setPixelShader(ID3D11PixelShader *shader) override                                 { m_d3dctx->PSSetShader(shader, nullptr, 0); }
+    void setConstantBuffers(int slot, int num, ID3D11Buffer *const *buffers) override       { m_d3dctx->PSSetConstantBuffers(slot, num, buffers); }
+    void setSamplers(int slot, int num, ID3D11SamplerState *const *samplers) override       { m_d3dctx->PSSetSamplers(slot, num, samplers); }
+    void setShaderResources(int slot, int num, ID3D11ShaderResourceView *const *views) override { m_d3dctx->PSSetShaderResources(slot, num, views); }
+    void setDepthStencil(ID3D11DepthStencilState *state) override                           { m_d3dctx->OMSetDepthStencilState(state, 0); }
+
+    NvResult loadAsset(NvCo::ReadStream *stream, hwAssetID &o_aid, const hwConversionSettings &settings) override
+    {
+        return m_sdk->loadAsset(stream, o_aid, nullptr, &settings);
+    }
+    NvResult createAsset(const hwAssetDescriptor &desc, hwAssetID &o_aid, const hwConversionSettings &settings) override
+    {
+        return m_sdk->createAsset(desc, o_aid, nullptr, &settings);
+    }
+    NvResult freeAsset(hwAssetID aid) override                                  { return m_sdk->freeAsset(aid); }
+    int getNumBones(hwAssetID aid) override                                     { return m_sdk->getNumBones(aid); }
+    NvResult getBoneName(hwAssetID aid, int nth, char *o_name) override         { return m_sdk->getBoneName(aid, nth, o_name); }
+    NvResult getBoneIndices(hwAssetID aid, hwFloat4 *o_indices) override        { return m_sdk->getBoneIndices(aid, o_indices); }
+    NvResult getBoneWeights(hwAssetID aid, hwFloat4 *o_weights) override        { return m_sdk->getBoneWeights(aid, o_weights); }
+    NvResult getBindPose(hwAssetID aid, int nth, hwMatrix *o_mat) override      { return m_sdk->getBindPose(aid, nth, o_mat); }
+    NvResult getInstanceDescriptorFromAsset(hwAssetID aid, hwHairDescriptor &o_desc) override { return m_sdk->getInstanceDescriptorFromAsset(aid, o_desc); }
+
+    NvResult createInstance(hwAssetID aid, hwInstanceID &o_iid) override        { return m_sdk->createInstance(aid, o_iid); }
+    NvResult freeInstance(hwInstanceID iid) override                            { return m_sdk->freeInstance(iid); }
+    NvResult getBounds(hwInstanceID iid, hwFloat3 &o_min, hwFloat3 &o_max) override { return m_sdk->getBounds(iid, o_min, o_max, false); }
+    NvResult getInstanceDescriptor(hwInstanceID iid, hwHairDescriptor &o_desc) override { return m_sdk->getInstanceDescriptor(iid, o_desc); }
+    NvResult updateInstanceDescriptor(hwInstanceID iid, const hwHairDescriptor &desc) override { return m_sdk->updateInstanceDescriptor(iid, desc); }
+    NvResult setTexture(hwInstanceID iid, hwTextureType type, ID3D11ShaderResourceView *srv) override
+    {
+        if (!srv) { return m_sdk->setTexture(iid, type, nvidia::Common::ApiHandle::getNull()); }
+        return m_sdk->setTexture(iid, type, nvidia::Common::Dx11Type::wrap(srv));
+    }
+    NvResult updateSkinningMatrices(hwInstanceID iid, int num_bones, const hwMatrix *matrices) override { return m_sdk->updateSkinningMatrices(iid, num_bones, matrices); }
+    NvResult updateSkinningDQs(hwInstanceID iid, int num_bones, const hwDQuaternion *dqs) override      { return m_sdk->updateSkinningDqs(iid, num_bones, dqs); }
+
+    NvResult setViewProjection(const hwMatrix &view, const hwMatrix &proj, float fov) override
+    {
+        D3D11_VIEWPORT dxViewport;
+        UINT numViewports = 1;
+        m_d3dctx->RSGetViewports(&numViewports, &dxViewport);
+
+        NvHair::Viewport viewport;
+        viewport.init(dxViewport.TopLeftX, dxViewport.TopLeftY, dxViewport.Width, dxViewport.Height);
+        return m_sdk->setViewProjection(viewport, view, proj, nvidia::HairWorks::HandednessHint::RIGHT, fov);
+    }
+    NvResult stepSimulation(float dt) override                                  { return m_sdk->stepSimulation(dt, nullptr, true); }
+    void preRender(float interpolation) override                                { m_sdk->preRender(interpolation); }
+    NvResult prepareShaderConstantBuffer(hwInstanceID iid, NvHair::ShaderConstantBuffer &o_cb) override { return m_sdk->prepareShaderConstantBuffer(iid, o_cb); }
+    NvResult getShaderResources(hwInstanceID iid, ID3D11ShaderResourceView **o_srvs) override
+    {
+        return m_sdk->getShaderResources(iid, NV_NULL, NvHair::ShaderResourceType::COUNT_OF, NvCo::Dx11Type::wrapPtr(o_srvs));
+    }
+    NvResult getTextures(hwInstanceID iid, const hwTextureType *types, int num, ID3D11ShaderResourceView **o_srvs) override
+    {
+        return m_sdk->getTextures(iid, types, num, NvCo::Dx11Type::wrapPtr(o_srvs));
+    }
+    NvResult renderHairs(hwInstanceID iid, const NvHair::ShaderSettings &settings) override { return m_sdk->renderHairs(iid, &settings); }
+    NvResult renderVisualization(hwInstanceID iid) override                     { return m_sdk->renderVisualization(iid); }
+
+private:
+    ID3D11Device        *m_d3ddev;
+    ID3D11DeviceContext *m_d3dctx;
+    hwSDK               *m_sdk;
+};
+
+
+hwBackendD3D11::hwBackendD3D11(ID3D11Device *d3ddev, hwSDK *sdk)
+    : m_d3ddev(d3ddev)
+    , m_d3dctx(nullptr)
+    , m_sdk(sdk)
+{
+    m_d3ddev->GetImmediateContext(&m_d3dctx);
+}
+
+hwBackendD3D11::~hwBackendD3D11()
+{
+    if (m_d3dctx) {
+        m_d3dctx->Release();
+        m_d3dctx = nullptr;
+    }
+}
+
+bool hwBackendD3D11::initialize()
+{
+	auto dev_handle = NvCo::Dx11Type::wrap(m_d3ddev);
+	auto ctx_handle = NvCo::Dx11Type::wrap(m_d3dctx);
+
+	if (NV_SUCCEEDED(m_sdk->initRenderResources(dev_handle, ctx_handle))) {
+		hwLog("GFSDK_HairSDK::InitRenderResources() succeeded.\n");
+	}
+	else {
+		hwLog("GFSDK_HairSDK::InitRenderResources() failed.\n");
+		return false;
+	}
+
+	if (NV_SUCCEEDED(m_sdk->setCurrentContext(ctx_handle))) {
+		hwLog("GFSDK_HairSDK::SetCurrentContext() succeeded.\n");
+	}
+	else {
+		hwLog("GFSDK_HairSDK::SetCurrentContext() failed.\n");
+		return false;
+	}
+	return true;
+}
+
+hwBackend* hwCreateBackendD3D11(ID3D11Device *d3ddev, hwSDK *sdk)
+{
+    if (!d3ddev || !sdk) { return nullptr; }
+
+    auto *ret = new hwBackendD3D11(d3ddev, sdk);
+    if (!ret->initialize()) {
+        delete ret;
+        return nullptr;
+    }
+    return ret;
+}
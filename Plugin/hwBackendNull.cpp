@@ -0,0 +1,280 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwBackend.h"
+#include "hwApxReader.h"
+
+// what the null backend hands out in place of D3D11 objects. views keep their descriptor so they can be looked up again.
+struct hwNullObject
+{
+    ID3D11Resource *resource;
+    D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc;
+    D3D11_RENDER_TARGET_VIEW_DESC rtv_desc;
+};
+
+class hwBackendNull : public hwBackend
+{
+public:
+    hwBackendNull(int latency_us);
+
+    const char* getName() const override { return "Null"; }
+    void getStats(hwBackendStats &o_stats) const override;
+
+    ID3D11PixelShader*          createPixelShader(const void *bytecode, size_t size) override   { return newObject<ID3D11PixelShader>(); }
+    ID3D11Buffer*               createBuffer(const D3D11_BUFFER_DESC &desc) override            { return newObject<ID3D11Buffer>(); }
+    ID3D11SamplerState*         createSampler(const D3D11_SAMPLER_DESC &desc) override          { return newObject<ID3D11SamplerState>(); }
+    ID3D11DepthStencilState*    createDepthStencil(const D3D11_DEPTH_STENCIL_DESC &desc) override { return newObject<ID3D11DepthStencilState>(); }
+    ID3D11RasterizerState*      createRasterizer(const D3D11_RASTERIZER_DESC &desc) override    { return newObject<ID3D11RasterizerState>(); }
+    ID3D11BlendState*           createBlend(const D3D11_BLEND_DESC &desc) override              { return newObject<ID3D11BlendState>(); }
+    ID3D11ShaderResourceView*   createSRV(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC &desc) override;
+    ID3D11RenderTargetView*     createRTV(ID3D11Resource *resource, const D3D11_RENDER_TARGET_VIEW_DESC &desc) override;
+    void                        release(ID3D11DeviceChild *obj) override;
+
+    bool getTextureDesc(ID3D11Resource *resource, D3D11_TEXTURE2D_DESC &o_desc) override;
+    int  getResourceRefs(ID3D11Resource *resource) override { count(); return -1; }
+    void getViewDesc(ID3D11ShaderResourceView *view, D3D11_SHADER_RESOURCE_VIEW_DESC &o_desc, ID3D11Resource *&o_resource) override;
+    void getViewDesc(ID3D11RenderTargetView *view, D3D11_RENDER_TARGET_VIEW_DESC &o_desc, ID3D11Resource *&o_resource) override;
+
+    bool updateBuffer(ID3D11Buffer *buf, const void *data, size_t size) override;
+    void setPixelShader(ID3D11PixelShader *shader) override                                     { bind(); }
+    void setConstantBuffers(int slot, int num, ID3D11Buffer *const *buffers) override           { bind(); }
+    void setSamplers(int slot, int num, ID3D11SamplerState *const *samplers) override           { bind(); }
+    void setShaderResources(int slot, int num, ID3D11ShaderResourceView *const *views) override { bind(); }
+    void setDepthStencil(ID3D11DepthStencilState *state) override                               { bind(); }
+
+    NvResult loadAsset(NvCo::ReadStream *stream, hwAssetID &o_aid, const hwConversionSettings &settings) override;
+    NvResult createAsset(const hwAssetDescriptor &desc, hwAssetID &o_aid, const hwConversionSettings &settings) override;
+    NvResult freeAsset(hwAssetID aid) override                                  { sdk(); --m_objects_alive; return NV_OK; }
+    int      getNumBones(hwAssetID aid) override                                { sdk(); return 0; }
+    NvResult getBoneName(hwAssetID aid, int nth, char *o_name) override         { sdk(); return NV_FAIL; }
+    NvResult getBoneIndices(hwAssetID aid, hwFloat4 *o_indices) override        { sdk(); return NV_FAIL; }
+    NvResult getBoneWeights(hwAssetID aid, hwFloat4 *o_weights) override        { sdk(); return NV_FAIL; }
+    NvResult getBindPose(hwAssetID aid, int nth, hwMatrix *o_mat) override      { sdk(); return NV_FAIL; }
+    NvResult getInstanceDescriptorFromAsset(hwAssetID aid, hwHairDescriptor &o_desc) override { sdk(); o_desc = hwHairDescriptor(); return NV_OK; }
+
+    NvResult createInstance(hwAssetID aid, hwInstanceID &o_iid) override;
+    NvResult freeInstance(hwInstanceID iid) override                            { sdk(); --m_objects_alive; return NV_OK; }
+    NvResult getBounds(hwInstanceID iid, hwFloat3 &o_min, hwFloat3 &o_max) override;
+    NvResult getInstanceDescriptor(hwInstanceID iid, hwHairDescriptor &o_desc) override { sdk(); o_desc = hwHairDescriptor(); return NV_OK; }
+    NvResult updateInstanceDescriptor(hwInstanceID iid, const hwHairDescriptor &desc) override { sdk(); return NV_OK; }
+    NvResult setTexture(hwInstanceID iid, hwTextureType type, ID3D11ShaderResourceView *srv) override { sdk(); return NV_OK; }
+    NvResult updateSkinningMatrices(hwInstanceID iid, int num_bones, const hwMatrix *matrices) override { sdk(); return NV_OK; }
+    NvResult updateSkinningDQs(hwInstanceID iid, int num_bones, const hwDQuaternion *dqs) override      { sdk(); return NV_OK; }
+
+    NvResult setViewProjection(const hwMatrix &view, const hwMatrix &proj, float fov) override { sdk(); return NV_OK; }
+    NvResult stepSimulation(float dt) override                                  { sdk(); return NV_OK; }
+    void     preRender(float interpolation) override                            { sdk(); }
+    NvResult prepareShaderConstantBuffer(hwInstanceID iid, NvHair::ShaderConstantBuffer &o_cb) override;
+    NvResult getShaderResources(hwInstanceID iid, ID3D11ShaderResourceView **o_srvs) override;
+    NvResult getTextures(hwInstanceID iid, const hwTextureType *types, int num, ID3D11ShaderResourceView **o_srvs) override;
+    NvResult renderHairs(hwInstanceID iid, const NvHair::ShaderSettings &settings) override;
+    NvResult renderVisualization(hwInstanceID iid) override                     { sdk(); return NV_OK; }
+
+private:
+    template<class T> T* newObject()
+    {
+        count();
+        ++m_objects_created;
+        ++m_objects_alive;
+        auto *obj = new hwNullObject();
+        return reinterpret_cast<T*>(obj);
+    }
+    void count() { ++m_calls; }
+    void bind() { ++m_calls; ++m_binds; }
+    void sdk()  { ++m_calls; ++m_sdk_calls; }
+    void wait() const;
+
+    int m_latency_us;
+    std::atomic_int m_next_id;
+
+    // written by the render thread, read by whoever asks for the stats
+    std::atomic_int m_calls;
+    std::atomic_int m_objects_created;
+    std::atomic_int m_objects_alive;
+    std::atomic_int m_binds;
+    std::atomic_int m_uploads;
+    std::atomic_int m_bytes_uploaded;
+    std::atomic_int m_draws;
+    std::atomic_int m_sdk_calls;
+};
+
+
+hwBackendNull::hwBackendNull(int latency_us)
+    : m_latency_us(std::max<int>(latency_us, 0))
+    , m_next_id(0)
+    , m_calls(0)
+    , m_objects_created(0)
+    , m_objects_alive(0)
+    , m_binds(0)
+    , m_uploads(0)
+    , m_bytes_uploaded(0)
+    , m_draws(0)
+    , m_sdk_calls(0)
+{
+}
+
+void hwBackendNull::getStats(hwBackendStats &o_stats) const
+{
+    o_stats.calls = m_calls;
+    o_stats.objects_created = m_objects_created;
+    o_stats.objects_alive = m_objects_alive;
+    o_stats.binds = m_binds;
+    o_stats.uploads = m_uploads;
+    o_stats.bytes_uploaded = m_bytes_uploaded;
+    o_stats.draws = m_draws;
+    o_stats.sdk_calls = m_sdk_calls;
+}
+
+// spins rather than sleeps: sleeping is far coarser than the microseconds a driver takes
+void hwBackendNull::wait() const
+{
+    if (m_latency_us <= 0) { return; }
+
+    auto end = std::chrono::high_resolution_clock::now() + std::chrono::microseconds(m_latency_us);
+    while (std::chrono::high_resolution_clock::now() < end) {}
+}
+
+ID3D11ShaderResourceView* hwBackendNull::createSRV(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC &desc)
+{
+    auto *ret = newObject<ID3D11ShaderResourceView>();
+    auto *obj = reinterpret_cast<hwNullObject*>(ret);
+    obj->resource = resource;
+    obj->srv_desc = desc;
+    return ret;
+}
+
+ID3D11RenderTargetView* hwBackendNull::createRTV(ID3D11Resource *resource, const D3D11_RENDER_TARGET_VIEW_DESC &desc)
+{
+    auto *ret = newObject<ID3D11RenderTargetView>();
+    auto *obj = reinterpret_cast<hwNullObject*>(ret);
+    obj->resource = resource;
+    obj->rtv_desc = desc;
+    return ret;
+}
+
+void hwBackendNull::release(ID3D11DeviceChild *obj)
+{
+    count();
+    if (!obj) { return; }
+    delete reinterpret_cast<hwNullObject*>(obj);
+    --m_objects_alive;
+}
+
+// resources are whatever the caller passed in, so there is nothing to ask. they look like a plain 2D texture.
+bool hwBackendNull::getTextureDesc(ID3D11Resource *resource, D3D11_TEXTURE2D_DESC &o_desc)
+{
+    count();
+    memset(&o_desc, 0, sizeof(o_desc));
+    o_desc.Width = o_desc.Height = 1;
+    o_desc.MipLevels = o_desc.ArraySize = 1;
+    o_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    return resource != nullptr;
+}
+
+void hwBackendNull::getViewDesc(ID3D11ShaderResourceView *view, D3D11_SHADER_RESOURCE_VIEW_DESC &o_desc, ID3D11Resource *&o_resource)
+{
+    count();
+    auto *obj = reinterpret_cast<hwNullObject*>(view);
+    o_desc = obj->srv_desc;
+    o_resource = obj->resource;
+}
+
+void hwBackendNull::getViewDesc(ID3D11RenderTargetView *view, D3D11_RENDER_TARGET_VIEW_DESC &o_desc, ID3D11Resource *&o_resource)
+{
+    count();
+    auto *obj = reinterpret_cast<hwNullObject*>(view);
+    o_desc = obj->rtv_desc;
+    o_resource = obj->resource;
+}
+
+bool hwBackendNull::updateBuffer(ID3D11Buffer *buf, const void *data, size_t size)
+{
+    count();
+    if (!buf) { return false; }
+    ++m_uploads;
+    m_bytes_uploaded += (int)size;
+    wait();
+    return true;
+}
+
+// the stream is read through and parsed, so file IO and parsing are part of what is measured. hwApxRead() stands in
+// for the SDK's parser, which is slower: this is the least a load costs.
+NvResult hwBackendNull::loadAsset(NvCo::ReadStream *stream, hwAssetID &o_aid, const hwConversionSettings &settings)
+{
+    sdk();
+    if (!stream) { return NV_FAIL; }
+
+    std::string data;
+    char buf[4096];
+    for (size_t n; (n = stream->read(buf, sizeof(buf))) > 0; ) { data.append(buf, n); }
+    hwApxAsset apx;
+    if (data.empty() || !hwApxRead(data.data(), data.size(), apx)) { return NV_FAIL; }
+
+    o_aid = (hwAssetID)m_next_id++;
+    ++m_objects_created;
+    ++m_objects_alive;
+    return NV_OK;
+}
+
+NvResult hwBackendNull::createAsset(const hwAssetDescriptor &desc, hwAssetID &o_aid, const hwConversionSettings &settings)
+{
+    sdk();
+    if (desc.m_numVertices == 0 || !desc.m_vertices) { return NV_FAIL; }
+
+    o_aid = (hwAssetID)m_next_id++;
+    ++m_objects_created;
+    ++m_objects_alive;
+    return NV_OK;
+}
+
+NvResult hwBackendNull::createInstance(hwAssetID aid, hwInstanceID &o_iid)
+{
+    sdk();
+    o_iid = (hwInstanceID)m_next_id++;
+    ++m_objects_created;
+    ++m_objects_alive;
+    return NV_OK;
+}
+
+NvResult hwBackendNull::getBounds(hwInstanceID iid, hwFloat3 &o_min, hwFloat3 &o_max)
+{
+    sdk();
+    o_min.x = o_min.y = o_min.z = -1.0f;
+    o_max.x = o_max.y = o_max.z = 1.0f;
+    return NV_OK;
+}
+
+NvResult hwBackendNull::prepareShaderConstantBuffer(hwInstanceID iid, NvHair::ShaderConstantBuffer &o_cb)
+{
+    sdk();
+    // the SDK's constants hold the instance's transforms and hair parameters: they differ from one instance to the next
+    memset(&o_cb, 0, sizeof(o_cb));
+    memcpy(&o_cb, &iid, std::min(sizeof(iid), sizeof(o_cb)));
+    return NV_OK;
+}
+
+NvResult hwBackendNull::getShaderResources(hwInstanceID iid, ID3D11ShaderResourceView **o_srvs)
+{
+    sdk();
+    std::fill(o_srvs, o_srvs + NvHair::ShaderResourceType::COUNT_OF, nullptr);
+    return NV_OK;
+}
+
+NvResult hwBackendNull::getTextures(hwInstanceID iid, const hwTextureType *types, int num, ID3D11ShaderResourceView **o_srvs)
+{
+    sdk();
+    std::fill(o_srvs, o_srvs + num, nullptr);
+    return NV_OK;
+}
+
+NvResult hwBackendNull::renderHairs(hwInstanceID iid, const NvHair::ShaderSettings &settings)
+{
+    count();
+    ++m_draws;
+    wait();
+    return NV_OK;
+}
+
+hwBackend* hwCreateBackendNull(int latency_us)
+{
+    return new hwBackendNull(latency_us);
+}
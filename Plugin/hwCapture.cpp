@@ -0,0 +1,292 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwContext.h"
+
+hwCaptureWriter::hwCaptureWriter()
+{
+}
+
+hwCaptureWriter::~hwCaptureWriter()
+{
+    close();
+}
+
+bool hwCaptureWriter::open(const char *path)
+{
+    close();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_file.open(path, std::ios::binary);
+    if (!m_file) {
+        hwLog("hwCaptureWriter::open(): failed to open %s\n", path);
+        return false;
+    }
+
+    hwCaptureFileHeader header;
+    header.magic = hwCaptureMagic;
+    header.version = hwCaptureVersion;
+    header.descriptor_size = sizeof(hwHairDescriptor);
+    header.pad = 0;
+    m_file.write((const char*)&header, sizeof(header));
+
+    m_start = std::chrono::steady_clock::now();
+    m_active = true;
+    hwLog("hwCaptureWriter::open(): capturing to %s\n", path);
+    return true;
+}
+
+void hwCaptureWriter::close()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_active) { return; }
+
+    m_active = false;
+    m_file.close();
+    hwLog("hwCaptureWriter::close()\n");
+}
+
+uint64_t hwCaptureWriter::now() const
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+void hwCaptureWriter::write(hwECaptureRecord type, uint64_t time, const void *data, size_t size, const void *extra, size_t extra_size)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_active) { return; }
+
+    hwCaptureRecordHeader header;
+    header.type = type;
+    header.size = (uint32_t)(size + extra_size);
+    header.time = time;
+    m_file.write((const char*)&header, sizeof(header));
+    m_file.write((const char*)data, size);
+    if (extra_size > 0) {
+        m_file.write((const char*)extra, extra_size);
+    }
+}
+
+
+
+// captured handle -> handle of the replaying context
+class hwHandleRemap
+{
+public:
+    void set(uint32_t from, uint32_t to) { m_table[from] = to; }
+    uint32_t operator[](uint32_t from) const
+    {
+        auto i = m_table.find(from);
+        return i != m_table.end() ? i->second : hwNullHandle;
+    }
+
+private:
+    std::map<uint32_t, uint32_t> m_table;
+};
+
+static void hwReplayCommand(hwContext &ctx, const hwCommandHeader &header, const void *data,
+    const hwHandleRemap &shaders, const hwHandleRemap &instances)
+{
+    switch (header.type) {
+    case hwECommandType_SetViewProjection: {
+        auto &c = *(const hwCmdSetViewProjection*)data;
+        ctx.setViewProjection(c.view, c.proj, c.fov);
+        break;
+    }
+    case hwECommandType_SetRenderTarget:
+        ctx.setRenderTarget(nullptr, nullptr);
+        break;
+    case hwECommandType_SetShader:
+        ctx.setShader(shaders[((const hwCmdSetShader*)data)->hs]);
+        break;
+    case hwECommandType_SetLights: {
+        auto &c = *(const hwCmdSetLights*)data;
+        ctx.setLights(c.num_lights, c.lights);
+        break;
+    }
+    case hwECommandType_SetSphericalHarmonics: {
+        auto &c = *(const hwCmdSetSphericalHarmonics*)data;
+        ctx.setSphericalHarmonics(c.Ar, c.Ag, c.Ab, c.Br, c.Bg, c.Bb, c.C);
+        break;
+    }
+    case hwECommandType_SetGIParameters:
+        ctx.setGIParameters(((const hwCmdSetGIParameters*)data)->params);
+        break;
+    case hwECommandType_SetReflectionProbe:
+        ctx.setReflectionProbe(nullptr, nullptr);
+        break;
+    case hwECommandType_Render:
+        ctx.render(instances[((const hwCmdRender*)data)->hi]);
+        break;
+    case hwECommandType_RenderShadow:
+        ctx.renderShadow(instances[((const hwCmdRender*)data)->hi]);
+        break;
+    case hwECommandType_StepSimulation:
+        ctx.stepSimulation(((const hwCmdStepSimulation*)data)->dt);
+        break;
+    case hwECommandType_RenderBatch:
+    case hwECommandType_RenderShadowBatch: {
+        auto &c = *(const hwCmdRenderBatch*)data;
+        std::vector<hwHInstance> handles(c.handles, c.handles + c.count);
+        for (auto &h : handles) { h = instances[h]; }
+        if (header.type == hwECommandType_RenderBatch) { ctx.renderBatch(c.count, handles.data()); }
+        else { ctx.renderShadowBatch(c.count, handles.data()); }
+        break;
+    }
+    case hwECommandType_SetInstanceEnvironment: {
+        auto c = *(const hwCmdSetInstanceEnvironment*)data;
+        c.env.probe1 = c.env.probe2 = nullptr;
+        ctx.instanceSetEnvironment(instances[c.hi], c.env);
+        break;
+    }
+    default:
+        hwLog("hwReplayCaptureFile(): unknown command %d\n", header.type);
+        break;
+    }
+}
+
+bool hwReplayCaptureFile(hwContext &ctx, const char *path, bool realtime)
+{
+    std::string bin;
+    if (!hwFileToString(bin, path)) {
+        hwLog("hwReplayCaptureFile(): failed to load %s\n", path);
+        return false;
+    }
+
+    const char *pos = bin.data();
+    const char *end = pos + bin.size();
+    {
+        hwCaptureFileHeader header;
+        if (bin.size() < sizeof(header)) { pos = end; }
+        else { memcpy(&header, pos, sizeof(header)); }
+        if (pos == end || header.magic != hwCaptureMagic || header.version != hwCaptureVersion) {
+            hwLog("hwReplayCaptureFile(): %s is not a capture file or its version doesn't match\n", path);
+            return false;
+        }
+        if (header.descriptor_size != sizeof(hwHairDescriptor)) {
+            hwLog("hwReplayCaptureFile(): %s was captured with a different HairWorks SDK\n", path);
+            return false;
+        }
+        pos += sizeof(header);
+    }
+
+    hwHandleRemap shaders, assets, instances;
+    auto start = std::chrono::steady_clock::now();
+    int num_records = 0;
+
+    // record payloads are not aligned in the file. copy each one out before reading it as a struct.
+    std::vector<uint64_t> payload;
+    while (pos + sizeof(hwCaptureRecordHeader) <= end) {
+        hwCaptureRecordHeader header;
+        memcpy(&header, pos, sizeof(header));
+        pos += sizeof(header);
+        if (header.size > (size_t)(end - pos)) {
+            hwLog("hwReplayCaptureFile(): %s is truncated\n", path);
+            break;
+        }
+        payload.resize(header.size / sizeof(uint64_t) + 1);
+        memcpy(payload.data(), pos, header.size);
+        pos += header.size;
+        const char *data = (const char*)payload.data();
+
+        if (realtime) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(header.time));
+        }
+
+        switch (header.type) {
+        case hwECaptureRecord_Command: {
+            auto &command = *(const hwCommandHeader*)data;
+            hwReplayCommand(ctx, command, &command + 1, shaders, instances);
+            break;
+        }
+        case hwECaptureRecord_ShaderLoad: {
+            auto &r = *(const hwCapShaderLoad*)data;
+            shaders.set(r.result, ctx.shaderLoadFromFile(std::string(data + sizeof(r), header.size - sizeof(r))));
+            break;
+        }
+        case hwECaptureRecord_ShaderLoadFromMemory: {
+            auto &r = *(const hwCapShaderLoad*)data;
+            shaders.set(r.result, ctx.shaderLoadFromMemory(data + sizeof(r), header.size - sizeof(r)));
+            break;
+        }
+        case hwECaptureRecord_ShaderRelease:
+            ctx.shaderRelease(shaders[((const hwCapHandle*)data)->handle]);
+            break;
+        case hwECaptureRecord_ShaderReload:
+            ctx.shaderReload(shaders[((const hwCapHandle*)data)->handle]);
+            break;
+        case hwECaptureRecord_AssetLoad: {
+            auto &r = *(const hwCapAssetLoad*)data;
+            assets.set(r.result, ctx.assetLoadFromFile(std::string(data + sizeof(r), header.size - sizeof(r)), &r.settings));
+            break;
+        }
+        case hwECaptureRecord_AssetLoadFromMemory: {
+            auto &r = *(const hwCapAssetLoad*)data;
+            assets.set(r.result, ctx.assetLoadFromMemory(data + sizeof(r), header.size - sizeof(r), &r.settings));
+            break;
+        }
+        case hwECaptureRecord_AssetRelease:
+            ctx.assetRelease(assets[((const hwCapHandle*)data)->handle]);
+            break;
+        case hwECaptureRecord_AssetReload:
+            ctx.assetReload(assets[((const hwCapHandle*)data)->handle]);
+            break;
+        case hwECaptureRecord_InstanceCreate: {
+            auto &r = *(const hwCapInstanceCreate*)data;
+            instances.set(r.result, ctx.instanceCreate(assets[r.asset]));
+            break;
+        }
+        case hwECaptureRecord_InstanceRelease:
+            ctx.instanceRelease(instances[((const hwCapHandle*)data)->handle]);
+            break;
+        case hwECaptureRecord_InstanceSetDescriptor: {
+            auto &r = *(const hwCapInstanceSetDescriptor*)data;
+            ctx.instanceSetDescriptor(instances[r.hi], r.desc);
+            break;
+        }
+        case hwECaptureRecord_InstanceSetTexture: {
+            auto &r = *(const hwCapInstanceSetTexture*)data;
+            ctx.instanceSetTexture(instances[r.hi], (hwTextureType)r.type, nullptr);
+            break;
+        }
+        case hwECaptureRecord_InstanceUpdateSkinningMatrices: {
+            auto &r = *(const hwCapInstanceSkinning*)data;
+            ctx.instanceUpdateSkinningMatrices(instances[r.hi], r.num_bones, (hwMatrix*)(data + sizeof(r)));
+            break;
+        }
+        case hwECaptureRecord_InstanceUpdateSkinningDQs: {
+            auto &r = *(const hwCapInstanceSkinning*)data;
+            ctx.instanceUpdateSkinningDQs(instances[r.hi], r.num_bones, (hwDQuaternion*)(data + sizeof(r)));
+            break;
+        }
+        case hwECaptureRecord_InitializeDepthStencil:
+            ctx.initializeDepthStencil(((const hwCapInt*)data)->value);
+            break;
+        case hwECaptureRecord_SetShadowTexture:
+            ctx.setShadowTexture(nullptr);
+            break;
+        case hwECaptureRecord_SetShadowParams:
+            ctx.setShadowParams(nullptr);
+            break;
+        case hwECaptureRecord_BeginFrame:
+            ctx.beginFrame(((const hwCapInt*)data)->value);
+            break;
+        case hwECaptureRecord_Submit:
+            ctx.submit(((const hwCapInt*)data)->value);
+            break;
+        case hwECaptureRecord_Flush: {
+            auto &r = *(const hwCapFlush*)data;
+            if (r.all) { ctx.flush(); }
+            else { ctx.flush(r.frame, r.view); }
+            break;
+        }
+        default:
+            hwLog("hwReplayCaptureFile(): unknown record %d\n", header.type);
+            break;
+        }
+        ++num_records;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    hwLog("hwReplayCaptureFile(%s): %d records in %.2f ms\n", path, num_records, (double)elapsed / 1000.0);
+    return true;
+}
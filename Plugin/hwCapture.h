@@ -0,0 +1,86 @@
+﻿#pragma once
+
+// capture of the calls made to hwContext, for reproducing a session offline.
+// the file is a header followed by records of [hwCaptureRecordHeader][payload].
+// deferred commands are stored as the very same records hwCommandBuffer holds. other calls have their own payloads below.
+// GPU resources (textures, buffers) can't be captured; only whether one was given is recorded, and replay passes nullptr.
+
+#define hwCaptureMagic      0x50435748 // "HWCP"
+#define hwCaptureVersion    1
+
+enum hwECaptureRecord
+{
+    hwECaptureRecord_Command,               // payload: hwCommandHeader + command record
+    hwECaptureRecord_ShaderLoad,            // hwCapShaderLoad + path
+    hwECaptureRecord_ShaderRelease,         // hwCapHandle
+    hwECaptureRecord_ShaderReload,          // hwCapHandle
+    hwECaptureRecord_AssetLoad,             // hwCapAssetLoad + path
+    hwECaptureRecord_AssetRelease,          // hwCapHandle
+    hwECaptureRecord_AssetReload,           // hwCapHandle
+    hwECaptureRecord_InstanceCreate,        // hwCapInstanceCreate
+    hwECaptureRecord_InstanceRelease,       // hwCapHandle
+    hwECaptureRecord_InstanceSetDescriptor, // hwCapInstanceSetDescriptor
+    hwECaptureRecord_InstanceSetTexture,    // hwCapInstanceSetTexture
+    hwECaptureRecord_InstanceUpdateSkinningMatrices,// hwCapInstanceSkinning + hwMatrix[num_bones]
+    hwECaptureRecord_InstanceUpdateSkinningDQs,     // hwCapInstanceSkinning + hwDQuaternion[num_bones]
+    hwECaptureRecord_InitializeDepthStencil,// hwCapInt (flip comparison)
+    hwECaptureRecord_SetShadowTexture,      // hwCapInt (has texture)
+    hwECaptureRecord_SetShadowParams,       // hwCapInt (has buffer)
+    hwECaptureRecord_BeginFrame,            // hwCapInt (frame)
+    hwECaptureRecord_Submit,                // hwCapInt (view)
+    hwECaptureRecord_Flush,                 // hwCapFlush
+    hwECaptureRecord_ShaderLoadFromMemory,  // hwCapShaderLoad + shader bytes
+    hwECaptureRecord_AssetLoadFromMemory,   // hwCapAssetLoad + asset bytes
+};
+
+struct hwCaptureFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t descriptor_size;   // sizeof(hwHairDescriptor). captures are only replayable with the same SDK
+    uint32_t pad;
+};
+
+struct hwCaptureRecordHeader
+{
+    uint32_t type;
+    uint32_t size;      // payload size
+    uint64_t time;      // microseconds since the capture began
+};
+
+struct hwCapHandle                  { uint32_t handle; };
+struct hwCapInt                     { int value; };
+struct hwCapShaderLoad              { hwHShader result; };
+struct hwCapAssetLoad               { hwHAsset result; hwConversionSettings settings; };
+struct hwCapInstanceCreate          { hwHAsset asset; hwHInstance result; };
+struct hwCapInstanceSetDescriptor   { hwHInstance hi; hwHairDescriptor desc; };
+struct hwCapInstanceSetTexture      { hwHInstance hi; int type; int has_texture; };
+struct hwCapInstanceSkinning        { hwHInstance hi; int num_bones; };
+struct hwCapFlush                   { int frame; int view; int all; }; // all: flush() rather than flush(frame, view)
+
+
+// records can come from both the game thread (calls) and the render thread (flush), so writes are serialized.
+class hwCaptureWriter
+{
+public:
+    hwCaptureWriter();
+    ~hwCaptureWriter();
+
+    bool open(const char *path);
+    void close();
+    bool active() const { return m_active; }
+    uint64_t now() const;
+
+    void write(hwECaptureRecord type, uint64_t time, const void *data, size_t size, const void *extra = nullptr, size_t extra_size = 0);
+
+private:
+    std::ofstream       m_file;
+    std::mutex          m_mutex;
+    std::atomic<bool>   m_active = { false };
+    std::chrono::steady_clock::time_point m_start;
+};
+
+
+// drives ctx with the calls stored in a capture file, in the same order.
+// handles are remapped to the ones ctx hands out. if realtime is true, the original timing between calls is reproduced.
+bool hwReplayCaptureFile(hwContext &ctx, const char *path, bool realtime);
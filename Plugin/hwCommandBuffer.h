@@ -0,0 +1,80 @@
+﻿#pragma once
+
+// linear arena of tagged POD command records.
+// records are laid out back to back as [hwCommandHeader][payload]. clear() keeps the capacity,
+// so once the buffer has grown to the size of a typical frame, recording does no heap allocation.
+
+struct hwCommandHeader
+{
+    uint32_t type;
+    uint32_t size; // size of the whole record (header + payload), multiple of hwCommandBuffer::Align
+};
+
+class hwCommandBuffer
+{
+public:
+    static const size_t Align = 8;
+
+    hwCommandBuffer() : m_size(0) {}
+
+    void* allocate(uint32_t type, size_t payload_size)
+    {
+        size_t record_size = (sizeof(hwCommandHeader) + payload_size + (Align - 1)) & ~(Align - 1);
+        size_t pos = m_size;
+        if (pos + record_size > m_data.size()) {
+            m_data.resize(std::max<size_t>(m_data.size() * 2, pos + record_size));
+        }
+        m_size += record_size;
+
+        auto *header = (hwCommandHeader*)&m_data[pos];
+        header->type = type;
+        header->size = (uint32_t)record_size;
+        return header + 1;
+    }
+
+    // T is a POD record. extra is for variable length records (trailing array).
+    template<class T>
+    T* push(uint32_t type, size_t extra = 0)
+    {
+        return (T*)allocate(type, sizeof(T) + extra);
+    }
+
+    // body: void(const hwCommandHeader &header, const void *payload)
+    // begin is a byte offset of a record, e.g. size() at some earlier point of recording.
+    template<class Body>
+    void each(const Body &body, size_t begin = 0) const
+    {
+        for (size_t pos = begin; pos < m_size; ) {
+            auto *header = (const hwCommandHeader*)&m_data[pos];
+            body(*header, (const void*)(header + 1));
+            pos += header->size;
+        }
+    }
+
+    // keeps only records for which pred(header) returns true. records are compacted in place.
+    template<class Pred>
+    void filter(const Pred &pred)
+    {
+        size_t dst = 0;
+        for (size_t pos = 0; pos < m_size; ) {
+            auto *header = (const hwCommandHeader*)&m_data[pos];
+            size_t record_size = header->size;
+            if (pred(*header)) {
+                if (dst != pos) { memmove(&m_data[dst], &m_data[pos], record_size); }
+                dst += record_size;
+            }
+            pos += record_size;
+        }
+        m_size = dst;
+    }
+
+    void   clear()          { m_size = 0; }
+    bool   empty() const    { return m_size == 0; }
+    size_t size() const     { return m_size; }
+    size_t capacity() const { return m_data.size(); }
+    void   swap(hwCommandBuffer &other) { m_data.swap(other.m_data); std::swap(m_size, other.m_size); }
+
+private:
+    std::vector<char> m_data;
+    size_t m_size;
+};
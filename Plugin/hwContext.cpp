@@ -1,6 +1,11 @@
 ﻿#include "pch.h"
 #include "hwInternal.h"
 #include "hwContext.h"
+#include "hwBackend.h"
+#include "hwHash.h"
+#include "hwReadStream.h"
+#include "hwApxReader.h"
+#include "hwCookedAsset.h"
 
 #if defined(_M_IX86)
 #define hwSDKDLL "NvHairWorksDx11.win32.dll"
@@ -15,6 +20,16 @@ bool operator==(const hwConversionSettings &a, const hwConversionSettings &b)
 #undef cmp
 }
 
+// consistent with operator== above
+static uint64_t hwHashSettings(const hwConversionSettings &v)
+{
+    uint64_t h = hwHash64(&v.m_targetUpAxisHint, sizeof(v.m_targetUpAxisHint));
+    h = hwHash64(&v.m_targetHandednessHint, sizeof(v.m_targetHandednessHint), h);
+    h = hwHash64(&v.m_conversionMatrix, sizeof(v.m_conversionMatrix), h);
+    h = hwHash64(&v.m_targetSceneUnit, sizeof(v.m_targetSceneUnit), h);
+    return h;
+}
+
 bool hwFileToString(std::string &o_buf, const char *path)
 {
     std::ifstream f(path, std::ios::binary);
@@ -35,6 +50,11 @@ hwSDK* hwContext::loadSDK()
         return g_hw_sdk;
     }
 
+#ifndef hwWithD3D11
+    // headless builds have no loader. the null backend doesn't need the SDK.
+    hwLog("hwContext::loadSDK(): not available in headless builds\n");
+    return nullptr;
+#else // hwWithD3D11
     char path[MAX_PATH] = {0};
 
     if(path[0] == 0) {
@@ -54,6 +74,7 @@ hwSDK* hwContext::loadSDK()
 	g_hw_sdk = NvHair::loadSdk(path, NV_HAIR_VERSION, nullptr, nullptr);
     hwLog("hwContext::loadSDK(): %s (%s)\n", g_hw_sdk ? "succeeded" : "failed", path);
     return g_hw_sdk;
+#endif // hwWithD3D11
 }
 
 void hwContext::unloadSDK()
@@ -67,6 +88,10 @@ void hwContext::unloadSDK()
 
 hwContext::hwContext()
 {
+    for (int i = 1; i < hwNumCommandPages; ++i) {
+        m_free_pages.push(i);
+    }
+    m_pending_pages.reserve(hwNumCommandPages);
 }
 
 hwContext::~hwContext()
@@ -76,7 +101,7 @@ hwContext::~hwContext()
 
 bool hwContext::valid() const
 {
-    return m_d3ddev!=nullptr && m_d3dctx!=nullptr && g_hw_sdk!=nullptr;
+    return m_backend!=nullptr;
 }
 
 bool hwContext::initialize(hwDevice *d3d_device)
@@ -92,914 +117,2281 @@ bool hwContext::initialize(hwDevice *d3d_device)
 		return false;
 	}
 
-	m_d3ddev = (ID3D11Device*)d3d_device;
-	m_d3ddev->GetImmediateContext(&m_d3dctx);
-
-	m_dev_handle = NvCo::Dx11Type::wrap((ID3D11Device*)d3d_device);
-	m_ctx_handle = NvCo::Dx11Type::wrap(m_d3dctx);
-
-	if (NV_SUCCEEDED(g_hw_sdk->initRenderResources(m_dev_handle, m_ctx_handle))) {
-		hwLog("GFSDK_HairSDK::InitRenderResources() succeeded.\n");
-	}
-	else {
-		hwLog("GFSDK_HairSDK::InitRenderResources() failed.\n");
-		finalize();
-		return false;
-	}
-
-	if (NV_SUCCEEDED(g_hw_sdk->setCurrentContext(m_ctx_handle))) {
-		hwLog("GFSDK_HairSDK::SetCurrentContext() succeeded.\n");
-	}
-	else {
-		hwLog("GFSDK_HairSDK::SetCurrentContext() failed.\n");
-		finalize();
-		return false;
-	}
+#ifdef hwWithD3D11
+	return initialize(hwCreateBackendD3D11((ID3D11Device*)d3d_device, g_hw_sdk));
+#else // hwWithD3D11
+	return false;
+#endif // hwWithD3D11
+}
 
+bool hwContext::initialize(hwBackend *backend)
+{
+	if (backend == nullptr) { return false; }
+	m_backend = backend;
+	hwLog("hwContext::initialize(): %s backend\n", m_backend->getName());
+
+	m_states.initialize(m_backend);
+	m_views.initialize(m_backend);
+	m_views.setReleaser([this](ID3D11View *view) { retire(view); });
+	m_render_views.initialize(m_backend);
+	m_rs_enable_depth = getDepthState(false);
 	{
-		CD3D11_DEPTH_STENCIL_DESC desc;
-
-		m_d3ddev->CreateDepthStencilState(&desc, &m_rs_enable_depth);
+		D3D11_SAMPLER_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+		desc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+		desc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+		desc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
+		desc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+		desc.MaxAnisotropy = 1;
+		desc.MinLOD = 0;
+		desc.MaxLOD = D3D11_FLOAT32_MAX;
+		m_rs_sampler_texture = m_states.getSampler(desc);
 	}
 	{
-		// create constant buffer for hair rendering pixel shader
-		D3D11_BUFFER_DESC desc;
-		desc.Usage = D3D11_USAGE_DYNAMIC;
-		desc.ByteWidth = sizeof(hwConstantBuffer);
-		desc.StructureByteStride = 0;
-		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		desc.MiscFlags = 0;
-		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-		m_d3ddev->CreateBuffer(&desc, 0, &m_rs_constant_buffer);
+		D3D11_SAMPLER_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+		desc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+		desc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+		desc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+		desc.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT;
+		desc.MinLOD = 0;
+		desc.MaxLOD = D3D11_FLOAT32_MAX;
+		m_rs_sampler_shadow = m_states.getSampler(desc);
 	}
+	// constant buffers for hair rendering pixel shader
+	m_rs_frame_cb = createConstantBuffer(sizeof(hwFrameConstantBuffer));
+	m_rs_instance_cb = createConstantBuffer(sizeof(hwInstanceConstantBuffer));
+	m_rs_legacy_cb = createConstantBuffer(sizeof(hwLegacyConstantBuffer));
+	m_frame_cb_dirty = true;
+	m_instance_cb_valid = false;
+	m_legacy_cb_valid = false;
 
 	return true;
 }
 
 void hwContext::finalize()
 {
-    for (auto &i : m_instances) { instanceRelease(i.handle); }
+    captureEnd();
+
+    // workers only touch the jobs they were given. the assets still loading are released below like the others
+    m_workers.finalize();
+    m_loading_assets.clear();
+    m_reloading_shaders.clear();
+    m_reloading_assets.clear();
+    m_watcher.clear();
+    m_file_watching = false;
+
+    m_instances.each([this](hwInstanceData &v) { instanceRelease(v.handle); });
     m_instances.clear();
+    m_instance_store.clear();
+    m_render_store.clear();
 
-    for (auto &i : m_assets) { assetRelease(i.handle); }
+    m_assets.each([this](hwAssetData &v) { assetRelease(v.handle); });
     m_assets.clear();
+    m_asset_paths.clear();
+    m_asset_contents.clear();
+    m_asset_sources.clear();
 
-    for (auto &i : m_shaders) { shaderRelease(i.handle); }
+    m_shaders.each([this](hwShaderData &v) { shaderRelease(v.handle); });
     m_shaders.clear();
-
-    for (auto &i : m_srvtable) { i.second->Release(); }
-    m_srvtable.clear();
-
-    for (auto &i : m_rtvtable) { i.second->Release(); }
-    m_rtvtable.clear();
-
-	if (reflectionSRV1)
-	{
-		reflectionSRV1->Release();
-		reflectionSRV1 = nullptr;
-	}
-
-	if (reflectionSRV2)
-	{
-		reflectionSRV2->Release();
-		reflectionSRV2 = nullptr;
-	}
-
-	if (shadowSRV)
-	{
-		shadowSRV->Release();
-		shadowSRV = nullptr;
-	}
-
-    if (m_rs_enable_depth) {
-        m_rs_enable_depth->Release();
-        m_rs_enable_depth = nullptr;
-    }
-
-    if (m_d3dctx)
-    {
-        m_d3dctx->Release();
-        m_d3dctx = nullptr;
+    m_shader_paths.clear();
+    m_shader_contents.clear();
+    m_shader_programs.clear();
+
+    // the views are released along with the cache
+    m_env = hwEnvironmentData();
+    std::fill(m_env_probes, m_env_probes + 2, nullptr);
+    std::fill(m_bound_probes, m_bound_probes + 2, nullptr);
+    shadowSRV = nullptr;
+    bufferSRV = nullptr;
+    m_views.finalize();
+    // the render thread is done: what is still retired goes now
+    collectRetired();
+    releaseRetired(true);
+    for (auto &r : m_retired_pending) { releaseObject(r); }
+    m_retired_pending.clear();
+    m_instance_envs.clear();
+    m_render_views.finalize();
+
+    m_rs_enable_depth = nullptr;
+    m_rs_sampler_texture = nullptr;
+    m_rs_sampler_shadow = nullptr;
+    m_states.finalize();
+
+    if (m_backend) {
+        m_backend->release(m_rs_frame_cb);
+        m_backend->release(m_rs_instance_cb);
+        m_backend->release(m_rs_legacy_cb);
+        delete m_backend;
+        m_backend = nullptr;
     }
+    m_rs_frame_cb = nullptr;
+    m_rs_instance_cb = nullptr;
+    m_rs_legacy_cb = nullptr;
 }
 
+static void hwReadAssetFile(hwAssetLoadJob &job, hwWorkerPool *workers = nullptr);
+
 void hwContext::move(hwContext &from)
 {
 #define mov(V) V=from.V; from.V=decltype(V)();
 
-    mov(m_d3dctx);
-    mov(m_d3ddev);
-
-    mov(m_shaders);
-    mov(m_assets);
-    mov(m_instances);
-    mov(m_srvtable);
-    mov(m_rtvtable);
+    mov(m_backend);
+
+    m_shaders.move(from.m_shaders);
+    m_assets.move(from.m_assets);
+    m_instances.move(from.m_instances);
+    mov(m_instance_store);
+    mov(m_render_store);
+    m_instance_store.changed = true; // m_published_stores stays behind
+    mov(m_shader_programs);
+    m_shader_programs_changed = true; // as does m_published_shaders
+    mov(m_instance_envs);
+    mov(m_shader_paths);
+    mov(m_asset_paths);
+    mov(m_shader_contents);
+    mov(m_asset_contents);
+    mov(m_asset_sources);
+    mov(m_asset_cache);
+    mov(m_loading_assets);
+    mov(m_reloading_shaders);
+    mov(m_reloading_assets);
+    {
+        // from's workers drop the reads they haven't started when it goes. they are queued again here: a read
+        // that has started already returns at once
+        auto workers = &m_workers;
+        for (hwHAsset ha : m_loading_assets) {
+            if (auto *v = m_assets.get(ha)) {
+                if (auto job = v->job) { m_workers.run([job, workers]() { hwReadAssetFile(*job, workers); }); }
+            }
+        }
+        for (hwHShader hs : m_reloading_shaders) {
+            if (auto *v = m_shaders.get(hs)) {
+                if (auto job = v->reload_job) { m_workers.run([job]() { hwReadAssetFile(*job); }); }
+            }
+        }
+        for (hwHAsset ha : m_reloading_assets) {
+            if (auto *v = m_assets.get(ha)) {
+                if (auto job = v->reload_job) { m_workers.run([job]() { hwReadAssetFile(*job); }); }
+            }
+        }
+    }
+    {
+        // the watcher can't be moved. it watches the files of what has been moved
+        bool watching = from.m_file_watching;
+        from.setFileWatching(false);
+        setFileWatching(watching);
+    }
+    m_views.move(from.m_views);
+    m_views.setReleaser([this](ID3D11View *view) { retire(view); });
+    m_render_views.move(from.m_render_views);
+    {
+        // the queue can't be moved. what was in it waits for the next hand off, the render thread's waits as it did
+        hwRetiredObject r;
+        while (from.m_retired.pop(r)) { m_retired_pending.push_back(r); }
+        m_retired_pending.insert(m_retired_pending.end(), from.m_retired_pending.begin(), from.m_retired_pending.end());
+        from.m_retired_pending.clear();
+        mov(m_retired_waiting);
+        mov(m_newest_frame);
+        mov(m_recording_frame);
+    }
     //mov(m_commands);
 
+    mov(m_states);
     mov(m_rs_enable_depth);
-    mov(m_rs_constant_buffer);
-    //mov(m_cb);
+    mov(m_rs_sampler_texture);
+    mov(m_rs_sampler_shadow);
+    mov(m_rs_frame_cb);
+    mov(m_rs_instance_cb);
+    mov(m_rs_legacy_cb);
+    mov(m_frame_cb);
+    mov(m_frame_cb_dirty);
+    mov(m_light_features);
+    mov(m_bound_shader);
+    mov(m_instance_cb);
+    mov(m_instance_cb_valid);
+    mov(m_legacy_cb);
+    mov(m_legacy_cb_valid);
+    // what is bound is unknown until the next beginDraws()
+    m_bound_ps = nullptr;
+    m_legacy_cb_bound = false;
+    std::fill(m_bound_probes, m_bound_probes + 2, nullptr);
+    mov(m_env);
+    std::copy(from.m_env_probes, from.m_env_probes + 2, m_env_probes);
+    std::fill(from.m_env_probes, from.m_env_probes + 2, nullptr);
+    mov(shadowSRV);
+    mov(shadowBuffer);
+    mov(bufferSRV);
+
+    m_stale_frame_policy = from.m_stale_frame_policy.load();
+    m_sort_mode = from.m_sort_mode.load();
+    m_dedup_bytes_saved = from.m_dedup_bytes_saved.exchange(0);
+    m_shader_variants = from.m_shader_variants.exchange(0);
 
 #undef mov
 }
 
 
-hwShaderData& hwContext::newShaderData()
+// what the asset is keyed on in m_asset_contents. a cooked asset carries the hash of the APX it was cooked from,
+// so it is shared with loads of the APX itself
+static void hwHashSource(hwAssetLoadJob &job)
+{
+    hwCookedAsset c;
+    if (job.cooked && hwReadCookedAsset(job.data, job.size, c)) {
+        job.source_hash = c.header->source_hash;
+        job.source_size = c.header->source_size;
+        job.geometry_hash = c.header->source_geometry_hash;
+    }
+    else {
+        job.source_hash = hwHashContent(job.data, job.size);
+        job.source_size = job.size;
+        hwApxSectionHashes sections;
+        job.geometry_hash = hwApxHashSections(job.data, job.size, sections) ? sections.geometry : 0;
+    }
+}
+
+// of what the first load of a file has read: its cooked asset as it is, or the APX parsed and cooked without a
+// descriptor (the other loads take the SDK's one of the first asset, see hwAssetSource). the loads waiting for it
+// are let go even if it fails: they read the file themselves then.
+static void hwBuildAssetSource(hwAssetSource &s, const hwAssetLoadJob &job, bool ok, hwWorkerPool *workers)
+{
+    std::string cooked;
+    if (ok && job.cooked) {
+        cooked.assign(job.data, job.size);
+    }
+    else if (ok) {
+        hwApxAsset apx;
+        if (hwApxRead(job.data, job.size, apx, workers)) {
+            hwCookAsset(apx, nullptr, job.source_hash, job.geometry_hash, 0, job.source_size, cooked);
+        }
+        else {
+            hwLog("hwBuildAssetSource(\"%s\") failed: can't read the HairAssetDescriptor.\n", job.path.c_str());
+        }
+    }
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.cooked.swap(cooked);
+    s.source_hash = job.source_hash;
+    s.built = true;
+    s.cond.notify_all();
+}
+
+// the first load of the file was queued before the loads that wait here, so a worker never waits for a job behind it
+static bool hwWaitAssetSource(hwAssetSource &s)
 {
-    auto i = std::find_if(m_shaders.begin(), m_shaders.end(), [](const hwShaderData &v) { return !v; });
-    if (i != m_shaders.end()) { return *i; }
+    std::unique_lock<std::mutex> lock(s.mutex);
+    s.cond.wait(lock, [&]() { return s.built; });
+    return !s.cooked.empty();
+}
 
-    hwShaderData tmp;
-    tmp.handle = m_shaders.size();
-    m_shaders.push_back(tmp);
-    return m_shaders.back();
+// reads the cooked asset from the cache, the parsed source of the file if the job has one, or the file.
+// run by a worker, or by the game thread if the load is synchronous or it needs the asset before a worker got to it.
+static void hwReadAssetFile(hwAssetLoadJob &job, hwWorkerPool *workers)
+{
+    int expected = hwAssetLoadJob::Queued;
+    if (!job.state.compare_exchange_strong(expected, hwAssetLoadJob::Reading)) { return; }
+
+    auto file = std::make_shared<hwMappedFile>();
+    job.cooked = job.cache.load(job.path, job.cache_tag, *file);
+    bool ok = true;
+    if (!job.cooked && job.source && !job.build_source && hwWaitAssetSource(*job.source)) {
+        // in the source's own format. there is nothing to cook: job.file stays null
+        job.cooked = true;
+        job.data = job.source->cooked.data();
+        job.size = job.source->cooked.size();
+    }
+    else if (job.cooked || file->open(job.path.c_str())) {
+        job.file = file;
+        job.data = file->data();
+        job.size = file->size();
+    }
+    else {
+        ok = false;
+    }
+    if (ok) { hwHashSource(job); }
+    if (job.build_source) { hwBuildAssetSource(*job.source, job, ok, workers); }
+    job.state = ok ? hwAssetLoadJob::Read : hwAssetLoadJob::Failed;
 }
 
 hwHShader hwContext::shaderLoadFromFile(const std::string &path)
 {
-    {
-        auto i = std::find_if(m_shaders.begin(), m_shaders.end(), [&](const hwShaderData &v) { return v.path == path; });
-        if (i != m_shaders.end() && i->ref_count > 0) {
-            ++i->ref_count;
-            return i->handle;
+    hwHShader ret = loadShader(path);
+    if (m_capture.active()) {
+        hwCapShaderLoad r = { ret };
+        captureCall(hwECaptureRecord_ShaderLoad, r, path.data(), path.size());
+    }
+    return ret;
+}
+
+// true if the compiled shader (DXBC) declares cbPerFrame but not cbPerInstance: it was built before the constants
+// were split and reads hwLegacyConstantBuffer. the names are in the resource definition (RDEF) chunk.
+static bool hwReadsLegacyConstants(const void *data, size_t size)
+{
+    auto *bytes = (const uint8_t*)data;
+    auto u32 = [&](size_t pos) { uint32_t r; memcpy(&r, bytes + pos, 4); return r; };
+    if (size < 32 || memcmp(bytes, "DXBC", 4) != 0) { return false; }
+
+    uint32_t num_chunks = u32(28);
+    if (num_chunks > (size - 32) / 4) { return false; }
+    for (uint32_t i = 0; i < num_chunks; ++i) {
+        size_t chunk = u32(32 + i * 4);
+        if (chunk > size - 8 || memcmp(bytes + chunk, "RDEF", 4) != 0) { continue; }
+        size_t rdef = chunk + 8, rdef_size = std::min<size_t>(u32(chunk + 4), size - rdef);
+        if (rdef_size < 8) { return false; }
+
+        // cbuffer descriptions are 24 bytes, starting with the offset of the name in the chunk
+        uint32_t num_cbuffers = u32(rdef), cbuffers = u32(rdef + 4);
+        bool per_frame = false, per_instance = false;
+        for (uint32_t c = 0; c < num_cbuffers; ++c) {
+            size_t desc = (size_t)cbuffers + c * 24;
+            if (desc + 4 > rdef_size) { break; }
+            size_t name = u32(rdef + desc);
+            if (name >= rdef_size) { continue; }
+            const char *str = (const char*)bytes + rdef + name;
+            size_t len = strnlen(str, rdef_size - name);
+            if (len == 10 && memcmp(str, "cbPerFrame", 10) == 0) { per_frame = true; }
+            if (len == 13 && memcmp(str, "cbPerInstance", 13) == 0) { per_instance = true; }
         }
+        return per_frame && !per_instance;
+    }
+    return false;
+}
+
+hwHShader hwContext::shaderLoadFromMemory(const void *data, size_t size)
+{
+    hwHShader ret = createShader(std::string(), data, size);
+    if (m_capture.active()) {
+        hwCapShaderLoad r = { ret };
+        captureCall(hwECaptureRecord_ShaderLoadFromMemory, r, data, size);
+    }
+    return ret;
+}
+
+hwHShader hwContext::loadShader(const std::string &path)
+{
+    std::string npath = hwPathRegistry::normalize(path);
+    if (auto *i = m_shaders.get(m_shader_paths.find(npath))) {
+        ++i->ref_count;
+        return i->handle;
     }
 
-    std::string bin;
-    if (!hwFileToString(bin, path.c_str())) {
+    hwMappedFile bin;
+    if (!bin.open(path.c_str())) {
         hwLog("failed to load shader (%s)\n", path.c_str());
         return hwNullHandle;
     }
 
-    hwShaderData& v = newShaderData();
-    v.path = path;
-    if (SUCCEEDED(m_d3ddev->CreatePixelShader(&bin[0], bin.size(), nullptr, &v.shader))) {
-        v.ref_count = 1;
-        hwLog("CreatePixelShader(%s) : %d succeeded.\n", path.c_str(), v.handle);
-        return v.handle;
+    hwHShader ret = createShader(path, bin.data(), bin.size());
+    if (ret != hwNullHandle) {
+        m_shader_paths.add(npath, 0, ret);
+        if (m_file_watching) { m_watcher.add(path); }
+        loadShaderVariants(*m_shaders.get(ret));
+    }
+    return ret;
+}
+
+// path: empty for shaders from memory
+hwHShader hwContext::createShader(const std::string &path, const void *data, size_t size)
+{
+    hwShaderData *v = m_shaders.alloc();
+    if (!v) {
+        hwLog("CreatePixelShader(%s) failed: out of shader handles.\n", path.c_str());
+        return hwNullHandle;
+    }
+    v->path = path;
+    if (createShaderShared(*v, data, size)) {
+        v->ref_count = 1;
+        updateShaderPrograms(*v);
+        hwLog("CreatePixelShader(%s) : %d succeeded.\n", path.c_str(), v->handle);
+        return v->handle;
     }
     else {
         hwLog("CreatePixelShader(%s) failed.\n", path.c_str());
+        m_shaders.free(v->handle);
     }
     return hwNullHandle;
 }
 
-void hwContext::shaderRelease(hwHShader hs)
+// takes the pixel shader of another shader with the same contents if there is one
+bool hwContext::createShaderShared(hwShaderData &v, const void *data, size_t size)
 {
-    if (hs >= m_shaders.size()) { return; }
+    v.legacy_constants = hwReadsLegacyConstants(data, size);
+    uint64_t key = hwHashContent(data, size);
+    auto it = m_shader_contents.find(key);
+    if (it != m_shader_contents.end() && it->second.size == size) {
+        auto &c = it->second;
+        ++c.ref_count;
+        v.shader = c.shader;
+        v.content_key = key;
+        ++m_dedup_hits;
+        m_dedup_bytes_saved += (int)size;
+        return true;
+    }
 
-    auto &v = m_shaders[hs];
-    if (v.ref_count > 0 && --v.ref_count == 0) {
-        v.shader->Release();
-        v.invalidate();
-        hwLog("shaderRelease(%d)\n", hs);
+    if ((v.shader = m_backend->createPixelShader(data, size)) == nullptr) { return false; }
+    v.content_key = key;
+    if (it == m_shader_contents.end()) {
+        m_shader_contents[key] = { v.shader, 1, size };
     }
+    return true;
 }
 
-void hwContext::shaderReload(hwHShader hs)
+void hwContext::releaseShaderContent(hwShaderData &v)
 {
-    if (hs >= m_shaders.size()) { return; }
+    if (!v.shader) { return; }
+
+    // a shader not in the table is the loser of a hash collision, and owns its pixel shader alone
+    auto it = m_shader_contents.find(v.content_key);
+    if (it != m_shader_contents.end() && it->second.shader == v.shader) {
+        auto &c = it->second;
+        if (--c.ref_count > 0) {
+            m_dedup_bytes_saved -= (int)c.size;
+        }
+        else {
+            retire(v.shader);
+            m_shader_contents.erase(it);
+        }
+    }
+    else {
+        retire(v.shader);
+    }
+    v.shader = nullptr;
+    v.content_key = 0;
+}
 
-    auto &v = m_shaders[hs];
-    // release existing shader
-    if (v.shader) {
-        v.shader->Release();
-        v.shader = nullptr;
+void hwContext::shaderRelease(hwHShader hs)
+{
+    if (m_capture.active()) { captureCall(hwECaptureRecord_ShaderRelease, hwCapHandle{ hs }); }
+    auto *v = m_shaders.get(hs);
+    if (!v) { return; }
+
+    if (v->ref_count > 0 && --v->ref_count == 0) {
+        releaseShaderVariants(*v);
+        releaseShaderContent(*v);
+        if (!v->path.empty()) { m_shader_paths.remove(hwPathRegistry::normalize(v->path)); }
+        m_shader_programs[hwHandleIndex(hs)] = hwShaderPrograms();
+        m_shader_programs_changed = true;
+        m_shaders.free(hs);
+        hwLog("shaderRelease(%d)\n", hs);
     }
+}
 
-    // reload
-    std::string bin;
-    if (!hwFileToString(bin, v.path.c_str())) {
-        hwLog("failed to reload shader (%s)\n", v.path.c_str());
+void hwContext::shaderReload(hwHShader hs)
+{
+    if (m_capture.active()) { captureCall(hwECaptureRecord_ShaderReload, hwCapHandle{ hs }); }
+    auto *v = m_shaders.get(hs);
+    if (!v) { return; }
+    if (v->path.empty()) {
+        hwLog("shaderReload(%d): loaded from memory. can't reload.\n", hs);
         return;
     }
-    if (SUCCEEDED(m_d3ddev->CreatePixelShader(&bin[0], bin.size(), nullptr, &v.shader))) {
-        hwLog("CreatePixelShader(%s) : %d reloaded.\n", v.path.c_str(), v.handle);
-    }
-    else {
-        hwLog("CreatePixelShader(%s) failed to reload.\n", v.path.c_str());
-    }
+    startShaderReload(*v);
 }
 
+// a reload started before this one is dropped: its read may have missed the latest write
+void hwContext::startShaderReload(hwShaderData &v)
+{
+    if (!v.reload_job) { m_reloading_shaders.push_back(v.handle); }
+    auto job = std::make_shared<hwAssetLoadJob>();
+    job->path = v.path;
+    v.reload_job = job;
+    m_workers.run([job]() { hwReadAssetFile(*job); });
+}
 
-hwAssetData& hwContext::newAssetData()
+void hwContext::swapShader(hwShaderData &v, hwAssetLoadJob &job)
 {
-    auto i = std::find_if(m_assets.begin(), m_assets.end(), [](const hwAssetData &v) { return !v; });
-    if (i != m_assets.end()) { return *i; }
+    if (job.state != hwAssetLoadJob::Read) {
+        hwLog("failed to reload shader (%s). keeps the loaded one.\n", v.path.c_str());
+        return;
+    }
+    if (v.shader && job.source_hash == v.content_key) { return; } // written with what it had
 
-    hwAssetData tmp;
-    tmp.handle = m_assets.size();
-    m_assets.push_back(tmp);
-    return m_assets.back();
+    hwShaderData next;
+    if (!createShaderShared(next, job.data, job.size)) {
+        hwLog("CreatePixelShader(%s) failed to reload. keeps the loaded one.\n", v.path.c_str());
+        return;
+    }
+    releaseShaderContent(v);
+    v.shader = next.shader;
+    v.content_key = next.content_key;
+    v.legacy_constants = next.legacy_constants;
+    hwLog("CreatePixelShader(%s) : %d reloaded.\n", v.path.c_str(), v.handle);
+    loadShaderVariants(v);
+    updateShaderPrograms(v);
 }
 
-hwHAsset hwContext::assetLoadFromFile(const std::string &path, const hwConversionSettings *_settings)
+static int hwCountBits(uint32_t v)
 {
-    hwConversionSettings settings;
-    if (_settings != nullptr) { settings = *_settings; }
+    int n = 0;
+    for (; v; v &= v - 1) { ++n; }
+    return n;
+}
 
-    {
-        auto i = std::find_if(m_assets.begin(), m_assets.end(),
-            [&](const hwAssetData &v) { return v.path == path && v.settings==settings; });
-        if (i != m_assets.end() && i->ref_count > 0) {
-            ++i->ref_count;
-            return i->aid;
+// hwEShaderFeature bits of the variants Shaders/DefaultHairShader_fXX.hlsl build. only these are looked for
+static const uint32_t hwShaderVariantFiles[hwNumShaderVariantFiles] = { 0x01, 0x09, 0x0b, 0x0f, 0x19, 0x29, 0x49, 0x69 };
+
+// the variants of a shader loaded from "name.cso" are "name_fXX.cso" next to it, XX the hwEShaderFeature bits they
+// have in hex, for the XX of hwShaderVariantFiles. any of them may be missing: what no variant covers is
+// drawn with the shader itself, which is expected to be the uber shader. replaces the variants v had.
+void hwContext::loadShaderVariants(hwShaderData &v)
+{
+    std::string stem = v.path;
+    size_t dot = stem.find_last_of('.');
+    if (dot != std::string::npos && stem.find_first_of("/\\", dot) == std::string::npos) { stem.resize(dot); }
+
+    ID3D11PixelShader *found[hwNumShaderVariants] = {};
+    std::vector<ID3D11PixelShader*> created;
+    for (uint32_t f : hwShaderVariantFiles) {
+        char suffix[16];
+        sprintf(suffix, "_f%02x.cso", f);
+        std::string path = stem + suffix;
+        hwMappedFile bin;
+        if (!bin.open(path.c_str())) { continue; }
+        if (hwReadsLegacyConstants(bin.data(), bin.size())) {
+            // draws bind hwLegacyConstantBuffer only for the shader itself
+            hwLog("CreatePixelShader(%s) skipped: built before the constants were split.\n", path.c_str());
+            continue;
+        }
+        if ((found[f] = m_backend->createPixelShader(bin.data(), bin.size())) != nullptr) {
+            created.push_back(found[f]);
+        }
+        else {
+            hwLog("CreatePixelShader(%s) failed.\n", path.c_str());
         }
     }
 
-    hwAssetData& v = newAssetData();
-    v.settings = settings;
-    v.path = path;
-	NvCo::StdCFileReadStream stream(path.c_str());
-	if (NV_SUCCEEDED(g_hw_sdk->loadAsset(&stream, v.aid, nullptr, &settings))) {
-        v.ref_count = 1;
-
-        hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") : %d succeeded.\n", path.c_str(), v.handle);
-        return v.handle;
+    // (g + 1) | f steps through the supersets of f in increasing order
+    ID3D11PixelShader *variants[hwNumShaderVariants] = {};
+    for (int f = 0; f < hwEShaderFeature_All; ++f) {
+        int best = hwCountBits(hwEShaderFeature_All);
+        for (int g = f; g < hwEShaderFeature_All; g = (g + 1) | f) {
+            if (found[g] && hwCountBits(g) < best) {
+                variants[f] = found[g];
+                best = hwCountBits(g);
+            }
+        }
     }
-    else {
-        hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") failed.\n", path.c_str());
+
+    // the render thread may be drawing with the old ones: they are retired, and released once it has passed this frame
+    std::vector<ID3D11PixelShader*> old;
+    old.swap(v.variant_shaders);
+    std::copy(variants, variants + hwNumShaderVariants, v.variants);
+    v.variant_shaders = std::move(created);
+    v.has_variants = !v.variant_shaders.empty();
+    for (auto *ps : old) { retire(ps); }
+    updateShaderPrograms(v);
+    m_shader_variants += (int)v.variant_shaders.size() - (int)old.size();
+    if (!v.variant_shaders.empty()) {
+        hwLog("CreatePixelShader(%s) : %d variants.\n", v.path.c_str(), (int)v.variant_shaders.size());
     }
-    return hwNullHandle;
 }
 
-void hwContext::assetRelease(hwHAsset ha)
+void hwContext::releaseShaderVariants(hwShaderData &v)
 {
-	if (ha >= m_assets.size()) { return; }
-
-	auto &v = m_assets[ha];
-	if (v.ref_count > 0 && --v.ref_count == 0) {
-		g_hw_sdk->freeAsset(v.aid);
-		v.invalidate();
-	}
+    std::fill(v.variants, v.variants + hwNumShaderVariants, nullptr);
+    v.has_variants = false;
+    for (auto *ps : v.variant_shaders) { retire(ps); }
+    m_shader_variants -= (int)v.variant_shaders.size();
+    v.variant_shaders.clear();
+    updateShaderPrograms(v);
 }
 
-void hwContext::assetReload(hwHAsset ha)
+void hwContext::updateShaderPrograms(const hwShaderData &v)
 {
-    if (ha >= m_assets.size()) { return; }
+    uint32_t i = hwHandleIndex(v.handle);
+    if (i >= m_shader_programs.size()) { m_shader_programs.resize(i + 1); }
+    auto &p = m_shader_programs[i];
+    p.handle = v.handle;
+    p.shader = v.shader;
+    std::copy(v.variants, v.variants + hwNumShaderVariants, p.variants);
+    p.has_variants = v.has_variants;
+    p.legacy_constants = v.legacy_constants;
+    m_shader_programs_changed = true;
+}
 
-    auto &v = m_assets[ha];
-    // release existing asset
-	g_hw_sdk->freeAsset(v.aid);
-	v.aid = hwNullAssetID;
 
-	// reload
-	NvCo::StdCFileReadStream stream(v.path.c_str());
-	if (NV_SUCCEEDED(g_hw_sdk->loadAsset(&stream, v.aid, nullptr, &v.settings))) {
-        hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") : %d reloaded.\n", v.path.c_str(), v.handle);
-    }
-    else {
-        hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") failed to reload.\n", v.path.c_str());
+hwHAsset hwContext::assetLoadFromFile(const std::string &path, const hwConversionSettings *_settings)
+{
+    hwConversionSettings settings;
+    if (_settings != nullptr) { settings = *_settings; }
+
+    hwHAsset ret = loadAsset(path, settings);
+    if (m_capture.active()) {
+        hwCapAssetLoad r = { ret, settings };
+        captureCall(hwECaptureRecord_AssetLoad, r, path.data(), path.size());
     }
+    return ret;
 }
 
-int hwContext::assetGetNumBones(hwHAsset ha) const
+hwHAsset hwContext::assetLoadFromFileAsync(const std::string &path, const hwConversionSettings *_settings, hwAssetLoadCallback cb, void *userdata)
 {
-	if (ha >= m_assets.size()) { return 0; }
+    hwConversionSettings settings;
+    if (_settings != nullptr) { settings = *_settings; }
+
+    hwHAsset ret = loadAsset(path, settings, true);
+    // replayed as a synchronous load
+    if (m_capture.active()) {
+        hwCapAssetLoad r = { ret, settings };
+        captureCall(hwECaptureRecord_AssetLoad, r, path.data(), path.size());
+    }
 
-	return g_hw_sdk->getNumBones(m_assets[ha].aid);
+    if (cb) {
+        auto *v = m_assets.get(ret);
+        if (!v) {
+            cb(ret, hwEAssetStatus_Failed, userdata);
+        }
+        else if (v->status == hwEAssetStatus_Loading) {
+            v->waiters.push_back({ cb, userdata });
+        }
+        else {
+            cb(ret, v->status, userdata);
+        }
+    }
+    return ret;
 }
 
-const char* hwContext::assetGetBoneName(hwHAsset ha, int nth) const
+hwHAsset hwContext::assetLoadFromMemory(const void *data, size_t size, const hwConversionSettings *_settings)
 {
-    static char tmp[256];
-    if (ha >= m_assets.size()) { tmp[0] = '\0'; return tmp; }
+    hwConversionSettings settings;
+    if (_settings != nullptr) { settings = *_settings; }
 
-	if (!NV_SUCCEEDED(g_hw_sdk->getBoneName(m_assets[ha].aid, nth, tmp))) {
-        hwLog("GFSDK_HairSDK::GetBoneName(%d) failed.\n", ha);
+    hwHAsset ret = loadAssetFromMemory(data, size, settings);
+    if (m_capture.active()) {
+        hwCapAssetLoad r = { ret, settings };
+        captureCall(hwECaptureRecord_AssetLoadFromMemory, r, data, size);
     }
-    return tmp;
+    return ret;
 }
 
-void hwContext::assetGetBoneIndices(hwHAsset ha, hwFloat4 &o_indices) const
+hwEAssetStatus hwContext::assetGetStatus(hwHAsset ha)
 {
-    if (ha >= m_assets.size()) { return; }
+    collectAssetLoads();
+    auto *v = m_assets.get(ha);
+    return v ? v->status : hwEAssetStatus_Invalid;
+}
 
-	if (!NV_SUCCEEDED(g_hw_sdk->getBoneIndices(m_assets[ha].aid, &o_indices))) {
-        hwLog("GFSDK_HairSDK::GetBoneIndices(%d) failed.\n", ha);
+// data: the APX file. desc: the default instance descriptor the SDK made of it
+static bool hwCookToCache(const hwAssetCache &cache, hwWorkerPool *workers, const std::string &path, uint64_t tag, const char *data, size_t data_size, const hwHairDescriptor &desc)
+{
+    // stamped with the mtime of now. if the file has been changed since data was read, it is likely to have another size
+    uint64_t mtime, size;
+    if (!hwAssetCache::getFileInfo(path, mtime, size) || size != data_size) { return false; }
+
+    hwApxAsset apx;
+    if (!hwApxRead(data, data_size, apx, workers)) {
+        hwLog("hwCookAsset(\"%s\") failed: can't read the HairAssetDescriptor.\n", path.c_str());
+        return false;
     }
+    hwApxSectionHashes sections;
+    hwApxHashSections(data, data_size, sections);
+    std::string cooked;
+    hwCookAsset(apx, &desc, hwHashContent(data, data_size), sections.geometry, mtime, size, cooked);
+    return cache.store(path, tag, cooked);
 }
 
-void hwContext::assetGetBoneWeights(hwHAsset ha, hwFloat4 &o_weight) const
+hwHAsset hwContext::loadAsset(const std::string &path, const hwConversionSettings &settings, bool async)
 {
-    if (ha >= m_assets.size()) { return; }
+    std::string npath = hwPathRegistry::normalize(path);
+    uint64_t settings_hash = hwHashSettings(settings);
+    if (auto *i = m_assets.get(m_asset_paths.find(npath, settings_hash))) {
+        hwHAsset ha = i->handle;
+        ++i->ref_count;
+        // synchronous loads return loaded assets. the reference keeps it alive through the waiters' callbacks
+        if (!async && i->status == hwEAssetStatus_Loading) {
+            finishAssetLoad(*i);
+            m_loading_assets.erase(std::remove(m_loading_assets.begin(), m_loading_assets.end(), ha), m_loading_assets.end());
+            i = m_assets.get(ha);
+            if (i->status != hwEAssetStatus_Ready) {
+                releaseAsset(ha);
+                return hwNullHandle;
+            }
+        }
+        return ha;
+    }
 
-	if (!NV_SUCCEEDED(g_hw_sdk->getBoneWeights(m_assets[ha].aid, &o_weight))) {
-        hwLog("GFSDK_HairSDK::GetBoneWeights(%d) failed.\n", ha);
+    hwAssetData *v = m_assets.alloc();
+    if (!v) {
+        hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") failed: out of asset handles.\n", path.c_str());
+        return hwNullHandle;
+    }
+    v->settings = settings;
+    v->path = path;
+
+    v->ref_count = 1;
+    v->status = hwEAssetStatus_Loading;
+    v->job = std::make_shared<hwAssetLoadJob>();
+    v->job->path = path;
+    v->job->cache_tag = settings_hash;
+    v->job->cache = m_asset_cache;
+    m_asset_paths.add(npath, settings_hash, v->handle);
+    if (m_file_watching) { m_watcher.add(path); }
+
+    // the file is loaded or loading with other settings already: made of the parsed source of that rather than the file
+    auto &entry = m_asset_sources[npath];
+    auto source = entry.lock();
+    if (!source) {
+        source = std::make_shared<hwAssetSource>();
+        entry = source;
+        v->job->build_source = true;
+    }
+    v->source = v->job->source = source;
+
+    if (async) {
+        m_loading_assets.push_back(v->handle);
+        auto job = v->job;
+        auto workers = &m_workers;
+        m_workers.run([job, workers]() { hwReadAssetFile(*job, workers); });
+        return v->handle;
+    }
+
+    finishAssetLoad(*v);
+    if (v->status != hwEAssetStatus_Ready) {
+        hwHAsset ha = v->handle;
+        m_assets.free(ha);
+        return hwNullHandle;
     }
+    return v->handle;
 }
 
-void hwContext::assetGetBindPose(hwHAsset ha, int nth, hwMatrix &o_mat)
+hwHAsset hwContext::loadAssetFromMemory(const void *data, size_t size, const hwConversionSettings &settings)
 {
-    if (ha >= m_assets.size()) { return; }
-
-	if (!NV_SUCCEEDED(g_hw_sdk->getBindPose(m_assets[ha].aid, nth, &o_mat))) {
-        hwLog("GFSDK_HairSDK::GetBindPose(%d, %d) failed.\n", ha, nth);
+    hwAssetData *v = m_assets.alloc();
+    if (!v) {
+        hwLog("GFSDK_HairSDK::LoadHairAssetFromMemory() failed: out of asset handles.\n");
+        return hwNullHandle;
     }
+    v->settings = settings;
+    v->ref_count = 1;
+    v->status = hwEAssetStatus_Loading;
+    v->job = std::make_shared<hwAssetLoadJob>();
+    v->job->data = (const char*)data;
+    v->job->size = size;
+    v->job->cache_tag = hwHashSettings(settings);
+    hwCookedAsset c;
+    v->job->cooked = hwReadCookedAsset(data, size, c);
+    hwHashSource(*v->job);
+    v->job->state = hwAssetLoadJob::Read;
+
+    finishAssetLoad(*v);
+    if (v->status != hwEAssetStatus_Ready) {
+        hwHAsset ha = v->handle;
+        m_assets.free(ha);
+        return hwNullHandle;
+    }
+    return v->handle;
 }
 
-void hwContext::assetGetDefaultDescriptor(hwHAsset ha, hwHairDescriptor &o_desc) const
+// assets whose file has been read are created, and their waiters called. game thread only.
+void hwContext::collectAssetLoads()
 {
-    if (ha >= m_assets.size()) { return; }
-
-	if (!NV_SUCCEEDED(g_hw_sdk->getInstanceDescriptorFromAsset(m_assets[ha].aid, o_desc))) {
-        hwLog("GFSDK_HairSDK::CopyInstanceDescriptorFromAsset(%d) failed.\n", ha);
+    // callbacks may start new loads
+    std::vector<hwHAsset> loading;
+    loading.swap(m_loading_assets);
+    for (hwHAsset ha : loading) {
+        auto *v = m_assets.get(ha);
+        if (!v || v->status != hwEAssetStatus_Loading) { continue; } // released or finished meanwhile
+
+        int state = v->job->state;
+        if (state == hwAssetLoadJob::Read || state == hwAssetLoadJob::Failed) {
+            finishAssetLoad(*v);
+        }
+        else {
+            m_loading_assets.push_back(ha);
+        }
     }
 }
 
-hwInstanceData& hwContext::newInstanceData()
+// the SDK parses and creates the GPU resources in one call, so that part runs here rather than on the workers
+void hwContext::finishAssetLoad(hwAssetData &v)
 {
-    auto i = std::find_if(m_instances.begin(), m_instances.end(), [](const hwInstanceData &v) { return !v; });
-    if (i != m_instances.end()) { return *i; }
+    auto &job = *v.job;
+    hwReadAssetFile(job, &m_workers); // if no worker has started it yet
+    while (job.state == hwAssetLoadJob::Reading) { std::this_thread::yield(); }
+
+    if (job.state == hwAssetLoadJob::Read) {
+        if (createAssetShared(v, job)) {
+            v.status = hwEAssetStatus_Ready;
+            hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") : %d succeeded%s.\n", v.path.c_str(), v.handle,
+                !job.cooked ? "" : job.file ? " (cooked)" : " (from the parsed source)");
+        }
+        else {
+            v.status = hwEAssetStatus_Failed;
+            hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") failed.\n", v.path.c_str());
+        }
+    }
+    else {
+        v.status = hwEAssetStatus_Failed;
+        hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") failed: can't read the file.\n", v.path.c_str());
+    }
+    v.job.reset();
+
+    hwHAsset ha = v.handle;
+    if (v.status == hwEAssetStatus_Ready) {
+        registerAssetSource(v);
+        m_instances.each([&](hwInstanceData &i) {
+            if (i.hasset == ha && !i && !createInstanceSDK(i, v)) {
+                hwLog("GFSDK_HairSDK::CreateHairInstance(%d) failed.\n", ha);
+            }
+        });
+    }
+    else if (!v.path.empty()) {
+        // later loads of the same file try again
+        m_asset_paths.remove(hwPathRegistry::normalize(v.path), hwHashSettings(v.settings));
+    }
 
-    hwInstanceData tmp;
-    tmp.handle = m_instances.size();
-    m_instances.push_back(tmp);
-    return m_instances.back();
+    // a callback may release the asset: v is not touched after this
+    auto waiters = std::move(v.waiters);
+    hwEAssetStatus status = v.status;
+    for (auto &w : waiters) { w.cb(ha, status, w.userdata); }
 }
 
-hwHInstance hwContext::instanceCreate(hwHAsset ha)
+// shadow flags of the descriptor, and its hash so that setting the same descriptor again can be skipped.
+// the hash covers the raw bytes, padding included: a descriptor that differs only in padding is sent again, which is harmless.
+static void hwStoreDescriptor(hwInstanceStore &store, uint32_t i, const hwHairDescriptor &desc)
 {
-	if (ha >= m_assets.size()) { return hwNullHandle; }
-
-	hwInstanceData& v = newInstanceData();
-	v.hasset = ha;
-	if (NV_SUCCEEDED(g_hw_sdk->createInstance(m_assets[ha].aid, v.iid))) {
-		hwLog("GFSDK_HairSDK::CreateHairInstance(%d) : %d succeeded.\n", ha, v.handle);
-	}
-	else
-	{
-		hwLog("GFSDK_HairSDK::CreateHairInstance(%d) failed.\n", ha);
-	}
-	return v.handle;
+    uint32_t f = store.flags[i] & ~(hwEInstanceFlag_CastShadow | hwEInstanceFlag_ReceiveShadow | hwEInstanceFlag_Glint);
+    if (desc.m_castShadows) { f |= hwEInstanceFlag_CastShadow; }
+    if (desc.m_receiveShadows) { f |= hwEInstanceFlag_ReceiveShadow; }
+    if (desc.m_glintStrength > 0.0f) { f |= hwEInstanceFlag_Glint; }
+    if (store.flags[i] != f) {
+        store.flags[i] = f;
+        store.changed = true;
+    }
+    store.descriptor_hashes[i] = hwHash64(&desc, sizeof(desc));
 }
 
-void hwContext::instanceRelease(hwHInstance hi)
+// the first asset made of the source's contents gives it its default descriptor. an asset reloaded with other
+// contents lets its source go, and the file's entry with it: the next load of the file builds a new one.
+// sources live as long as an asset holds them: m_asset_sources only points to them.
+void hwContext::registerAssetSource(hwAssetData &v)
 {
-    if (hi >= m_instances.size()) { return; }
-    auto &v = m_instances[hi];
+    auto source = v.source;
+    if (!source) { return; }
 
-	if (NV_SUCCEEDED(g_hw_sdk->freeInstance(v.iid))) {
-        hwLog("GFSDK_HairSDK::FreeHairInstance(%d) succeeded.\n", hi);
+    bool built;
+    uint64_t source_hash;
+    {
+        std::lock_guard<std::mutex> lock(source->mutex);
+        built = source->built;
+        source_hash = source->source_hash;
     }
-    else {
-        hwLog("GFSDK_HairSDK::FreeHairInstance(%d) failed.\n", hi);
+    if (!built) { return; } // its first load is still reading the file. that one gives it the descriptor
+    if (source_hash != v.source_hash) {
+        v.source.reset();
+        auto it = m_asset_sources.find(hwPathRegistry::normalize(v.path));
+        if (it != m_asset_sources.end() && it->second.lock() == source) { m_asset_sources.erase(it); }
+        return;
+    }
+    if (!source->has_desc) {
+        if (v.has_default_desc) { source->desc = v.default_desc; }
+        else if (!NV_SUCCEEDED(m_backend->getInstanceDescriptorFromAsset(v.aid, source->desc))) { return; }
+        source->has_desc = true;
     }
-    v.invalidate();
 }
 
-void hwContext::instanceGetBounds(hwHInstance hi, hwFloat3 &o_min, hwFloat3 &o_max) const
+static uint64_t hwAssetContentKey(const hwAssetLoadJob &job)
 {
-    if (hi >= m_instances.size()) { return; }
-    auto &v = m_instances[hi];
+    return hwHashContent(&job.source_hash, sizeof(job.source_hash), job.cache_tag);
+}
 
-	if (!NV_SUCCEEDED(g_hw_sdk->getBounds(v.iid, o_min, o_max, false)))
-	{
-        hwLog("GFSDK_HairSDK::GetBounds(%d) failed.\n", hi);
+// takes the SDK asset of another asset with the same contents and settings if there is one, creates it otherwise.
+// the file has been read either way: what sharing saves is the SDK's parse and the GPU copy.
+bool hwContext::createAssetShared(hwAssetData &v, hwAssetLoadJob &job)
+{
+    uint64_t key = hwAssetContentKey(job);
+    auto it = m_asset_contents.find(key);
+    if (it != m_asset_contents.end() && it->second.size == job.source_size) {
+        auto &c = it->second;
+        ++c.ref_count;
+        v.aid = c.aid;
+        v.has_default_desc = c.has_default_desc;
+        v.default_desc = c.default_desc;
+        v.content_key = key;
+        v.source_hash = job.source_hash;
+        v.geometry_hash = job.geometry_hash;
+        ++m_dedup_hits;
+        m_dedup_bytes_saved += (int)c.size;
+        return true;
     }
+
+    if (!createAssetSDK(v, job)) { return false; }
+    v.content_key = key;
+    v.source_hash = job.source_hash;
+    v.geometry_hash = job.geometry_hash;
+    if (it == m_asset_contents.end()) {
+        m_asset_contents[key] = { v.aid, 1, job.source_size, v.has_default_desc, v.default_desc };
+    }
+    return true;
 }
 
-void hwContext::instanceGetDescriptor(hwHInstance hi, hwHairDescriptor &desc) const
+void hwContext::releaseAssetContent(hwAssetData &v)
 {
-    if (hi >= m_instances.size()) { return; }
-    auto &v = m_instances[hi];
-
-	if (!NV_SUCCEEDED(g_hw_sdk->getInstanceDescriptor(v.iid, desc)))
-	{
-        hwLog("GFSDK_HairSDK::CopyCurrentInstanceDescriptor(%d) failed.\n", hi);
+    if (v.aid == hwNullAssetID) { return; }
+
+    // an asset not in the table is the loser of a hash collision, and owns its SDK asset alone
+    auto it = m_asset_contents.find(v.content_key);
+    if (it != m_asset_contents.end() && it->second.aid == v.aid) {
+        auto &c = it->second;
+        if (--c.ref_count > 0) {
+            m_dedup_bytes_saved -= (int)c.size;
+        }
+        else {
+            retireAsset(v.aid);
+            m_asset_contents.erase(it);
+        }
+    }
+    else {
+        retireAsset(v.aid);
     }
+    v.aid = hwNullAssetID;
+    v.content_key = 0;
 }
 
-void hwContext::instanceSetDescriptor(hwHInstance hi, const hwHairDescriptor &desc)
+// from the cooked asset if job has one and it is usable, from the APX otherwise. the APX is cooked by a worker then.
+bool hwContext::createAssetSDK(hwAssetData &v, hwAssetLoadJob &job)
 {
-    if (hi >= m_instances.size()) { return; }
-    auto &v = m_instances[hi];
+    if (job.cooked) {
+        hwCookedAsset c;
+        const hwHairDescriptor *desc = nullptr;
+        if (hwReadCookedAsset(job.data, job.size, c) && !(desc = hwGetCookedDescriptor(c)) && job.source && job.source->has_desc) {
+            desc = &job.source->desc;
+        }
+        if (desc) {
+            hwAssetDescriptor ad;
+            hwMakeAssetDescriptor(c, ad);
+            if (NV_SUCCEEDED(m_backend->createAsset(ad, v.aid, v.settings))) {
+                v.default_desc = *desc;
+                v.has_default_desc = true;
+                return true;
+            }
+        }
+        // cooked with another SDK, or something the SDK doesn't take. cooked again below
+        job.cooked = false;
+        auto file = std::make_shared<hwMappedFile>();
+        if (v.path.empty() || !file->open(job.path.c_str())) { return false; }
+        job.file = file;
+        job.data = file->data();
+        job.size = file->size();
+    }
 
-	if (!NV_SUCCEEDED(g_hw_sdk->updateInstanceDescriptor(v.iid, desc)))
-	{
-        hwLog("GFSDK_HairSDK::UpdateInstanceDescriptor(%d) failed.\n", hi);
+    hwMemoryReadStream stream(job.data, job.size);
+    if (!NV_SUCCEEDED(m_backend->loadAsset(&stream, v.aid, v.settings))) { return false; }
+    v.has_default_desc = false;
+
+    // assets from memory have no file to cook
+    hwHairDescriptor desc;
+    if (m_asset_cache.enabled() && job.file && NV_SUCCEEDED(m_backend->getInstanceDescriptorFromAsset(v.aid, desc))) {
+        auto cache = m_asset_cache;
+        auto path = v.path;
+        auto tag = job.cache_tag;
+        auto file = job.file; // stays mapped until the worker is done with it
+        auto workers = &m_workers;
+        m_workers.run([cache, workers, path, tag, file, desc]() { hwCookToCache(cache, workers, path, tag, file->data(), file->size(), desc); });
     }
+    return true;
 }
 
-void hwContext::instanceSetTexture(hwHInstance hi, hwTextureType type, hwTexture *tex)
+void hwContext::setAssetCacheDirectory(const std::string &dir)
 {
-	if (hi >= m_instances.size()) { return; }
-	auto &v = m_instances[hi];
+    m_asset_cache.setDirectory(dir);
+}
 
-	if (!tex)
-	{
-		if (!NV_SUCCEEDED(g_hw_sdk->setTexture(v.iid, type, nvidia::Common::ApiHandle::getNull())))
-		{
-			hwLog("GFSDK_HairSDK::SetTextureSRV(%d, %d) failed.\n", hi, type);
-		}
+bool hwContext::assetCook(const std::string &path, const hwConversionSettings *_settings)
+{
+    if (!m_asset_cache.enabled()) {
+        hwLog("hwAssetCook(\"%s\") failed: no cache directory.\n", path.c_str());
+        return false;
+    }
+    hwConversionSettings settings;
+    if (_settings != nullptr) { settings = *_settings; }
 
-		return;
-	}
+    hwMappedFile data;
+    if (!data.open(path.c_str())) {
+        hwLog("hwAssetCook(\"%s\") failed: can't read the file.\n", path.c_str());
+        return false;
+    }
 
-	D3D11_TEXTURE2D_DESC texDesc;
-	tex->GetDesc(&texDesc);
-	ID3D11ShaderResourceView* srv;
-	D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc;
-	ZeroMemory(&SRVDesc, sizeof(SRVDesc));
-	SRVDesc.Format = texDesc.Format;
-	SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	SRVDesc.Texture2D.MostDetailedMip = 0;
-	SRVDesc.Texture2D.MipLevels = texDesc.MipLevels;
-	m_d3ddev->CreateShaderResourceView(tex, &SRVDesc, &srv);
+    // the default instance descriptor is the SDK's reading of the file
+    hwAssetID aid = hwNullAssetID;
+    hwHairDescriptor desc;
+    hwMemoryReadStream stream(data.data(), data.size());
+    bool ok = NV_SUCCEEDED(m_backend->loadAsset(&stream, aid, settings)) && NV_SUCCEEDED(m_backend->getInstanceDescriptorFromAsset(aid, desc));
+    if (aid != hwNullAssetID) { m_backend->freeAsset(aid); }
+    if (!ok) {
+        hwLog("hwAssetCook(\"%s\") failed: the SDK can't load it.\n", path.c_str());
+        return false;
+    }
+    return hwCookToCache(m_asset_cache, &m_workers, path, hwHashSettings(settings), data.data(), data.size(), desc);
+}
 
-	if (!srv || !NV_SUCCEEDED(g_hw_sdk->setTexture(v.iid, type, nvidia::Common::Dx11Type::wrap(srv))))
-	{
-		hwLog("GFSDK_HairSDK::SetTextureSRV(%d, %d) failed.\n", hi, type);
-	}
+void hwContext::assetRelease(hwHAsset ha)
+{
+	if (m_capture.active()) { captureCall(hwECaptureRecord_AssetRelease, hwCapHandle{ ha }); }
+	releaseAsset(ha);
 }
 
-void hwContext::setShadowTexture(ID3D11Resource *shadowTex)
+void hwContext::releaseAsset(hwHAsset ha)
 {
-	if (shadowSRV)
-	{
-		shadowSRV->Release();
-		shadowSRV = nullptr;
+	auto *v = m_assets.get(ha);
+	if (!v) { return; }
+
+	if (v->ref_count > 0 && --v->ref_count == 0) {
+		releaseAssetContent(*v);
+		// a failed load has already given its path up, maybe to another load
+		std::string npath = hwPathRegistry::normalize(v->path);
+		uint64_t settings_hash = hwHashSettings(v->settings);
+		if (m_asset_paths.find(npath, settings_hash) == ha) {
+			m_asset_paths.remove(npath, settings_hash);
+		}
+		m_assets.free(ha); // a worker still reading the file keeps the job alive
+		auto source = m_asset_sources.find(npath);
+		if (source != m_asset_sources.end() && source->second.expired()) {
+			m_asset_sources.erase(source);
+		}
 	}
+}
 
-	if (!shadowTex)
-	{
-		return;
-	}
+void hwContext::assetReload(hwHAsset ha)
+{
+    if (m_capture.active()) { captureCall(hwECaptureRecord_AssetReload, hwCapHandle{ ha }); }
+    auto *v = m_assets.get(ha);
+    if (!v || v->status == hwEAssetStatus_Loading) { return; }
+    if (v->path.empty()) {
+        hwLog("assetReload(%d): loaded from memory. can't reload.\n", ha);
+        return;
+    }
 
-	D3D11_TEXTURE2D_DESC texDesc;
+    startAssetReload(*v);
+}
 
-	shadowTex->QueryInterface(&shadowTexture);
+// the cache only has the file's cooked asset if it is up to date.
+// a reload started before this one is dropped: its read may have missed the latest write
+void hwContext::startAssetReload(hwAssetData &v)
+{
+    if (!v.reload_job) { m_reloading_assets.push_back(v.handle); }
+    auto job = std::make_shared<hwAssetLoadJob>();
+    job->path = v.path;
+    job->cache_tag = hwHashSettings(v.settings);
+    job->cache = m_asset_cache;
+    v.reload_job = job;
+    m_workers.run([job]() { hwReadAssetFile(*job); });
+}
 
-	shadowTexture->GetDesc(&texDesc);
-	
-	D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc;
-	ZeroMemory(&SRVDesc, sizeof(SRVDesc));
-	SRVDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	SRVDesc.Texture2D.MostDetailedMip = 0;
-	SRVDesc.Texture2D.MipLevels = 1;
-	HRESULT hr = m_d3ddev->CreateShaderResourceView(shadowTexture, &SRVDesc, &shadowSRV);
+// the new SDK asset and all the instances of v are created against it before anything of v is released,
+// so v and its instances are left as they were if any of it fails
+void hwContext::swapAsset(hwAssetData &v, hwAssetLoadJob &job)
+{
+    if (job.state != hwAssetLoadJob::Read) {
+        hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") failed to reload: can't read the file. keeps the loaded one.\n", v.path.c_str());
+        return;
+    }
+    if (v.aid != hwNullAssetID && job.source_hash == v.source_hash) { return; } // written with what it had
+    if (v.aid != hwNullAssetID && job.geometry_hash != 0 && job.geometry_hash == v.geometry_hash && swapAssetMaterial(v, job)) { return; }
+
+    hwAssetData next;
+    next.path = v.path;
+    next.settings = v.settings;
+    if (!createAssetShared(next, job)) {
+        hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") failed to reload. keeps the loaded one.\n", v.path.c_str());
+        return;
+    }
 
-	if (!SUCCEEDED(hr))
-	{
-		hwLog("Create Shadow SRV Failed!");
-	}
+    std::vector<hwInstanceData*> instances;
+    std::vector<hwInstanceID> iids;
+    m_instances.each([&](hwInstanceData &i) {
+        if (i.hasset == v.handle && i) { instances.push_back(&i); }
+    });
+    for (size_t n = 0; n < instances.size(); ++n) {
+        hwInstanceID iid = hwNullInstanceID;
+        if (!NV_SUCCEEDED(m_backend->createInstance(next.aid, iid))) { break; }
+        iids.push_back(iid);
+    }
+    if (iids.size() != instances.size()) {
+        for (auto iid : iids) { m_backend->freeInstance(iid); }
+        releaseAssetContent(next);
+        hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") failed to reload: can't create its instances. keeps the loaded one.\n", v.path.c_str());
+        return;
+    }
+
+    hwAssetData prev;
+    prev.aid = v.aid;
+    prev.content_key = v.content_key;
+    v.aid = next.aid;
+    v.content_key = next.content_key;
+    v.has_default_desc = next.has_default_desc;
+    v.default_desc = next.default_desc;
+    v.source_hash = next.source_hash;
+    v.geometry_hash = next.geometry_hash;
+    if (v.status == hwEAssetStatus_Failed) {
+        // the failed load gave its path up. loads of it share this asset again, unless one has taken it meanwhile
+        std::string npath = hwPathRegistry::normalize(v.path);
+        uint64_t settings_hash = hwHashSettings(v.settings);
+        if (!m_assets.get(m_asset_paths.find(npath, settings_hash))) { m_asset_paths.add(npath, settings_hash, v.handle); }
+    }
+    v.status = hwEAssetStatus_Ready;
+    ++v.revision;
+    for (size_t n = 0; n < instances.size(); ++n) {
+        auto &i = *instances[n];
+        i.has_pending_desc = NV_SUCCEEDED(m_backend->getInstanceDescriptor(i.iid, i.pending_desc));
+        retireInstance(i.iid);
+        i.iid = iids[n];
+        initInstanceSDK(i, v);
+    }
+    // instances of an asset whose load failed are waiting for it
+    m_instances.each([&](hwInstanceData &i) {
+        if (i.hasset == v.handle && !i && !createInstanceSDK(i, v)) {
+            hwLog("GFSDK_HairSDK::CreateHairInstance(%d) failed.\n", v.handle);
+        }
+    });
+    releaseAssetContent(prev);
+    hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") : %d reloaded%s.\n", v.path.c_str(), v.handle, job.cooked ? " (cooked)" : "");
 }
 
-void hwContext::instanceUpdateSkinningMatrices(hwHInstance hi, int num_bones, hwMatrix *matrices)
+// the SDK asset stays: only the fields the APX has values for are taken from the new material, into the default
+// descriptor and into the descriptor of each instance. what instances have been given beyond those (transform, LOD etc.)
+// is kept. false if the new material can't be read, which makes it a full reload.
+bool hwContext::swapAssetMaterial(hwAssetData &v, hwAssetLoadJob &job)
 {
-	if (matrices == nullptr) { return; }
-	if (hi >= m_instances.size()) { return; }
-	auto &v = m_instances[hi];
+    hwHairDescriptor material;
+    hwCookedAsset c;
+    const hwHairDescriptor *cooked_desc = nullptr;
+    std::vector<hwHairDescriptor> materials;
+    if (job.cooked && hwReadCookedAsset(job.data, job.size, c) && (cooked_desc = hwGetCookedDescriptor(c))) {
+        material = *cooked_desc;
+    }
+    else if (!job.cooked && hwApxReadMaterials(job.data, job.size, materials) && !materials.empty()) {
+        material = materials[0];
+    }
+    else {
+        return false;
+    }
 
-	if (!NV_SUCCEEDED(g_hw_sdk->updateSkinningMatrices(v.iid, num_bones, matrices)))
-	{
-		hwLog("GFSDK_HairSDK::UpdateSkinningMatrices(%d) failed.\n", hi);
-	}
+    hwHairDescriptor desc;
+    if (v.has_default_desc) {
+        desc = v.default_desc;
+    }
+    else if (!NV_SUCCEEDED(m_backend->getInstanceDescriptorFromAsset(v.aid, desc))) {
+        return false;
+    }
+    hwApxCopyMaterial(material, desc);
+    v.default_desc = desc;
+    v.has_default_desc = true;
+    v.source_hash = job.source_hash;
+
+    hwHAsset ha = v.handle;
+    m_instances.each([&](hwInstanceData &i) {
+        if (i.hasset != ha) { return; }
+        if (!i) {
+            if (i.has_pending_desc) { hwApxCopyMaterial(material, i.pending_desc); }
+            return;
+        }
+        hwHairDescriptor idesc;
+        if (!NV_SUCCEEDED(m_backend->getInstanceDescriptor(i.iid, idesc))) { return; }
+        hwApxCopyMaterial(material, idesc);
+        if (NV_SUCCEEDED(m_backend->updateInstanceDescriptor(i.iid, idesc))) {
+            hwStoreDescriptor(m_instance_store, i.index, idesc);
+        }
+        else {
+            hwLog("GFSDK_HairSDK::UpdateInstanceDescriptor(%d) failed.\n", i.handle);
+        }
+    });
+    ++v.revision;
+    hwLog("GFSDK_HairSDK::LoadHairAssetFromFile(\"%s\") : %d reloaded (materials only).\n", v.path.c_str(), v.handle);
+    return true;
 }
 
-void hwContext::instanceUpdateSkinningDQs(hwHInstance hi, int num_bones, hwDQuaternion *dqs)
+// shaders and assets whose reload has been read are swapped. game thread only, between frames
+void hwContext::collectReloads()
 {
-    if (dqs == nullptr) { return; }
-    if (hi >= m_instances.size()) { return; }
-    auto &v = m_instances[hi];
+    if (m_file_watching) { pollFileWatcher(); }
+
+    std::vector<hwHShader> shaders;
+    shaders.swap(m_reloading_shaders);
+    for (hwHShader hs : shaders) {
+        auto *v = m_shaders.get(hs);
+        if (!v || !v->reload_job) { continue; } // released meanwhile
+
+        int state = v->reload_job->state;
+        if (state == hwAssetLoadJob::Read || state == hwAssetLoadJob::Failed) {
+            auto job = std::move(v->reload_job);
+            swapShader(*v, *job);
+        }
+        else {
+            m_reloading_shaders.push_back(hs);
+        }
+    }
 
-	if (!NV_SUCCEEDED(g_hw_sdk->updateSkinningDqs(v.iid, num_bones, dqs)))
-	{
-        hwLog("GFSDK_HairSDK::UpdateSkinningDQs(%d) failed.\n", hi);
+    std::vector<hwHAsset> assets;
+    assets.swap(m_reloading_assets);
+    for (hwHAsset ha : assets) {
+        auto *v = m_assets.get(ha);
+        if (!v || !v->reload_job) { continue; }
+
+        int state = v->reload_job->state;
+        if (state == hwAssetLoadJob::Read || state == hwAssetLoadJob::Failed) {
+            auto job = std::move(v->reload_job);
+            swapAsset(*v, *job);
+            if (v->status == hwEAssetStatus_Ready) { registerAssetSource(*v); } // the contents may have changed
+        }
+        else {
+            m_reloading_assets.push_back(ha);
+        }
     }
 }
 
-
-void hwContext::beginScene()
+void hwContext::setFileWatching(bool enabled)
 {
-    m_mutex.lock();
+    if (enabled == m_file_watching) { return; }
+    m_file_watching = enabled;
+    m_watcher.clear();
+    if (!enabled) { return; }
+
+    m_shaders.each([this](hwShaderData &v) {
+        if (!v.path.empty()) { m_watcher.add(v.path); }
+    });
+    m_assets.each([this](hwAssetData &v) {
+        if (!v.path.empty()) { m_watcher.add(v.path); }
+    });
 }
 
-void hwContext::endScene()
+// files stay watched after their shaders and assets are released. their changes just don't match anything then
+void hwContext::pollFileWatcher()
 {
-    m_mutex.unlock();
+    std::vector<std::string> changed;
+    m_watcher.poll(changed);
+    for (auto &npath : changed) {
+        m_shaders.each([&](hwShaderData &v) {
+            if (!v.path.empty() && hwPathRegistry::normalize(v.path) == npath) {
+                hwLog("%s has been changed. reloading.\n", v.path.c_str());
+                startShaderReload(v);
+            }
+        });
+        m_assets.each([&](hwAssetData &v) {
+            if (!v.path.empty() && v.status != hwEAssetStatus_Loading && hwPathRegistry::normalize(v.path) == npath) {
+                hwLog("%s has been changed. reloading.\n", v.path.c_str());
+                startAssetReload(v);
+            }
+        });
+    }
 }
 
-void hwContext::initializeDepthStencil(BOOL flipComparison)
+int hwContext::assetGetRevision(hwHAsset ha) const
 {
-	CD3D11_DEPTH_STENCIL_DESC desc;
-
-	if (flipComparison)
-	{
-		desc.DepthEnable = TRUE;
-		desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
-		desc.DepthFunc = D3D11_COMPARISON_GREATER;
-
-		desc.StencilEnable = FALSE;
-
-		desc.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK;
-		desc.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK;
-
-
-		desc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
-		desc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
-		desc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
-		desc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
-
-		desc.BackFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
-		desc.BackFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
-		desc.BackFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
-		desc.BackFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
-	}
-
-		m_d3ddev->CreateDepthStencilState(&desc, &m_rs_enable_depth);
-	
+    auto *v = m_assets.get(ha);
+    return v ? v->revision : 0;
 }
 
-void hwContext::setShadowParams(void* shadowCB)
+int hwContext::assetGetNumBones(hwHAsset ha) const
 {
-	shadowBuffer = static_cast<ID3D11Buffer*>(shadowCB);
+	auto *v = m_assets.get(ha);
+	if (!v) { return 0; }
 
-	if (!shadowBuffer)
-	{
-		if (bufferSRV)
-		{
-			bufferSRV->Release();
-			bufferSRV = nullptr;
-		}
-		return;
-	}
-
-	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
-	ZeroMemory(&srvDesc, sizeof(srvDesc));
-	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
-	srvDesc.Buffer.ElementWidth = 1;
-	m_d3ddev->CreateShaderResourceView(shadowBuffer, &srvDesc, &bufferSRV);
+	return m_backend->getNumBones(v->aid);
 }
 
-void hwContext::pushDeferredCall(const DeferredCall &c)
+const char* hwContext::assetGetBoneName(hwHAsset ha, int nth) const
 {
-    m_commands.push_back(c);
+    static char tmp[256];
+    auto *v = m_assets.get(ha);
+    if (!v) { tmp[0] = '\0'; return tmp; }
+
+	if (!NV_SUCCEEDED(m_backend->getBoneName(v->aid, nth, tmp))) {
+        hwLog("GFSDK_HairSDK::GetBoneName(%d) failed.\n", ha);
+    }
+    return tmp;
 }
 
-void hwContext::setRenderTarget(hwTexture *framebuffer, hwTexture *depthbuffer)
+void hwContext::assetGetBoneIndices(hwHAsset ha, hwFloat4 &o_indices) const
 {
-    pushDeferredCall([=]() {
-        setRenderTargetImpl(framebuffer, depthbuffer);
-    });
+    auto *v = m_assets.get(ha);
+    if (!v) { return; }
+
+	if (!NV_SUCCEEDED(m_backend->getBoneIndices(v->aid, &o_indices))) {
+        hwLog("GFSDK_HairSDK::GetBoneIndices(%d) failed.\n", ha);
+    }
 }
 
-void hwContext::setViewProjection(const hwMatrix &view, const hwMatrix &proj, float fov)
+void hwContext::assetGetBoneWeights(hwHAsset ha, hwFloat4 &o_weight) const
 {
-    pushDeferredCall([=]() {
-        setViewProjectionImpl(view, proj, fov);
-    });
+    auto *v = m_assets.get(ha);
+    if (!v) { return; }
+
+	if (!NV_SUCCEEDED(m_backend->getBoneWeights(v->aid, &o_weight))) {
+        hwLog("GFSDK_HairSDK::GetBoneWeights(%d) failed.\n", ha);
+    }
 }
 
-void hwContext::setShader(hwHShader hs)
+void hwContext::assetGetBindPose(hwHAsset ha, int nth, hwMatrix &o_mat)
 {
-    pushDeferredCall([=]() {
-        setShaderImpl(hs);
-    });
+    auto *v = m_assets.get(ha);
+    if (!v) { return; }
+
+	if (!NV_SUCCEEDED(m_backend->getBindPose(v->aid, nth, &o_mat))) {
+        hwLog("GFSDK_HairSDK::GetBindPose(%d, %d) failed.\n", ha, nth);
+    }
 }
 
-void hwContext::setLights(int num_lights, const hwLightData *lights_)
+void hwContext::assetGetDefaultDescriptor(hwHAsset ha, hwHairDescriptor &o_desc) const
 {
-    std::array<hwLightData, hwMaxLights> lights;
-    num_lights = std::min<int>(num_lights, hwMaxLights);
-    std::copy(lights_, lights_ + num_lights, &lights[0]);
-    pushDeferredCall([=]() {
-        setLightsImpl(num_lights, &lights[0]);
-    });
+    auto *v = m_assets.get(ha);
+    if (!v) { return; }
+    if (v->has_default_desc) {
+        o_desc = v->default_desc;
+        return;
+    }
 
+	if (!NV_SUCCEEDED(m_backend->getInstanceDescriptorFromAsset(v->aid, o_desc))) {
+        hwLog("GFSDK_HairSDK::CopyInstanceDescriptorFromAsset(%d) failed.\n", ha);
+    }
 }
 
-void hwContext::setSphericalHarmonics(const hwFloat4 &Ar, const hwFloat4 &Ag, const hwFloat4 &Ab, const hwFloat4 &Br, const hwFloat4 &Bg, const hwFloat4 &Bb, const hwFloat4 &C)
+hwHInstance hwContext::instanceCreate(hwHAsset ha)
 {
-	pushDeferredCall([=]() {
-		setSphericalHarmonicsImpl(Ar, Ag, Ab, Br, Bg, Bb, C);
-	});
+	auto *a = m_assets.get(ha);
+	if (!a) { return hwNullHandle; }
+
+	hwHInstance ret = hwNullHandle;
+	if (hwInstanceData *v = m_instances.alloc()) {
+		v->hasset = ha;
+		v->index = m_instance_store.add(v->handle, hwNullInstanceID, ha);
+		if (a->status == hwEAssetStatus_Loading) {
+			// created by finishAssetLoad()
+			hwLog("GFSDK_HairSDK::CreateHairInstance(%d) : %d pending.\n", ha, v->handle);
+			ret = v->handle;
+		}
+		else if (createInstanceSDK(*v, *a)) {
+			hwLog("GFSDK_HairSDK::CreateHairInstance(%d) : %d succeeded.\n", ha, v->handle);
+			ret = v->handle;
+		}
+		else
+		{
+			hwLog("GFSDK_HairSDK::CreateHairInstance(%d) failed.\n", ha);
+			freeInstanceSlot(*v);
+		}
+	}
+	else {
+		hwLog("GFSDK_HairSDK::CreateHairInstance(%d) failed: out of instance handles.\n", ha);
+	}
+	if (m_capture.active()) {
+		hwCapInstanceCreate r = { ha, ret };
+		captureCall(hwECaptureRecord_InstanceCreate, r);
+	}
+	return ret;
 }
 
-void hwContext::setGIParameters(const hwFloat4 &Params)
+// creates the SDK side of v, and applies what was set on v while its asset was loading
+bool hwContext::createInstanceSDK(hwInstanceData &v, const hwAssetData &a)
 {
-	pushDeferredCall([=]() {
-		setGIParametersImpl(Params);
-	});
+	if (!NV_SUCCEEDED(m_backend->createInstance(a.aid, v.iid))) { return false; }
+	initInstanceSDK(v, a);
+	return true;
 }
 
-void hwContext::setReflectionProbe(ID3D11Resource *tex1, ID3D11Resource *tex2)
+// v.iid has just been created from a
+void hwContext::initInstanceSDK(hwInstanceData &v, const hwAssetData &a)
 {
-	pushDeferredCall([=]() {
-		setReflectionProbeImpl(tex1, tex2);
-	});
+	m_instance_store.iids[v.index] = v.iid;
+	m_instance_store.flags[v.index] &= ~hwEInstanceFlag_BoundsValid;
+	auto &b = m_instance_store.bounds[v.index];
+	if (NV_SUCCEEDED(m_backend->getBounds(v.iid, b.bmin, b.bmax))) {
+		m_instance_store.flags[v.index] |= hwEInstanceFlag_BoundsValid;
+	}
+	m_instance_store.changed = true;
+	if (v.has_pending_desc || a.has_default_desc) {
+		auto &desc = v.has_pending_desc ? v.pending_desc : a.default_desc;
+		if (NV_SUCCEEDED(m_backend->updateInstanceDescriptor(v.iid, desc))) {
+			hwStoreDescriptor(m_instance_store, v.index, desc);
+		}
+		v.has_pending_desc = false;
+	}
+	else {
+		hwHairDescriptor desc;
+		if (NV_SUCCEEDED(m_backend->getInstanceDescriptor(v.iid, desc))) {
+			hwStoreDescriptor(m_instance_store, v.index, desc);
+		}
+	}
+	for (int t = 0; t < NvHair::TextureType::COUNT_OF; ++t) {
+		if (v.textures[t]) { m_backend->setTexture(v.iid, (hwTextureType)t, v.textures[t]); }
+	}
 }
 
-void hwContext::render(hwHInstance hi)
+void hwContext::freeInstanceSlot(hwInstanceData &v)
 {
-    pushDeferredCall([=]() {
-        renderImpl(hi);
-    });
+    // the last instance of the store takes the released one's place
+    if (auto *moved = m_instances.get(m_instance_store.remove(v.index))) {
+        moved->index = v.index;
+    }
+    m_instances.free(v.handle);
 }
 
-void hwContext::renderShadow(hwHInstance hi)
+void hwContext::instanceRelease(hwHInstance hi)
 {
-    pushDeferredCall([=]() {
-        renderShadowImpl(hi);
-    });
+    if (m_capture.active()) { captureCall(hwECaptureRecord_InstanceRelease, hwCapHandle{ hi }); }
+    auto *v = m_instances.get(hi);
+    if (!v) { return; }
+
+    if (!*v) {
+        // its asset never finished loading
+    }
+    else {
+        // pages already recorded may still draw it
+        retireInstance(v->iid);
+    }
+    for (auto srv : v->textures) { m_views.release(srv); }
+    // the render thread may have given it an environment
+    hwRetiredObject r = { hwERetired_Environment, m_recording_frame, nullptr, hwNullAssetID, hwNullInstanceID, hi };
+    retire(r);
+    freeInstanceSlot(*v);
 }
 
-void hwContext::stepSimulation(float dt)
+void hwContext::instanceGetBounds(hwHInstance hi, hwFloat3 &o_min, hwFloat3 &o_max) const
 {
-    std::unique_lock<std::mutex> lock(m_mutex);
+    auto *v = m_instances.get(hi);
+    if (!v || !*v) { return; }
 
-    pushDeferredCall([=]() {
-        stepSimulationImpl(dt);
-    });
+	if (!NV_SUCCEEDED(m_backend->getBounds(v->iid, o_min, o_max)))
+	{
+        hwLog("GFSDK_HairSDK::GetBounds(%d) failed.\n", hi);
+    }
 }
 
-
-hwSRV* hwContext::getSRV(hwTexture *tex)
+void hwContext::instanceGetDescriptor(hwHInstance hi, hwHairDescriptor &desc) const
 {
-    {
-        auto i = m_srvtable.find(tex);
-        if (i != m_srvtable.end()) {
-            return i->second;
-        }
+    auto *v = m_instances.get(hi);
+    if (!v) { return; }
+    if (!*v) {
+        if (v->has_pending_desc) { desc = v->pending_desc; }
+        return;
     }
 
-    hwSRV *ret = nullptr;
-    if (SUCCEEDED(m_d3ddev->CreateShaderResourceView(tex, nullptr, &ret))) {
-        m_srvtable[tex] = ret;
+	if (!NV_SUCCEEDED(m_backend->getInstanceDescriptor(v->iid, desc)))
+	{
+        hwLog("GFSDK_HairSDK::CopyCurrentInstanceDescriptor(%d) failed.\n", hi);
     }
-    return ret;
 }
 
-hwRTV* hwContext::getRTV(hwTexture *tex)
+void hwContext::instanceSetDescriptor(hwHInstance hi, const hwHairDescriptor &desc)
 {
-    {
-        auto i = m_rtvtable.find(tex);
-        if (i != m_rtvtable.end()) {
-            return i->second;
-        }
+    if (m_capture.active()) {
+        hwCapInstanceSetDescriptor r = { hi, desc };
+        captureCall(hwECaptureRecord_InstanceSetDescriptor, r);
     }
-
-    hwRTV *ret = nullptr;
-    if (SUCCEEDED(m_d3ddev->CreateRenderTargetView(tex, nullptr, &ret))) {
-        m_rtvtable[tex] = ret;
+    auto *v = m_instances.get(hi);
+    if (!v) { return; }
+    if (!*v) {
+        v->pending_desc = desc;
+        v->has_pending_desc = true;
+        return;
     }
-    return ret;
-}
 
+    // scripts tend to set the descriptor every frame whether it changed or not
+    if (m_instance_store.descriptor_hashes[v->index] == hwHash64(&desc, sizeof(desc))) { return; }
 
-void hwContext::setRenderTargetImpl(hwTexture *framebuffer, hwTexture *depthbuffer)
-{
-    // todo
+	if (!NV_SUCCEEDED(m_backend->updateInstanceDescriptor(v->iid, desc)))
+	{
+        hwLog("GFSDK_HairSDK::UpdateInstanceDescriptor(%d) failed.\n", hi);
+        return;
+    }
+    hwStoreDescriptor(m_instance_store, v->index, desc);
 }
 
-void hwContext::setViewProjectionImpl(const hwMatrix &view, const hwMatrix &proj, float fov)
+void hwContext::instanceSetTexture(hwHInstance hi, hwTextureType type, hwTexture *tex)
 {
-	D3D11_VIEWPORT dxViewport;
-	UINT numViewports = 1;
-	m_d3dctx->RSGetViewports(&numViewports, &dxViewport);
-
-	NvHair::Viewport viewport;
-	viewport.init(dxViewport.TopLeftX, dxViewport.TopLeftY, dxViewport.Width, dxViewport.Height);
+	if (m_capture.active()) {
+		hwCapInstanceSetTexture r = { hi, (int)type, tex != nullptr };
+		captureCall(hwECaptureRecord_InstanceSetTexture, r);
+	}
+	auto *v = m_instances.get(hi);
+	if (!v) { return; }
+	if ((int)type < 0 || (int)type >= NvHair::TextureType::COUNT_OF) { return; }
 
-	//g_hw_sdk->setViewProjection((const gfsdk_float4x4*)&view, (const gfsdk_float4x4*)&proj, GFSDK_HAIR_RIGHT_HANDED, fov) != GFSDK_HAIR_RETURN_OK
+	NvResult result;
+	hwSRV *srv = nullptr;
+	// an instance that is still pending only keeps the view. it is set once the instance is created
+	if (!tex)
+	{
+		result = *v ? m_backend->setTexture(v->iid, type, nullptr) : NV_OK;
+	}
+	else
+	{
+		srv = getSRV(tex, true);
+		result = !srv ? NV_FAIL : *v ? m_backend->setTexture(v->iid, type, srv) : NV_OK;
+	}
 
-	if (!NV_SUCCEEDED(g_hw_sdk->setViewProjection(viewport, view, proj, nvidia::HairWorks::HandednessHint::RIGHT, fov)))
+	if (!NV_SUCCEEDED(result))
 	{
-		hwLog("GFSDK_HairSDK::SetViewProjection() failed.\n");
+		hwLog("GFSDK_HairSDK::SetTextureSRV(%d, %d) failed.\n", hi, type);
+		m_views.release(srv);
+		return;
+	}
+
+	// the previous view is no longer used by this instance. the cache destroys it once nothing else uses it.
+	m_views.release(v->textures[type]);
+	v->textures[type] = srv;
+	if (type == NvHair::TextureType::SPECULAR) {
+		uint32_t &flags = m_instance_store.flags[v->index];
+		uint32_t f = srv ? flags | hwEInstanceFlag_SpecularTexture : flags & ~hwEInstanceFlag_SpecularTexture;
+		if (f != flags) {
+			flags = f;
+			m_instance_store.changed = true;
+		}
 	}
 }
 
-void hwContext::setShaderImpl(hwHShader hs)
+void hwContext::setShadowTexture(ID3D11Resource *shadowTex)
 {
-    if (hs >= m_shaders.size()) { return; }
+	if (m_capture.active()) { captureCall(hwECaptureRecord_SetShadowTexture, hwCapInt{ shadowTex != nullptr }); }
 
-    auto &v = m_shaders[hs];
-    if (v.shader) {
-        m_d3dctx->PSSetShader(v.shader, nullptr, 0);
-    }
+	ID3D11ShaderResourceView *srv = nullptr;
+	if (shadowTex)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc;
+		ZeroMemory(&SRVDesc, sizeof(SRVDesc));
+		SRVDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		SRVDesc.Texture2D.MostDetailedMip = 0;
+		SRVDesc.Texture2D.MipLevels = 1;
+		srv = m_views.acquireSRV(shadowTex, SRVDesc);
+
+		if (!srv)
+		{
+			hwLog("Create Shadow SRV Failed!");
+		}
+	}
+
+	m_views.release(shadowSRV);
+	shadowSRV = srv;
 }
 
-void hwContext::setLightsImpl(int num_lights, const hwLightData *lights)
+void hwContext::instanceUpdateSkinningMatrices(hwHInstance hi, int num_bones, hwMatrix *matrices)
 {
-    m_cb.num_lights = num_lights;
-    std::copy(lights, lights + num_lights, m_cb.lights);
+	if (matrices == nullptr) { return; }
+	if (m_capture.active()) {
+		hwCapInstanceSkinning r = { hi, num_bones };
+		captureCall(hwECaptureRecord_InstanceUpdateSkinningMatrices, r, matrices, sizeof(hwMatrix) * std::max<int>(num_bones, 0));
+	}
+	auto *v = m_instances.get(hi);
+	if (!v || !*v) { return; }
+
+	if (!NV_SUCCEEDED(m_backend->updateSkinningMatrices(v->iid, num_bones, matrices)))
+	{
+		hwLog("GFSDK_HairSDK::UpdateSkinningMatrices(%d) failed.\n", hi);
+	}
 }
 
-void hwContext::setSphericalHarmonicsImpl(const hwFloat4 &Ar, const hwFloat4 &Ag, const hwFloat4 &Ab, const hwFloat4 &Br, const hwFloat4 &Bg, const hwFloat4 &Bb, const hwFloat4 &C)
+void hwContext::instanceUpdateSkinningDQs(hwHInstance hi, int num_bones, hwDQuaternion *dqs)
 {
-	m_cb.shAr = Ar;
-	m_cb.shAg = Ag;
-	m_cb.shAb = Ab;
-	m_cb.shBr = Br;
-	m_cb.shBg = Bg;
-	m_cb.shBb = Bb;
-	m_cb.shC = C;
+    if (dqs == nullptr) { return; }
+    if (m_capture.active()) {
+        hwCapInstanceSkinning r = { hi, num_bones };
+        captureCall(hwECaptureRecord_InstanceUpdateSkinningDQs, r, dqs, sizeof(hwDQuaternion) * std::max<int>(num_bones, 0));
+    }
+    auto *v = m_instances.get(hi);
+    if (!v || !*v) { return; }
 
+	if (!NV_SUCCEEDED(m_backend->updateSkinningDQs(v->iid, num_bones, dqs)))
+	{
+        hwLog("GFSDK_HairSDK::UpdateSkinningDQs(%d) failed.\n", hi);
+    }
 }
 
-void hwContext::setGIParametersImpl(const hwFloat4 &Params)
+
+void hwContext::beginScene()
 {
-	m_cb.gi_params = Params;
+    // nothing to do. all recording happens on the game thread and is published by submit().
 }
 
-void hwContext::setReflectionProbeImpl(ID3D11Resource *tex1, ID3D11Resource *tex2)
+void hwContext::endScene()
 {
-	if (!tex1)
-	{
-		if (reflectionSRV1)
-		{
-			reflectionSRV1->Release();
-			reflectionSRV1 = nullptr;
-		}
-	}
-
-	if (!tex2)
-	{
-		if (reflectionSRV2)
-		{
-			reflectionSRV2->Release();
-			reflectionSRV2 = nullptr;
-		}
-	}
-
-	if (!tex1 || !tex2)
-		return;
+}
 
-	if (tex1 == reflectionTexture1 && tex2 == reflectionTexture2)
-		return;
-	
-	ID3D11Texture2D* cubemap1;
-	ID3D11Texture2D* cubemap2;
+// reversed_z: depth test passes for greater values (Unity 5.5+)
+ID3D11DepthStencilState* hwContext::getDepthState(bool reversed_z)
+{
+	D3D11_DEPTH_STENCIL_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.DepthEnable = TRUE;
+	desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	desc.DepthFunc = reversed_z ? D3D11_COMPARISON_GREATER : D3D11_COMPARISON_LESS;
 
-	reflectionTexture1 = tex1;
-	reflectionTexture2 = tex2;
+	desc.StencilEnable = FALSE;
 
-	reflectionTexture1->QueryInterface(&cubemap1);
-	reflectionTexture2->QueryInterface(&cubemap2);
+	desc.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK;
+	desc.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK;
 
-	D3D11_TEXTURE2D_DESC texDesc1;
-	cubemap1->GetDesc(&texDesc1);
+	desc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+	desc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+	desc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+	desc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
 
-	D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc1;
-	ZeroMemory(&SRVDesc1, sizeof(SRVDesc1));
+	desc.BackFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+	desc.BackFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+	desc.BackFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+	desc.BackFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
 
-	SRVDesc1.Format = texDesc1.Format;
-	SRVDesc1.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-	SRVDesc1.Texture2D.MostDetailedMip = 0;
-	SRVDesc1.Texture2D.MipLevels = texDesc1.MipLevels;
+	return m_states.getDepthStencil(desc);
+}
 
-	D3D11_TEXTURE2D_DESC texDesc2;
-	cubemap2->GetDesc(&texDesc2);
+void hwContext::initializeDepthStencil(BOOL flipComparison)
+{
+	if (m_capture.active()) { captureCall(hwECaptureRecord_InitializeDepthStencil, hwCapInt{ flipComparison }); }
 
-	D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc2;
-	ZeroMemory(&SRVDesc2, sizeof(SRVDesc2));
+	// cached, so switching back and forth doesn't create (or leak) anything
+	if (auto *state = getDepthState(flipComparison != FALSE)) {
+		m_rs_enable_depth = state;
+	}
+}
 
-	SRVDesc2.Format = texDesc2.Format;
-	SRVDesc2.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-	SRVDesc2.Texture2D.MostDetailedMip = 0;
-	SRVDesc2.Texture2D.MipLevels = texDesc2.MipLevels;
+void hwContext::setShadowParams(void* shadowCB)
+{
+	if (m_capture.active()) { captureCall(hwECaptureRecord_SetShadowParams, hwCapInt{ shadowCB != nullptr }); }
 
-	m_d3ddev->CreateShaderResourceView(cubemap1, &SRVDesc1, &reflectionSRV1);
-	m_d3ddev->CreateShaderResourceView(cubemap2, &SRVDesc2, &reflectionSRV2);
+	shadowBuffer = static_cast<ID3D11Buffer*>(shadowCB);
 
-	if (cubemap1)
+	// called every frame with the same buffer, which is a cache hit
+	ID3D11ShaderResourceView *srv = nullptr;
+	if (shadowBuffer)
 	{
-		cubemap1 = nullptr;
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+		ZeroMemory(&srvDesc, sizeof(srvDesc));
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.ElementWidth = 1;
+		srv = m_views.acquireSRV(shadowBuffer, srvDesc);
 	}
 
-	if (cubemap2)
-	{
-		cubemap2 = nullptr;
-	}
+	m_views.release(bufferSRV);
+	bufferSRV = srv;
 }
 
-void hwContext::renderImpl(hwHInstance hi)
+// signed distance between two frame indices as carried by render event IDs (wraps at hwFrameIndexMask)
+static int hwFrameDiff(int a, int b)
 {
-    if (hi >= m_instances.size()) { return; }
-    auto &v = m_instances[hi];
+    int d = (a - b) & hwFrameIndexMask;
+    return d > (int)(hwFrameIndexMask >> 1) ? d - (int)hwFrameIndexMask - 1 : d;
+}
 
-	g_hw_sdk->preRender(1);
+static bool hwIsDrawCommand(uint32_t type)
+{
+    return type == hwECommandType_Render || type == hwECommandType_RenderShadow ||
+        type == hwECommandType_RenderBatch || type == hwECommandType_RenderShadowBatch;
+}
 
-    // update constant buffer
-    {
-		g_hw_sdk->prepareShaderConstantBuffer(v.iid, m_cb.hw);
+static bool hwIsShadowCommand(uint32_t type)
+{
+    return type == hwECommandType_RenderShadow || type == hwECommandType_RenderShadowBatch;
+}
 
-        D3D11_MAPPED_SUBRESOURCE MappedResource;
-        m_d3dctx->Map(m_rs_constant_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource);
-        *((hwConstantBuffer*)MappedResource.pData) = m_cb;
-        m_d3dctx->Unmap(m_rs_constant_buffer, 0);
+template<class T>
+T* hwContext::pushCommand(hwECommandType type, size_t extra)
+{
+    if (m_capture.active()) { m_capture_times.push_back(m_capture.now()); }
+    return m_command_pages[m_recording_page].commands.push<T>(type, extra);
+}
 
-        m_d3dctx->PSSetConstantBuffers(0, 1, &m_rs_constant_buffer);
+// writes the commands recorded since the last call to the capture. they are complete by now.
+void hwContext::captureCommands()
+{
+    auto &commands = m_command_pages[m_recording_page].commands;
+    if (m_capture.active()) {
+        size_t i = 0;
+        commands.each([&](const hwCommandHeader &header, const void *) {
+            uint64_t time = i < m_capture_times.size() ? m_capture_times[i] : m_capture.now();
+            m_capture.write(hwECaptureRecord_Command, time, &header, header.size);
+            ++i;
+        }, m_capture_cursor);
     }
+    m_capture_times.clear();
+    m_capture_cursor = commands.size();
+}
 
-	// set texture sampler state
-	{
-		D3D11_SAMPLER_DESC samplerDesc;
-		samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-		samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-		samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-		samplerDesc.BorderColor[0] = 0;
-		samplerDesc.BorderColor[1] = 0;
-		samplerDesc.BorderColor[2] = 0;
-		samplerDesc.BorderColor[3] = 0;
-		samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
-		samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-		samplerDesc.MaxAnisotropy = 1;
-		samplerDesc.MinLOD = 0;
-		samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-		samplerDesc.MipLODBias = 0;
-		ID3D11SamplerState* sampler;
-		m_d3ddev->CreateSamplerState(&samplerDesc, &sampler);
-		m_d3dctx->PSSetSamplers(0, 1, &sampler);
-
-		if (sampler) {
-			sampler->Release(); 
-			sampler = nullptr;
-		}
-	}
+template<class T>
+void hwContext::captureCall(hwECaptureRecord type, const T &data, const void *extra, size_t extra_size)
+{
+    uint64_t time = m_capture.now();
+    captureCommands();
+    m_capture.write(type, time, &data, sizeof(T), extra, extra_size);
+}
+
+bool hwContext::captureBegin(const std::string &path)
+{
+    if (!m_capture.open(path.c_str())) { return false; }
+    // commands recorded before this point are not part of the capture
+    m_capture_times.clear();
+    m_capture_cursor = m_command_pages[m_recording_page].commands.size();
+    return true;
+}
+
+void hwContext::captureEnd()
+{
+    if (!m_capture.active()) { return; }
+    captureCommands();
+    m_capture.close();
+}
+
+void hwContext::submitCommands(int view)
+{
+    // before the page, so the render thread has the instances the page draws by the time it takes the page
+    publishRenderState();
+
+    auto &page = m_command_pages[m_recording_page];
+    if (m_capture.active()) { captureCommands(); }
+    if (page.commands.empty()) { return; }
+
+    int next;
+    if (m_free_pages.pop(next)) {
+        page.frame = m_recording_frame;
+        page.view = view;
+        m_submitted_pages.push(m_recording_page);
+        m_recording_page = next;
+    }
+    else {
+        // the render thread still holds every other page. the game thread never waits, and keeping these
+        // commands around would merge them into the next view or frame, so apply the stale frame policy to them.
+        handleStaleCommands(page.commands, true);
+    }
+    m_capture_cursor = m_command_pages[m_recording_page].commands.size();
+}
+
+void hwContext::beginFrame(int frame)
+{
+    if (m_capture.active()) { captureCall(hwECaptureRecord_BeginFrame, hwCapInt{ frame }); }
+    collectAssetLoads();
+    if (frame == m_recording_frame) { return; }
+
+    handOffRetired();
+    m_views.trim();
+
+    // anything still unsubmitted was recorded outside of any view
+    submitCommands(hwSharedView);
+    m_recording_frame = frame;
+    collectReloads();
+}
+
+void hwContext::submit(int view)
+{
+    if (m_capture.active()) { captureCall(hwECaptureRecord_Submit, hwCapInt{ view }); }
+    submitCommands(view & hwViewIndexMask);
+}
 
-	// set shadow sampler state
+void hwContext::setStaleFramePolicy(hwEStaleFramePolicy policy)
+{
+    m_stale_frame_policy = policy;
+}
+
+void hwContext::setSortMode(hwESortMode mode)
+{
+    m_sort_mode = mode;
+}
+
+void hwContext::getStats(hwStats &o_stats) const
+{
+    o_stats.frames_executed = m_frames_executed;
+    o_stats.frames_dropped = m_frames_dropped;
+    o_stats.frames_coalesced = m_frames_coalesced;
+    o_stats.commands_eliminated = m_commands_eliminated;
+    o_stats.bytes_uploaded = m_bytes_uploaded;
+    o_stats.instances_culled = m_instances_culled;
+    o_stats.dedup_hits = m_dedup_hits;
+    o_stats.dedup_bytes_saved = m_dedup_bytes_saved;
+    o_stats.shader_variants = m_shader_variants;
+    o_stats.shader_fallbacks = m_shader_fallbacks;
+
+    hwViewCacheStats views, render_views;
+    m_views.getStats(views);
+    m_render_views.getStats(render_views);
+    o_stats.views = views.views + render_views.views;
+    o_stats.views_referenced = views.views_referenced + render_views.views_referenced;
+    o_stats.views_created = views.views_created + render_views.views_created;
+    o_stats.views_evicted = views.views_evicted + render_views.views_evicted;
+    o_stats.view_cache_memory = views.memory + render_views.memory;
+
+    hwHandlePoolStats pools[3];
+    m_shaders.getStats(pools[0]);
+    m_assets.getStats(pools[1]);
+    m_instances.getStats(pools[2]);
+    o_stats.shaders = pools[0].used;
+    o_stats.assets = pools[1].used;
+    o_stats.instances = pools[2].used;
+    o_stats.handle_slots = o_stats.handles_allocated = o_stats.handles_freed = o_stats.stale_handles = 0;
+    for (auto &p : pools) {
+        o_stats.handle_slots += p.slots;
+        o_stats.handles_allocated += p.allocated;
+        o_stats.handles_freed += p.freed;
+        o_stats.stale_handles += p.stale;
+    }
+}
+
+void hwContext::getBackendStats(hwBackendStats &o_stats) const
+{
+    if (m_backend) {
+        m_backend->getStats(o_stats);
+    }
+    else {
+        memset(&o_stats, 0, sizeof(o_stats));
+    }
+}
+
+// called by the render thread for submitted pages, or by the game thread for a page that couldn't be submitted.
+// either way the commands are not executed as a frame of their own.
+void hwContext::handleStaleCommands(hwCommandBuffer &commands, bool count_frame)
+{
+    if (m_stale_frame_policy == hwEStaleFramePolicy_Coalesce) {
+        commands.filter([](const hwCommandHeader &header) { return !hwIsDrawCommand(header.type); });
+        if (count_frame) { ++m_frames_coalesced; }
+    }
+    else {
+        // instance environments are only sent when they change. dropping them would leave the instance with a stale one.
+        commands.filter([](const hwCommandHeader &header) { return header.type == hwECommandType_SetInstanceEnvironment; });
+        if (count_frame) { ++m_frames_dropped; }
+    }
+}
+
+void hwContext::setRenderTarget(hwTexture *framebuffer, hwTexture *depthbuffer)
+{
+    auto *c = pushCommand<hwCmdSetRenderTarget>(hwECommandType_SetRenderTarget);
+    c->framebuffer = framebuffer;
+    c->depthbuffer = depthbuffer;
+}
+
+void hwContext::setViewProjection(const hwMatrix &view, const hwMatrix &proj, float fov)
+{
+    auto *c = pushCommand<hwCmdSetViewProjection>(hwECommandType_SetViewProjection);
+    c->view = view;
+    c->proj = proj;
+    c->fov = fov;
+}
+
+void hwContext::setShader(hwHShader hs)
+{
+    pushCommand<hwCmdSetShader>(hwECommandType_SetShader)->hs = hs;
+}
+
+void hwContext::setLights(int num_lights, const hwLightData *lights)
+{
+    num_lights = std::max<int>(std::min<int>(num_lights, hwMaxLights), 0);
+    auto *c = pushCommand<hwCmdSetLights>(hwECommandType_SetLights, sizeof(hwLightData) * std::max<int>(num_lights - 1, 0));
+    c->num_lights = num_lights;
+    std::fill(c->pad, c->pad + 3, 0); // hwStateCache compares records bytewise
+    std::copy(lights, lights + num_lights, c->lights);
+}
+
+void hwContext::setSphericalHarmonics(const hwFloat4 &Ar, const hwFloat4 &Ag, const hwFloat4 &Ab, const hwFloat4 &Br, const hwFloat4 &Bg, const hwFloat4 &Bb, const hwFloat4 &C)
+{
+	auto *c = pushCommand<hwCmdSetSphericalHarmonics>(hwECommandType_SetSphericalHarmonics);
+	c->Ar = Ar; c->Ag = Ag; c->Ab = Ab;
+	c->Br = Br; c->Bg = Bg; c->Bb = Bb;
+	c->C = C;
+}
+
+void hwContext::setGIParameters(const hwFloat4 &Params)
+{
+	pushCommand<hwCmdSetGIParameters>(hwECommandType_SetGIParameters)->params = Params;
+}
+
+void hwContext::setReflectionProbe(ID3D11Resource *tex1, ID3D11Resource *tex2)
+{
+	auto *c = pushCommand<hwCmdSetReflectionProbe>(hwECommandType_SetReflectionProbe);
+	c->tex1 = tex1;
+	c->tex2 = tex2;
+}
+
+void hwContext::instanceSetEnvironment(hwHInstance hi, const hwEnvironmentData &env)
+{
+    auto *c = pushCommand<hwCmdSetInstanceEnvironment>(hwECommandType_SetInstanceEnvironment);
+    c->hi = hi;
+    c->pad = 0;
+    c->env = env;
+}
+
+void hwContext::render(hwHInstance hi)
+{
+    pushCommand<hwCmdRender>(hwECommandType_Render)->hi = hi;
+}
+
+void hwContext::renderShadow(hwHInstance hi)
+{
+    pushCommand<hwCmdRender>(hwECommandType_RenderShadow)->hi = hi;
+}
+
+void hwContext::renderBatch(int count, const hwHInstance *handles)
+{
+    if (count <= 0 || handles == nullptr) { return; }
+    auto *c = pushCommand<hwCmdRenderBatch>(hwECommandType_RenderBatch, sizeof(hwHInstance) * (count - 1));
+    c->count = count;
+    c->pad = 0;
+    std::copy(handles, handles + count, c->handles);
+}
+
+void hwContext::renderShadowBatch(int count, const hwHInstance *handles)
+{
+    if (count <= 0 || handles == nullptr) { return; }
+    auto *c = pushCommand<hwCmdRenderBatch>(hwECommandType_RenderShadowBatch, sizeof(hwHInstance) * (count - 1));
+    c->count = count;
+    c->pad = 0;
+    std::copy(handles, handles + count, c->handles);
+}
+
+void hwContext::stepSimulation(float dt)
+{
+    pushCommand<hwCmdStepSimulation>(hwECommandType_StepSimulation)->dt = dt;
+    // simulation is shared by all views and runs at the first flush of the frame
+    submitCommands(hwSharedView);
+}
+
+
+ID3D11Buffer* hwContext::createConstantBuffer(size_t size)
+{
+	D3D11_BUFFER_DESC desc;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.ByteWidth = (UINT)size;
+	desc.StructureByteStride = 0;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.MiscFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	ID3D11Buffer *ret = m_backend->createBuffer(desc);
+	if (!ret) {
+		hwLog("hwContext::createConstantBuffer(%d) failed.\n", (int)size);
+	}
+	return ret;
+}
+
+void hwContext::uploadConstantBuffer(ID3D11Buffer *buf, const void *data, size_t size)
+{
+	if (m_backend->updateBuffer(buf, data, size)) {
+		m_bytes_uploaded_current += (int)size;
+	}
+}
+
+// views of the whole texture. acquire: see hwViewCache
+hwSRV* hwContext::getSRV(hwTexture *tex, bool acquire)
+{
+    D3D11_TEXTURE2D_DESC texDesc;
+    if (!m_backend->getTextureDesc(tex, texDesc)) { return nullptr; }
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC desc;
+    ZeroMemory(&desc, sizeof(desc));
+    desc.Format = texDesc.Format;
+    desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+    desc.Texture2D.MostDetailedMip = 0;
+    desc.Texture2D.MipLevels = texDesc.MipLevels;
+    return acquire ? m_views.acquireSRV(tex, desc) : m_views.getSRV(tex, desc);
+}
+
+hwRTV* hwContext::getRTV(hwTexture *tex, bool acquire)
+{
+    D3D11_TEXTURE2D_DESC texDesc;
+    if (!m_backend->getTextureDesc(tex, texDesc)) { return nullptr; }
+
+    D3D11_RENDER_TARGET_VIEW_DESC desc;
+    ZeroMemory(&desc, sizeof(desc));
+    desc.Format = texDesc.Format;
+    desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+    desc.Texture2D.MipSlice = 0;
+    return acquire ? m_views.acquireRTV(tex, desc) : m_views.getRTV(tex, desc);
+}
+
+
+void hwContext::setRenderTargetImpl(hwTexture *framebuffer, hwTexture *depthbuffer)
+{
+    // todo
+}
+
+void hwContext::setViewProjectionImpl(const hwMatrix &view, const hwMatrix &proj, float fov)
+{
+	if (!NV_SUCCEEDED(m_backend->setViewProjection(view, proj, fov)))
 	{
-		D3D11_SAMPLER_DESC shadowSamplerDesc;
-		shadowSamplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
-		shadowSamplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
-		shadowSamplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
-		shadowSamplerDesc.BorderColor[0] = 0;
-		shadowSamplerDesc.BorderColor[1] = 0;
-		shadowSamplerDesc.BorderColor[2] = 0;
-		shadowSamplerDesc.BorderColor[3] = 0;
-		//shadowSamplerDesc.ComparisonFunc = D3D11_COMPARISON_GREATER;
-		//shadowSamplerDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_MIP_POINT;
-		shadowSamplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT;
-		shadowSamplerDesc.MaxAnisotropy = 0;
-		shadowSamplerDesc.MinLOD = 0;
-		shadowSamplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-		shadowSamplerDesc.MipLODBias = 0;
-		ID3D11SamplerState* shadowSampler;
-		m_d3ddev->CreateSamplerState(&shadowSamplerDesc, &shadowSampler);
-		m_d3dctx->PSSetSamplers(1, 1, &shadowSampler);
-
-		if (shadowSampler) {
-			shadowSampler->Release();
-			shadowSampler = nullptr;
-		}
+		hwLog("GFSDK_HairSDK::SetViewProjection() failed.\n");
+	}
+	m_render_store.cull(view, proj);
+}
+
+void hwContext::setShaderImpl(hwHShader hs)
+{
+    auto *v = findShaderPrograms(hs);
+    if (!v) { return; }
+
+    m_bound_shader = hs;
+    if (v->shader) {
+        m_backend->setPixelShader(v->shader);
+        m_bound_ps = v->shader;
+    }
+}
+
+void hwContext::setLightsImpl(int num_lights, const hwLightData *lights)
+{
+    m_frame_cb.num_lights = num_lights;
+    std::copy(lights, lights + num_lights, m_frame_cb.lights);
+    m_frame_cb_dirty = true;
+
+    uint32_t f = 0;
+    if (num_lights > 0) { f |= hwEShaderFeature_Lights; }
+    if (num_lights > 1) { f |= hwEShaderFeature_ManyLights; }
+    for (int i = 0; i < num_lights; ++i) {
+        if (lights[i].type != hwELightType_Directional) { f |= hwEShaderFeature_LocalLights; }
+    }
+    m_light_features = f;
+}
+
+void hwContext::setSphericalHarmonicsImpl(const hwFloat4 &Ar, const hwFloat4 &Ag, const hwFloat4 &Ab, const hwFloat4 &Br, const hwFloat4 &Bg, const hwFloat4 &Bb, const hwFloat4 &C)
+{
+	m_env.shAr = Ar;
+	m_env.shAg = Ag;
+	m_env.shAb = Ab;
+	m_env.shBr = Br;
+	m_env.shBg = Bg;
+	m_env.shBb = Bb;
+	m_env.shC = C;
+}
+
+void hwContext::setGIParametersImpl(const hwFloat4 &Params)
+{
+	m_env.gi_params = Params;
+}
+
+void hwContext::setReflectionProbeImpl(ID3D11Resource *tex1, ID3D11Resource *tex2)
+{
+	hwEnvironmentData env = m_env;
+	env.probe1 = tex1;
+	env.probe2 = tex2;
+	updateEnvironment(m_env, m_env_probes, env);
+}
+
+void hwContext::instanceSetEnvironmentImpl(hwHInstance hi, const hwEnvironmentData &env)
+{
+    if (m_render_store.find(hi) < 0) { return; }
+
+    auto &e = m_instance_envs[hi];
+    updateEnvironment(e.env, e.probes, env);
+}
+
+// probe views are only looked up when the probes change. a probe needs its pair, or neither is used.
+void hwContext::updateEnvironment(hwEnvironmentData &dst, hwSRV *(&probes)[2], const hwEnvironmentData &src)
+{
+	if (src.probe1 != dst.probe1 || src.probe2 != dst.probe2)
+	{
+		bool has_probes = src.probe1 && src.probe2;
+		hwSRV *srv1 = has_probes ? acquireCubeSRV(src.probe1) : nullptr;
+		hwSRV *srv2 = has_probes ? acquireCubeSRV(src.probe2) : nullptr;
+		m_render_views.release(probes[0]);
+		m_render_views.release(probes[1]);
+		probes[0] = srv1;
+		probes[1] = srv2;
 	}
+	dst = src;
+}
+
+hwSRV* hwContext::acquireCubeSRV(ID3D11Resource *tex)
+{
+	D3D11_TEXTURE2D_DESC texDesc;
+	if (!m_backend->getTextureDesc(tex, texDesc))
+		return nullptr;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc;
+	ZeroMemory(&SRVDesc, sizeof(SRVDesc));
+
+	SRVDesc.Format = texDesc.Format;
+	SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	SRVDesc.TextureCube.MostDetailedMip = 0;
+	SRVDesc.TextureCube.MipLevels = texDesc.MipLevels;
+	return m_render_views.acquireSRV(tex, SRVDesc);
+}
+
+// binds what every hair draw of a batch shares
+void hwContext::beginDraws()
+{
+	std::fill(m_bound_probes, m_bound_probes + 2, nullptr);
+	m_bound_ps = nullptr;
+	m_backend->preRender(1.0f);
+	m_legacy_cb_bound = false;
+
+	ID3D11Buffer *cbs[] = { m_rs_frame_cb, m_rs_instance_cb };
+	m_backend->setConstantBuffers(0, 2, cbs);
+
+	// set sampler states
+	m_backend->setSamplers(0, 1, &m_rs_sampler_texture);
+	m_backend->setSamplers(1, 1, &m_rs_sampler_shadow);
+
+	// set shadow texture
+	m_backend->setShaderResources(11, 1, &shadowSRV);
+
+	// update shadow matrices buffer
+	m_backend->setShaderResources(12, 1, &bufferSRV);
+}
+
+// the per-instance part of a hair draw. beginDraws() must have been called.
+void hwContext::drawInstance(hwHInstance hi)
+{
+    int si = m_render_store.find(hi);
+    if (si < 0) { return; }
+    hwInstanceID iid = m_render_store.iids[si];
+    if (iid == hwNullInstanceID) { return; } // asset still loading
+    uint32_t flags = m_render_store.flags[si];
+    if ((flags & hwEInstanceFlag_Visible) == 0) {
+        ++m_instances_culled_current;
+        return;
+    }
+
+    auto ie = m_instance_envs.find(hi);
+    const hwEnvironmentData &env = ie != m_instance_envs.end() ? ie->second.env : m_env;
+    hwSRV *const *probes = ie != m_instance_envs.end() ? ie->second.probes : m_env_probes;
+
+    // the variant of the bound shader for what the draw uses
+    bool legacy = false;
+    if (auto *s = findShaderPrograms(m_bound_shader)) {
+        uint32_t features = shaderFeatures(flags, probes);
+        ID3D11PixelShader *ps = s->variants[features];
+        if (!ps) {
+            ps = s->shader;
+            legacy = s->legacy_constants;
+            // shaders without variants (custom ones) always draw with themselves
+            if (s->has_variants && features != hwEShaderFeature_All) { ++m_shader_fallbacks_current; }
+        }
+        if (ps && ps != m_bound_ps) {
+            m_backend->setPixelShader(ps);
+            m_bound_ps = ps;
+        }
+    }
+
+    // update constant buffers. lights change rarely, the environment and hair constants are per instance.
+    if (legacy) {
+        hwLegacyConstantBuffer cb;
+        cb.shAr = env.shAr;
+        cb.shAg = env.shAg;
+        cb.shAb = env.shAb;
+        cb.shBr = env.shBr;
+        cb.shBg = env.shBg;
+        cb.shBb = env.shBb;
+        cb.shC = env.shC;
+        cb.gi_params = env.gi_params;
+        cb.num_lights = m_frame_cb.num_lights;
+        std::fill(cb.pad0, cb.pad0 + 3, 0);
+        std::copy(m_frame_cb.lights, m_frame_cb.lights + hwMaxLights, cb.lights);
+        m_backend->prepareShaderConstantBuffer(iid, cb.hw);
+        if (!m_legacy_cb_valid || memcmp(&cb, &m_legacy_cb, sizeof(cb)) != 0) {
+            m_legacy_cb = cb;
+            m_legacy_cb_valid = true;
+            uploadConstantBuffer(m_rs_legacy_cb, &m_legacy_cb, sizeof(m_legacy_cb));
+        }
+        if (!m_legacy_cb_bound) {
+            m_backend->setConstantBuffers(0, 1, &m_rs_legacy_cb);
+            m_legacy_cb_bound = true;
+        }
+    }
+    else {
+        if (m_frame_cb_dirty) {
+            uploadConstantBuffer(m_rs_frame_cb, &m_frame_cb, sizeof(m_frame_cb));
+            m_frame_cb_dirty = false;
+        }
+        if (m_legacy_cb_bound) {
+            m_backend->setConstantBuffers(0, 1, &m_rs_frame_cb);
+            m_legacy_cb_bound = false;
+        }
+
+        hwInstanceConstantBuffer cb;
+        cb.shAr = env.shAr;
+        cb.shAg = env.shAg;
+        cb.shAb = env.shAb;
+        cb.shBr = env.shBr;
+        cb.shBg = env.shBg;
+        cb.shBb = env.shBb;
+        cb.shC = env.shC;
+        cb.gi_params = env.gi_params;
+        m_backend->prepareShaderConstantBuffer(iid, cb.hw);
+        if (!m_instance_cb_valid || memcmp(&cb, &m_instance_cb, sizeof(cb)) != 0) {
+            m_instance_cb = cb;
+            m_instance_cb_valid = true;
+            uploadConstantBuffer(m_rs_instance_cb, &m_instance_cb, sizeof(m_instance_cb));
+        }
+    }
 
     // set shader resource views
     {
 		ID3D11ShaderResourceView* SRVs[NvHair::ShaderResourceType::COUNT_OF] = { nullptr, nullptr, nullptr, nullptr, nullptr };
-		g_hw_sdk->getShaderResources(v.iid, NV_NULL, NvHair::ShaderResourceType::COUNT_OF, NvCo::Dx11Type::wrapPtr(SRVs));
-		m_d3dctx->PSSetShaderResources(0, NvHair::ShaderResourceType::COUNT_OF, SRVs);
+		m_backend->getShaderResources(iid, SRVs);
+		m_backend->setShaderResources(0, NvHair::ShaderResourceType::COUNT_OF, SRVs);
 
 		ID3D11ShaderResourceView* ppTextureSRVs[4] = { nullptr, nullptr, nullptr, nullptr };
 
 		NvHair::TextureType::Enum textureTypes[4] = { NvHair::TextureType::ROOT_COLOR , NvHair::TextureType::TIP_COLOR, NvHair::TextureType::SPECULAR, NvHair::TextureType::STRAND };
 
-		if (NV_SUCCEEDED(g_hw_sdk->getTextures(v.iid, textureTypes, 4, NvCo::Dx11Type::wrapPtr(ppTextureSRVs))))
+		if (NV_SUCCEEDED(m_backend->getTextures(iid, textureTypes, 4, ppTextureSRVs)))
 		{
-			m_d3dctx->PSSetShaderResources(NvHair::ShaderResourceType::COUNT_OF, 4, ppTextureSRVs);
+			m_backend->setShaderResources(NvHair::ShaderResourceType::COUNT_OF, 4, ppTextureSRVs);
 		}
 
-		// set reflection probe
-		m_d3dctx->PSSetShaderResources(9, 1, &reflectionSRV1);
-
-		m_d3dctx->PSSetShaderResources(10, 1, &reflectionSRV2);
-
-		// set shadow texture
-		m_d3dctx->PSSetShaderResources(11, 1, &shadowSRV);
-
-		// update shadow matrices buffer
-		m_d3dctx->PSSetShaderResources(12, 1, &bufferSRV);
-		
+		// set reflection probes. instances close to each other mostly share them
+		if (probes[0] != m_bound_probes[0] || probes[1] != m_bound_probes[1])
+		{
+			m_backend->setShaderResources(9, 2, probes);
+			std::copy(probes, probes + 2, m_bound_probes);
+		}
     }
 
     // render
 	NvHair::ShaderSettings settings = NvHair::ShaderSettings(true, false);
-	if (!NV_SUCCEEDED(g_hw_sdk->renderHairs(v.iid, &settings)))
+	if (!NV_SUCCEEDED(m_backend->renderHairs(iid, settings)))
 	{
         hwLog("GFSDK_HairSDK::RenderHairs(%d) failed.\n", hi);
     }
     // render indicators
-	g_hw_sdk->renderVisualization(v.iid);
+	m_backend->renderVisualization(iid);
+}
+
+// hwEShaderFeature bits of what the draw of an instance uses. probes: the ones bound for it
+// flags: the instance's in m_render_store
+uint32_t hwContext::shaderFeatures(uint32_t flags, hwSRV *const *probes) const
+{
+    uint32_t f = m_light_features;
+    if (shadowSRV && (flags & hwEInstanceFlag_ReceiveShadow)) { f |= hwEShaderFeature_Shadows; }
+    if (probes[0] && probes[1]) { f |= hwEShaderFeature_Probes; }
+    if (flags & hwEInstanceFlag_Glint) { f |= hwEShaderFeature_Glint; }
+    if (flags & hwEInstanceFlag_SpecularTexture) { f |= hwEShaderFeature_SpecularTexture; }
+    return f;
+}
+
+void hwContext::renderImpl(hwHInstance hi)
+{
+    beginDraws();
+    drawInstance(hi);
+}
+
+void hwContext::renderBatchImpl(int count, const hwHInstance *handles)
+{
+    if (count <= 0) { return; }
+
+    beginDraws();
+    for (int i = 0; i < count; ++i) {
+        drawInstance(handles[i]);
+    }
+}
+
+void hwContext::renderShadowBatchImpl(int count, const hwHInstance *handles)
+{
+    for (int i = 0; i < count; ++i) {
+        renderShadowImpl(handles[i]);
+    }
 }
 
 void hwContext::renderShadowImpl(hwHInstance hi)
 {
-	if (hi >= m_instances.size()) { return; }
-	auto &v = m_instances[hi];
+	// not culled by the view frustum: the shadow may fall into view from outside it
+	int si = m_render_store.find(hi);
+	if (si < 0 || (m_render_store.flags[si] & hwEInstanceFlag_CastShadow) == 0) { return; }
+	hwInstanceID iid = m_render_store.iids[si];
+	if (iid == hwNullInstanceID) { return; } // asset still loading
 
 	// set shader resource views
 	{
 		ID3D11ShaderResourceView* SRVs[NvHair::ShaderResourceType::COUNT_OF];
-		g_hw_sdk->getShaderResources(v.iid, NV_NULL, NvHair::ShaderResourceType::COUNT_OF, NvCo::Dx11Type::wrapPtr(SRVs));
-		m_d3dctx->PSSetShaderResources(0, NvHair::ShaderResourceType::COUNT_OF, SRVs);
+		m_backend->getShaderResources(iid, SRVs);
+		m_backend->setShaderResources(0, NvHair::ShaderResourceType::COUNT_OF, SRVs);
 	}
 
 	auto settings = NvHair::ShaderSettings(false, true);
-	if (!NV_SUCCEEDED(g_hw_sdk->renderHairs(v.iid, &settings)))
+	if (!NV_SUCCEEDED(m_backend->renderHairs(iid, settings)))
 	{
 		hwLog("GFSDK_HairSDK::RenderHairs(%d) failed.\n", hi);
 	}
@@ -1007,24 +2399,536 @@ void hwContext::renderShadowImpl(hwHInstance hi)
 
 void hwContext::stepSimulationImpl(float dt)
 {
-	if (!NV_SUCCEEDED(g_hw_sdk->stepSimulation(dt, nullptr, true)))
+	if (!NV_SUCCEEDED(m_backend->stepSimulation(dt)))
 	{
 		hwLog("GFSDK_HairSDK::StepSimulation(%f) failed.\n", dt);
 	}
+	m_render_store.updateBounds(m_backend);
+}
+
+// size of the meaningful part of a state command. records are padded to hwCommandBuffer::Align with garbage.
+static size_t hwStateCommandSize(const hwCommandHeader &header, const void *data)
+{
+    switch (header.type) {
+    case hwECommandType_SetViewProjection:      return sizeof(hwCmdSetViewProjection);
+    case hwECommandType_SetShader:              return sizeof(hwCmdSetShader);
+    case hwECommandType_SetLights:              return offsetof(hwCmdSetLights, lights) + sizeof(hwLightData) * ((const hwCmdSetLights*)data)->num_lights;
+    case hwECommandType_SetSphericalHarmonics:  return sizeof(hwCmdSetSphericalHarmonics);
+    case hwECommandType_SetGIParameters:        return sizeof(hwCmdSetGIParameters);
+    }
+    return 0; // not tracked
+}
+
+bool hwStateCache::update(const hwCommandHeader &header, const void *data)
+{
+    size_t size = hwStateCommandSize(header, data);
+    if (size == 0) { return true; }
+
+    auto &state = m_state[header.type];
+    if (state.size() == size && memcmp(state.data(), data, size) == 0) {
+        return false;
+    }
+    state.assign((const char*)data, (const char*)data + size);
+    return true;
+}
+
+void hwStateCache::invalidate(hwECommandType type)
+{
+    m_state[type].clear();
+}
+
+void hwStateCache::invalidateAll()
+{
+    for (auto &state : m_state) { state.clear(); }
+}
+
+// view space depth of p. view is Unity's worldToCameraMatrix as given to hwSetViewProjection() (column major, camera looks down -z)
+static float hwViewDepth(const hwMatrix &view, const hwFloat3 &p)
+{
+    return -(view._13 * p.x + view._23 * p.y + view._33 * p.z + view._43);
+}
+
+// 24 bit depth that keeps the order of non-negative floats. anything behind the camera is 0.
+static uint64_t hwQuantizeDepth(float depth)
+{
+    if (!(depth > 0.0f)) { return 0; }
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    return bits >> 8;
+}
+
+// stable LSD radix sort by key, 8 bits per pass. passes where every key has the same digit are skipped.
+static void hwRadixSort(std::vector<hwSortItem> &items, std::vector<hwSortItem> &tmp)
+{
+    if (items.size() < 2) { return; }
+
+    tmp.resize(items.size());
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t offsets[257] = {};
+        for (auto &i : items) { ++offsets[((i.key >> shift) & 0xFF) + 1]; }
+        if (offsets[((items[0].key >> shift) & 0xFF) + 1] == items.size()) { continue; }
+
+        for (int d = 0; d < 256; ++d) { offsets[d + 1] += offsets[d]; }
+        for (auto &i : items) { tmp[offsets[(i.key >> shift) & 0xFF]++] = i; }
+        items.swap(tmp);
+    }
+}
+
+// StateFirst:  [63-62 pass][61-46 shader][45-30 asset][29-6 depth]
+// BackToFront: [63-62 pass][61-38 inverted depth][37-22 shader][21-6 asset]
+// shadow draws (pass 0) go before color draws (pass 1).
+uint64_t hwContext::makeSortKey(const hwDrawItem &item, hwESortMode mode) const
+{
+    uint64_t pass = hwIsShadowCommand(item.draw->type) ? 0 : 1;
+
+    uint64_t shader = 0xFFFF;
+    if (auto *c = item.state.cmd[hwECommandType_SetShader]) {
+        shader = hwHandleIndex(((const hwCmdSetShader*)(c + 1))->hs) & 0xFFFF;
+    }
+
+    hwHInstance hi = item.hi;
+    uint64_t asset = 0xFFFF;
+    uint64_t depth = 0;
+    int si = m_render_store.find(hi);
+    if (si >= 0) {
+        asset = hwHandleIndex(m_render_store.assets[si]) & 0xFFFF;
+
+        auto *vp = item.state.cmd[hwECommandType_SetViewProjection];
+        if (vp && (m_render_store.flags[si] & hwEInstanceFlag_BoundsValid)) {
+            auto &b = m_render_store.bounds[si];
+            hwFloat3 center = { (b.bmin.x + b.bmax.x) * 0.5f, (b.bmin.y + b.bmax.y) * 0.5f, (b.bmin.z + b.bmax.z) * 0.5f };
+            depth = hwQuantizeDepth(hwViewDepth(((const hwCmdSetViewProjection*)(vp + 1))->view, center));
+        }
+    }
+
+    if (mode == hwESortMode_BackToFront) {
+        return (pass << 62) | ((~depth & 0xFFFFFF) << 38) | (shader << 22) | (asset << 6);
+    }
+    else {
+        return (pass << 62) | (shader << 46) | (asset << 30) | (depth << 6);
+    }
+}
+
+// applies the state commands that differ from what was applied last in this command list
+void hwContext::applyState(const hwDrawState &state)
+{
+    for (int t = 0; t < hwNumStateCommandTypes; ++t) {
+        auto *cmd = state.cmd[t];
+        if (cmd && cmd != m_applied_state[t]) {
+            m_applied_state[t] = cmd;
+            executeCommand(*cmd, cmd + 1);
+        }
+    }
+}
+
+void hwContext::executeDraws(const hwDrawState &last, hwESortMode mode)
+{
+    if (!m_draw_items.empty()) {
+        m_sort_items.resize(m_draw_items.size());
+        for (size_t i = 0; i < m_draw_items.size(); ++i) {
+            m_sort_items[i].key = makeSortKey(m_draw_items[i], mode);
+            m_sort_items[i].index = (uint32_t)i;
+        }
+        hwRadixSort(m_sort_items, m_sort_tmp);
+
+        // the sorted draws are executed as one batch: shared state is bound once, before the first color draw
+        bool began = false;
+        for (auto &s : m_sort_items) {
+            auto &item = m_draw_items[s.index];
+            applyState(item.state);
+            if (hwIsShadowCommand(item.draw->type)) {
+                renderShadowImpl(item.hi);
+            }
+            else {
+                if (!began) {
+                    beginDraws();
+                    began = true;
+                }
+                drawInstance(item.hi);
+            }
+        }
+        m_draw_items.clear();
+        ++m_draw_stamp;
+    }
+
+    // leave the state as it was recorded for whatever follows
+    applyState(last);
+}
+
+void hwContext::executeCommands(const hwCommandBuffer &commands, bool skip_draws)
+{
+    hwESortMode mode = m_sort_mode;
+    if (skip_draws || mode == hwESortMode_None) {
+        commands.each([this, skip_draws](const hwCommandHeader &header, const void *data) {
+            if (skip_draws && hwIsDrawCommand(header.type)) { return; }
+            executeCommand(header, data);
+        });
+        return;
+    }
+
+    // state commands only note what the following draws were recorded with. draws are collected, sorted and executed
+    // with their own state. other commands (simulation) execute the draws before them to keep their place.
+    // color draws are stamped with m_draw_stamp by instance, for SetInstanceEnvironment to find the ones it must not overtake.
+    auto add_draw = [this](const hwDrawItem &item) {
+        m_draw_items.push_back(item);
+        if (hwIsShadowCommand(item.draw->type)) { return; }
+        uint32_t i = hwHandleIndex(item.hi);
+        if (i >= m_draw_stamps.size()) { m_draw_stamps.resize(i + 1, 0); }
+        m_draw_stamps[i] = m_draw_stamp;
+    };
+    std::fill(m_applied_state, m_applied_state + hwNumStateCommandTypes, nullptr);
+    hwDrawState state = {};
+    bool used[hwNumStateCommandTypes] = {};
+    m_draw_items.clear();
+    commands.each([&](const hwCommandHeader &header, const void *data) {
+        if (header.type < hwNumStateCommandTypes) {
+            // overridden before any draw used it
+            if (state.cmd[header.type] && !used[header.type]) { ++m_commands_eliminated_current; }
+            state.cmd[header.type] = &header;
+            used[header.type] = false;
+        }
+        else if (hwIsDrawCommand(header.type)) {
+            if (header.type == hwECommandType_RenderBatch || header.type == hwECommandType_RenderShadowBatch) {
+                auto &c = *(const hwCmdRenderBatch*)data;
+                for (int i = 0; i < c.count; ++i) {
+                    hwDrawItem item = { state, &header, c.handles[i] };
+                    add_draw(item);
+                }
+            }
+            else {
+                hwDrawItem item = { state, &header, ((const hwCmdRender*)data)->hi };
+                add_draw(item);
+            }
+            std::fill(used, used + hwNumStateCommandTypes, true);
+        }
+        else if (header.type == hwECommandType_SetInstanceEnvironment) {
+            // only read by the instance's own color draws. the batch is only broken if one of them was collected
+            // before it: those must draw with the environment they were recorded with.
+            uint32_t i = hwHandleIndex(((const hwCmdSetInstanceEnvironment*)data)->hi);
+            if (i < m_draw_stamps.size() && m_draw_stamps[i] == m_draw_stamp) {
+                executeDraws(state, mode);
+                std::fill(used, used + hwNumStateCommandTypes, true);
+            }
+            executeCommand(header, data);
+        }
+        else {
+            executeDraws(state, mode);
+            std::fill(used, used + hwNumStateCommandTypes, true);
+            executeCommand(header, data);
+        }
+    });
+    executeDraws(state, mode);
+}
+
+void hwContext::executeCommand(const hwCommandHeader &header, const void *data)
+{
+    if (!m_state_cache.update(header, data)) {
+        ++m_commands_eliminated_current;
+        return;
+    }
+
+    switch (header.type) {
+    case hwECommandType_SetViewProjection: {
+        auto &c = *(const hwCmdSetViewProjection*)data;
+        setViewProjectionImpl(c.view, c.proj, c.fov);
+        break;
+    }
+    case hwECommandType_SetRenderTarget: {
+        auto &c = *(const hwCmdSetRenderTarget*)data;
+        setRenderTargetImpl(c.framebuffer, c.depthbuffer);
+        break;
+    }
+    case hwECommandType_SetShader:
+        setShaderImpl(((const hwCmdSetShader*)data)->hs);
+        break;
+    case hwECommandType_SetLights: {
+        auto &c = *(const hwCmdSetLights*)data;
+        setLightsImpl(c.num_lights, c.lights);
+        break;
+    }
+    case hwECommandType_SetSphericalHarmonics: {
+        auto &c = *(const hwCmdSetSphericalHarmonics*)data;
+        setSphericalHarmonicsImpl(c.Ar, c.Ag, c.Ab, c.Br, c.Bg, c.Bb, c.C);
+        break;
+    }
+    case hwECommandType_SetGIParameters:
+        setGIParametersImpl(((const hwCmdSetGIParameters*)data)->params);
+        break;
+    case hwECommandType_SetReflectionProbe: {
+        auto &c = *(const hwCmdSetReflectionProbe*)data;
+        setReflectionProbeImpl(c.tex1, c.tex2);
+        break;
+    }
+    case hwECommandType_Render:
+        renderImpl(((const hwCmdRender*)data)->hi);
+        break;
+    case hwECommandType_RenderShadow:
+        renderShadowImpl(((const hwCmdRender*)data)->hi);
+        break;
+    case hwECommandType_StepSimulation:
+        stepSimulationImpl(((const hwCmdStepSimulation*)data)->dt);
+        break;
+    case hwECommandType_RenderBatch: {
+        auto &c = *(const hwCmdRenderBatch*)data;
+        renderBatchImpl(c.count, c.handles);
+        break;
+    }
+    case hwECommandType_RenderShadowBatch: {
+        auto &c = *(const hwCmdRenderBatch*)data;
+        renderShadowBatchImpl(c.count, c.handles);
+        break;
+    }
+    case hwECommandType_SetInstanceEnvironment: {
+        auto &c = *(const hwCmdSetInstanceEnvironment*)data;
+        instanceSetEnvironmentImpl(c.hi, c.env);
+        break;
+    }
+    default:
+        hwLog("hwContext::executeCommand(): unknown command %d\n", header.type);
+        break;
+    }
+}
+
+// the bound pixel shader and the viewport (read by setViewProjectionImpl()) may have been changed by Unity between flushes.
+// lights, SH and GI only live in m_frame_cb and stay valid.
+void hwContext::beginExecuteFrame(int frame)
+{
+    m_state_cache.invalidate(hwECommandType_SetShader);
+    m_state_cache.invalidate(hwECommandType_SetViewProjection);
+
+    if (frame != m_stats_frame) {
+        if (m_stats_frame != -1) {
+            m_commands_eliminated = m_commands_eliminated_current;
+            m_bytes_uploaded = m_bytes_uploaded_current;
+            m_instances_culled = m_instances_culled_current;
+            m_shader_fallbacks = m_shader_fallbacks_current;
+        }
+        m_stats_frame = frame;
+        m_commands_eliminated_current = 0;
+        m_bytes_uploaded_current = 0;
+        m_instances_culled_current = 0;
+        m_shader_fallbacks_current = 0;
+        m_render_views.trim();
+    }
+}
+
+// the game thread's store and shader programs go to the render thread whole. they only change when instances or
+// shaders are created, released or reloaded, or instance flags change, so most submits don't copy anything.
+void hwContext::publishRenderState()
+{
+    if (m_instance_store.changed) {
+        m_published_stores.back() = m_instance_store;
+        m_published_stores.publish();
+        m_instance_store.changed = false;
+    }
+    if (m_shader_programs_changed) {
+        m_published_shaders.back() = m_shader_programs;
+        m_published_shaders.publish();
+        m_shader_programs_changed = false;
+    }
+}
+
+void hwContext::collectRenderState()
+{
+    if (m_published_stores.acquire()) {
+        m_render_store.merge(m_published_stores.front());
+    }
+    m_published_shaders.acquire();
+}
+
+const hwShaderPrograms* hwContext::findShaderPrograms(hwHShader hs) const
+{
+    auto &programs = m_published_shaders.front();
+    uint32_t i = hwHandleIndex(hs);
+    if (hs == hwNullHandle || i >= programs.size() || programs[i].handle != hs) { return nullptr; }
+    return &programs[i];
+}
+
+// the game thread never waits for the render thread: what doesn't fit in the queue is kept and handed off with the next frame.
+// until then it is the same as retired in the frame it is handed off in, which is later, so that's safe.
+void hwContext::retire(const hwRetiredObject &r)
+{
+    if (!m_retired_pending.empty() || !m_retired.push(r)) {
+        m_retired_pending.push_back(r);
+    }
+}
+
+void hwContext::retire(ID3D11DeviceChild *object)
+{
+    if (!object) { return; }
+    hwRetiredObject r = { hwERetired_Object, m_recording_frame, object, hwNullAssetID, hwNullInstanceID, hwNullHandle };
+    retire(r);
+}
+
+void hwContext::retireAsset(hwAssetID aid)
+{
+    if (aid == hwNullAssetID) { return; }
+    hwRetiredObject r = { hwERetired_Asset, m_recording_frame, nullptr, aid, hwNullInstanceID, hwNullHandle };
+    retire(r);
+}
+
+void hwContext::retireInstance(hwInstanceID iid)
+{
+    if (iid == hwNullInstanceID) { return; }
+    hwRetiredObject r = { hwERetired_Instance, m_recording_frame, nullptr, hwNullAssetID, iid, hwNullHandle };
+    retire(r);
+}
+
+// views acquired from m_render_views are released into it by the render thread
+void hwContext::releaseRenderView(hwSRV *srv)
+{
+    if (!srv) { return; }
+    hwRetiredObject r = { hwERetired_RenderView, m_recording_frame, srv, hwNullAssetID, hwNullInstanceID, hwNullHandle };
+    retire(r);
+}
+
+void hwContext::handOffRetired()
+{
+    size_t n = 0;
+    while (n < m_retired_pending.size() && m_retired.push(m_retired_pending[n])) { ++n; }
+    m_retired_pending.erase(m_retired_pending.begin(), m_retired_pending.begin() + n);
+}
+
+void hwContext::collectRetired()
+{
+    hwRetiredObject r;
+    while (m_retired.pop(r)) {
+        m_retired_waiting.push_back(r);
+    }
+}
+
+// called at the end of a flush. pages recorded before an object was retired can still be submitted after it, up to
+// the next beginFrame(). once the render thread has flushed or taken a page of a later frame, every page of the
+// object's frame has been taken, and executed as it isn't the frame being flushed: the object can go.
+// without beginFrame() (flush() only) frames don't advance, and what is retired waits for finalize().
+void hwContext::releaseRetired(bool all)
+{
+    size_t n = 0;
+    for (auto &r : m_retired_waiting) {
+        if (!all && hwFrameDiff(r.frame & hwFrameIndexMask, m_newest_frame) >= 0) {
+            m_retired_waiting[n++] = r;
+        }
+        else {
+            releaseObject(r);
+        }
+    }
+    m_retired_waiting.resize(n);
+}
+
+void hwContext::releaseObject(const hwRetiredObject &r)
+{
+    switch (r.type) {
+    case hwERetired_Object:
+        m_backend->release(r.object);
+        break;
+    case hwERetired_Asset:
+        if (!NV_SUCCEEDED(m_backend->freeAsset(r.aid))) {
+            hwLog("GFSDK_HairSDK::FreeHairAsset(%d) failed.\n", r.aid);
+        }
+        break;
+    case hwERetired_Instance:
+        if (!NV_SUCCEEDED(m_backend->freeInstance(r.iid))) {
+            hwLog("GFSDK_HairSDK::FreeHairInstance(%d) failed.\n", r.iid);
+        }
+        break;
+    case hwERetired_RenderView:
+        m_render_views.release(static_cast<hwSRV*>(r.object));
+        break;
+    case hwERetired_Environment: {
+        auto it = m_instance_envs.find(r.hi);
+        if (it == m_instance_envs.end()) { break; }
+        for (auto srv : it->second.probes) { m_render_views.release(srv); }
+        m_instance_envs.erase(it);
+        break;
+    }
+    }
 }
 
 void hwContext::flush()
 {
-	{
-		std::unique_lock<std::mutex> lock(m_mutex);
-		m_commands_back = m_commands;
-		m_commands.clear();
-	}
+    if (m_capture.active()) {
+        hwCapFlush r = { 0, 0, 1 };
+        m_capture.write(hwECaptureRecord_Flush, m_capture.now(), &r, sizeof(r));
+    }
+	m_backend->setDepthStencil(m_rs_enable_depth);
+    beginExecuteFrame(m_stats_frame + 1); // every flush() counts as a frame of its own
+
+    collectRetired();
+    int page;
+    while (m_submitted_pages.pop(page)) {
+        m_pending_pages.push_back(page);
+        if (hwFrameDiff(m_command_pages[page].frame, m_newest_frame) > 0) { m_newest_frame = m_command_pages[page].frame & hwFrameIndexMask; }
+    }
+    collectRenderState();
 
-	m_d3dctx->OMSetDepthStencilState(m_rs_enable_depth, 0);
-    for (auto& c : m_commands_back) {
-        c();
+    for (int page : m_pending_pages) {
+        auto &commands = m_command_pages[page].commands;
+        executeCommands(commands);
+        commands.clear();
+        m_free_pages.push(page);
+    }
+    m_pending_pages.clear();
+    releaseRetired(false);
+}
+
+// returns true if the page is done with and can be recycled
+bool hwContext::executePendingPage(int page, int frame, int view)
+{
+    auto &p = m_command_pages[page];
+    int diff = hwFrameDiff(p.frame, frame);
+    if (diff == 0) {
+        // shared pages (simulation) run once, at the first flush of the frame
+        if (p.view != view && p.view != hwSharedView) { return false; }
+
+        executeCommands(p.commands);
+        if (frame != m_last_executed_frame) {
+            m_last_executed_frame = frame;
+            ++m_frames_executed;
+        }
     }
-    m_commands_back.clear();
+    else if (diff < 0) {
+        // older frame: its flush never came, or came before the page was submitted
+        handleStaleCommands(p.commands, p.frame != m_last_stale_frame);
+        m_last_stale_frame = p.frame;
+        executeCommands(p.commands);
+    }
+    else {
+        return false;
+    }
+    return true;
 }
 
+void hwContext::flush(int frame, int view)
+{
+    // called on the render thread, so don't touch the recording page (captureCall()) from here
+    if (m_capture.active()) {
+        hwCapFlush r = { frame, view, 0 };
+        m_capture.write(hwECaptureRecord_Flush, m_capture.now(), &r, sizeof(r));
+    }
+	m_backend->setDepthStencil(m_rs_enable_depth);
+    beginExecuteFrame(frame);
+
+    // take everything submitted up to this frame. pages recorded for a later frame stay in the queue.
+    collectRetired();
+    if (hwFrameDiff(frame, m_newest_frame) > 0) { m_newest_frame = frame & hwFrameIndexMask; }
+    int page;
+    while (m_submitted_pages.peek(page) && hwFrameDiff(m_command_pages[page].frame, frame) <= 0) {
+        m_submitted_pages.pop(page);
+        m_pending_pages.push_back(page);
+    }
+    collectRenderState();
+
+    // execute in submission order. pages of other views of this frame stay pending until their own flush.
+    size_t n = 0;
+    for (int page : m_pending_pages) {
+        if (executePendingPage(page, frame, view)) {
+            m_command_pages[page].commands.clear();
+            m_free_pages.push(page);
+        }
+        else {
+            m_pending_pages[n++] = page;
+        }
+    }
+    m_pending_pages.resize(n);
+    releaseRetired(false);
+}
@@ -1,40 +1,219 @@
 ﻿#pragma once
+#include "hwCommandBuffer.h"
+#include "hwSPSCQueue.h"
+#include "hwTripleBuffer.h"
+#include "hwCapture.h"
+#include "hwStateObjectCache.h"
+#include "hwViewCache.h"
+#include "hwHandlePool.h"
+#include "hwPathRegistry.h"
+#include "hwInstanceStore.h"
+#include "hwWorkerPool.h"
+#include "hwAssetCache.h"
+#include "hwReadStream.h"
+#include "hwFileWatcher.h"
+
+#define hwNumCommandPages   16
+#define hwMaxRetiredObjects 1024 // objects the game thread can hand to the render thread per frame before it keeps them for the next
+
+struct hwAssetLoadJob;
+
+// what the game thread is done with but the render thread may still be using: it reads shaders, asset and
+// instance IDs and views as it executes. the render thread releases them itself, once it has passed the frame
+// they were retired in (see hwContext::releaseRetired()).
+enum hwERetired
+{
+    hwERetired_Object,      // backend object (pixel shader, view)
+    hwERetired_Asset,       // SDK asset
+    hwERetired_Instance,    // SDK instance
+    hwERetired_RenderView,  // view acquired from the render thread's view cache
+    hwERetired_Environment, // environment of a released instance (see hwContext::m_instance_envs)
+};
+
+struct hwRetiredObject
+{
+    hwERetired          type;
+    int                 frame;  // hwBeginFrame() frame it was retired in
+    ID3D11DeviceChild  *object; // Object, RenderView
+    hwAssetID           aid;    // Asset
+    hwInstanceID        iid;    // Instance
+    hwHInstance         hi;     // Environment
+};
+
+// features of DefaultHairShader.hlsl a draw uses. the shader's variants are compiled with a subset of them and leave out
+// the code of the others. must match HW_FEATURE_* there.
+enum hwEShaderFeature
+{
+    hwEShaderFeature_Lights             = 1 << 0,
+    hwEShaderFeature_ManyLights         = 1 << 1,   // more than one
+    hwEShaderFeature_LocalLights        = 1 << 2,   // point or spot lights
+    hwEShaderFeature_Shadows            = 1 << 3,
+    hwEShaderFeature_Probes             = 1 << 4,
+    hwEShaderFeature_Glint              = 1 << 5,
+    hwEShaderFeature_SpecularTexture    = 1 << 6,
+    hwEShaderFeature_All                = (1 << 7) - 1, // the uber shader
+};
+#define hwNumShaderVariants     (hwEShaderFeature_All + 1)
+#define hwNumShaderVariantFiles 8   // the variants Shaders/DefaultHairShader_fXX.hlsl build (see hwShaderVariantFiles)
 
 struct hwShaderData
 {
     hwHShader handle;
     int ref_count;
-    ID3D11PixelShader *shader;
+    ID3D11PixelShader *shader;      // shared with the other shaders of the same contents
     std::string path;
-
-    hwShaderData() : handle(hwNullHandle), ref_count(0), shader(nullptr) {}
-    void invalidate() { ref_count = 0; shader = nullptr; path.clear(); }
+    uint64_t content_key;           // into hwContext::m_shader_contents
+    std::shared_ptr<hwAssetLoadJob> reload_job; // the file being read for a reload. shader stays in use until then
+    // by hwEShaderFeature bits: the variant with the fewest features that has them all. null: none has, draws use shader
+    ID3D11PixelShader *variants[hwNumShaderVariants];
+    std::vector<ID3D11PixelShader*> variant_shaders; // owned. the ones above
+    bool has_variants;              // variant_shaders isn't empty
+    bool legacy_constants;          // shader reads hwLegacyConstantBuffer
+
+    hwShaderData() : handle(hwNullHandle), ref_count(0), shader(nullptr), content_key(0), variants(), has_variants(false), legacy_constants(false) {}
     operator bool() const { return shader != nullptr; }
 };
 
+// what the render thread draws a shader with. the game thread keeps a copy of each shader's in m_shader_programs and
+// publishes them with the instance store, so that the render thread never reads m_shaders. replaced pixel shaders are
+// retired, so the render thread's copy stays usable until it takes the next one.
+struct hwShaderPrograms
+{
+    hwHShader handle = hwNullHandle;    // hwNullHandle: no shader in this slot
+    ID3D11PixelShader *shader = nullptr;
+    ID3D11PixelShader *variants[hwNumShaderVariants] = {}; // as hwShaderData::variants
+    bool has_variants = false;
+    bool legacy_constants = false;
+};
+
+enum hwEAssetStatus
+{
+    hwEAssetStatus_Invalid,     // not an asset handle, or released
+    hwEAssetStatus_Loading,
+    hwEAssetStatus_Ready,
+    hwEAssetStatus_Failed,
+};
+
+// parsed source of an asset file, shared by the assets of the file that have different conversion settings.
+// the SDK creates each of them from it with its own settings (see hwMakeAssetDescriptor()), so the file is read and
+// parsed once for all of them. built by the first load of the file, on its worker, from the bytes it has read.
+// the other loads wait for it, and don't read the file: they match the first until they are reloaded.
+// the default descriptor of the first asset is taken for the others, which assumes the SDK's default descriptor
+// doesn't depend on the conversion settings.
+struct hwAssetSource
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool built = false;         // under mutex. cooked and source_hash don't change after that
+    std::string cooked;         // hwCookAsset() of the file, or its cooked asset from the cache. empty if it can't be read
+    uint64_t source_hash = 0;   // of the file it was built from
+    bool has_desc = false;      // game thread. set once the first asset is created
+    hwHairDescriptor desc;      //
+};
+
+// file read of an asset load or reload. shared by the asset and the worker that reads it, if it is asynchronous.
+// loads from memory start out Read, with data pointing at the caller's bytes. shader reloads use it too, without a cache.
+// source_hash is the content hash of shaders.
+struct hwAssetLoadJob
+{
+    enum State { Queued, Reading, Read, Failed };
+
+    std::string path;
+    uint64_t cache_tag = 0;
+    hwAssetCache cache;
+    std::shared_ptr<hwMappedFile> file; // the cooked asset if cooked, the APX file otherwise
+    const char *data = nullptr;         // file's bytes, or the caller's
+    size_t size = 0;
+    bool cooked = false;
+    uint64_t source_hash = 0;           // hwHashContent() of the APX. taken from the header if cooked
+    uint64_t source_size = 0;           //
+    uint64_t geometry_hash = 0;         // hwApxSectionHashes::geometry of the APX. 0: unknown
+    std::shared_ptr<hwAssetSource> source; // used if the cache has no cooked asset for cache_tag
+    bool build_source = false;          // the first load of the file: builds source from what it reads
+    std::atomic<int> state = { Queued };
+};
+
+struct hwAssetLoadWaiter
+{
+    hwAssetLoadCallback cb;
+    void *userdata;
+};
+
 struct hwAssetData
 {
     hwHAsset handle;
     int ref_count;
-    hwAssetID aid;
+    hwAssetID aid;                              // shared with the other assets of the same contents and settings
     std::string path;
     hwConversionSettings settings;
-
-    hwAssetData() : handle(hwNullHandle), aid(hwNullAssetID), ref_count(0) {}
-    void invalidate() { ref_count = 0; aid = hwNullAssetID; path.clear(); }
+    uint64_t content_key;                       // into hwContext::m_asset_contents
+    uint64_t source_hash;                       // of the file as last loaded or reloaded (see hwAssetLoadJob)
+    uint64_t geometry_hash;                     //
+    int revision;                               // reloads swapped in so far. scripts take the new default descriptor when it changes
+    std::shared_ptr<hwAssetSource> source;      // of its file, shared with the assets of the file with other settings. freed with the last of them
+    hwEAssetStatus status;
+    std::shared_ptr<hwAssetLoadJob> job;        // while status is hwEAssetStatus_Loading
+    std::vector<hwAssetLoadWaiter> waiters;     // called when the load is done
+    std::shared_ptr<hwAssetLoadJob> reload_job; // the file being read for a reload. aid stays in use until then
+    // assets created from a cooked asset take their default instance descriptor from it instead of the SDK
+    bool has_default_desc;
+    hwHairDescriptor default_desc;
+
+    hwAssetData() : handle(hwNullHandle), aid(hwNullAssetID), ref_count(0), content_key(0), source_hash(0), geometry_hash(0), revision(0), status(hwEAssetStatus_Invalid),
+        has_default_desc(false), default_desc() {}
     operator bool() const { return aid != hwNullAssetID; }
 };
 
+// SDK assets and pixel shaders by the hash of the bytes they were made of, so that the same file copied to several
+// places or reached through different paths is created once. ref_count: handles using it.
+// size is compared on lookups too, a hash collision alone doesn't make two files the same.
+struct hwAssetContent
+{
+    hwAssetID aid;
+    int ref_count;
+    uint64_t size;              // of the APX
+    bool has_default_desc;
+    hwHairDescriptor default_desc;
+};
+
+struct hwShaderContent
+{
+    ID3D11PixelShader *shader;
+    int ref_count;
+    uint64_t size;
+};
+
+// lighting environment of an instance: light probe SH, GI parameters and the pair of reflection probes it blends.
+// must match Hwi.Environment.
+struct hwEnvironmentData
+{
+    hwFloat4 shAr, shAg, shAb, shBr, shBg, shBb, shC;
+    hwFloat4 gi_params; // x: light probe intensity y: reflection probe intensity z: specular strength w: probe blend amount
+    ID3D11Resource *probe1;
+    ID3D11Resource *probe2;
+};
+
+// environment given to an instance with instanceSetEnvironment(). only the render thread sets and reads it.
+// an instance without one is lit by the context's environment.
+struct hwInstanceEnvironment
+{
+    hwEnvironmentData env = {};
+    hwSRV *probes[2] = {};  // views of env.probe1/2, acquired from the render thread's view cache
+};
+
 struct hwInstanceData
 {
     hwHInstance handle;
     hwInstanceID iid;
     hwHAsset hasset;
-    bool cast_shadow;
-    bool receive_shadow;
-
-    hwInstanceData() : handle(hwNullHandle), iid(hwNullInstanceID), hasset(hwNullHandle), cast_shadow(false), receive_shadow(false) {}
-    void invalidate() { iid = hwNullInstanceID; hasset = hwNullAssetID; cast_shadow = false; receive_shadow = false; }
+    uint32_t index;     // into hwContext::m_instance_store
+    hwSRV *textures[NvHair::TextureType::COUNT_OF]; // acquired from the view cache
+    // an instance of an asset that is still loading has no iid yet. the last descriptor set is applied once it is created.
+    bool has_pending_desc;
+    hwHairDescriptor pending_desc;
+
+    hwInstanceData() : handle(hwNullHandle), iid(hwNullInstanceID), hasset(hwNullHandle), index(0), textures(),
+        has_pending_desc(false), pending_desc() {}
     operator bool() const { return iid != hwNullInstanceID; }
 };
 
@@ -62,7 +241,17 @@ struct hwLightData
     {}
 };
 
-struct hwConstantBuffer
+// constant buffers of the hair pixel shader. must match cbPerFrame and cbPerInstance in DefaultHairShader.hlsl.
+// each is uploaded only when its contents changed.
+struct hwFrameConstantBuffer
+{
+    int num_lights; int pad0[3];
+    hwLightData lights[hwMaxLights];
+
+    hwFrameConstantBuffer() : num_lights(0) {}
+};
+
+struct hwInstanceConstantBuffer
 {
 	//Spherical Harmonics
 	hwFloat4 shAr;
@@ -76,12 +265,123 @@ struct hwConstantBuffer
 	//GI Parameters
 	hwFloat4 gi_params;
 
-	
+	NvHair::ShaderConstantBuffer hw;
+};
+
+// the single cbPerFrame (b0) of shaders built before the constants were split into the two buffers above,
+// like the DefaultHairShader.cso that ships with the plugin. uploaded whole when it changes.
+struct hwLegacyConstantBuffer
+{
+    hwFloat4 shAr, shAg, shAb, shBr, shBg, shBb, shC;
+    hwFloat4 gi_params;
     int num_lights; int pad0[3];
     hwLightData lights[hwMaxLights];
-	NvHair::ShaderConstantBuffer hw;
+    NvHair::ShaderConstantBuffer hw;
+};
 
-    hwConstantBuffer() : num_lights(0) {}
+// deferred command records. recorded by the game thread into hwCommandBuffer and decoded in hwContext::flush().
+enum hwECommandType
+{
+    hwECommandType_SetViewProjection,
+    hwECommandType_SetRenderTarget,
+    hwECommandType_SetShader,
+    hwECommandType_SetLights,
+    hwECommandType_SetSphericalHarmonics,
+    hwECommandType_SetGIParameters,
+    hwECommandType_SetReflectionProbe,
+    hwECommandType_Render,
+    hwECommandType_RenderShadow,
+    hwECommandType_StepSimulation,
+    hwECommandType_RenderBatch,
+    hwECommandType_RenderShadowBatch,
+    hwECommandType_SetInstanceEnvironment,
+};
+
+struct hwCmdSetViewProjection   { hwMatrix view; hwMatrix proj; float fov; };
+struct hwCmdSetRenderTarget     { hwTexture *framebuffer; hwTexture *depthbuffer; };
+struct hwCmdSetShader           { hwHShader hs; };
+struct hwCmdSetLights           { int num_lights; int pad[3]; hwLightData lights[1]; }; // variable length: lights[num_lights]
+struct hwCmdSetSphericalHarmonics { hwFloat4 Ar, Ag, Ab, Br, Bg, Bb, C; };
+struct hwCmdSetGIParameters     { hwFloat4 params; };
+struct hwCmdSetReflectionProbe  { ID3D11Resource *tex1; ID3D11Resource *tex2; };
+struct hwCmdRender              { hwHInstance hi; };
+struct hwCmdStepSimulation      { float dt; };
+struct hwCmdRenderBatch         { int count; int pad; hwHInstance handles[1]; }; // variable length: handles[count]
+struct hwCmdSetInstanceEnvironment { hwHInstance hi; int pad; hwEnvironmentData env; };
+#define hwNumStateCommandTypes  (hwECommandType_SetReflectionProbe + 1) // commands before Render only set state
+
+// the state a draw was recorded with: the latest state command of each type before it
+struct hwDrawState  { const hwCommandHeader *cmd[hwNumStateCommandTypes]; };
+struct hwDrawItem   { hwDrawState state; const hwCommandHeader *draw; hwHInstance hi; }; // hi: the instance, also for batches
+struct hwSortItem   { uint64_t key; uint32_t index; };
+
+// order of the draws of a submitted command list (see hwContext::makeSortKey())
+enum hwESortMode
+{
+    hwESortMode_None,           // as recorded
+    hwESortMode_StateFirst,     // pass, shader, asset, then front to back. fewest state changes and best early depth rejection
+    hwESortMode_BackToFront,    // pass, then back to front. correct order for blended hair
+};
+
+// a submitted batch of commands, stamped with the frame and the view (camera) it was recorded for
+struct hwCommandPage
+{
+    hwCommandBuffer commands;
+    int frame;
+    int view;
+
+    hwCommandPage() : frame(0), view(hwSharedView) {}
+};
+
+// what to do with commands of frames that were never flushed (render thread fell behind or skipped a camera)
+enum hwEStaleFramePolicy
+{
+    hwEStaleFramePolicy_Drop,       // discard them entirely
+    hwEStaleFramePolicy_Coalesce,   // apply their state and simulation commands, skip their draws
+};
+
+// last state applied by flush(), to drop state commands that wouldn't change it
+class hwStateCache
+{
+public:
+    // returns false if the command sets exactly what is already set
+    bool update(const hwCommandHeader &header, const void *data);
+    void invalidate(hwECommandType type);
+    void invalidateAll();
+
+private:
+    std::vector<char> m_state[hwNumStateCommandTypes];
+};
+
+struct hwStats
+{
+    int frames_executed;
+    int frames_dropped;
+    int frames_coalesced;
+    int commands_eliminated;    // redundant state commands dropped in the last frame
+    int bytes_uploaded;         // constant buffer bytes uploaded in the last frame
+    int views;                  // SRVs/RTVs alive in the view caches of both threads, as of their last frame
+    int views_referenced;       // ones of them in use
+    int views_created;
+    int views_evicted;
+    int view_cache_memory;      // bytes
+    int shaders;                // alive
+    int assets;                 //
+    int instances;              //
+    int handle_slots;           // slots of the shader, asset and instance pools, used or free
+    int handles_allocated;      // since initialize()
+    int handles_freed;          //
+    int stale_handles;          // calls made with the handle of a released object
+    int instances_culled;       // draws skipped in the last frame because the instance was outside the view frustum
+    int dedup_hits;             // shader and asset loads that shared the contents of another file, since initialize()
+    int dedup_bytes_saved;      // file bytes of the shaders and assets alive that share another one's contents
+    int shader_variants;        // alive (see hwEShaderFeature)
+    int shader_fallbacks;       // draws in the last frame with a shader that has variants but none that covered them. they used the uber shader
+
+    hwStats() : frames_executed(0), frames_dropped(0), frames_coalesced(0), commands_eliminated(0), bytes_uploaded(0),
+        views(0), views_referenced(0), views_created(0), views_evicted(0), view_cache_memory(0),
+        shaders(0), assets(0), instances(0), handle_slots(0), handles_allocated(0), handles_freed(0), stale_handles(0), instances_culled(0),
+        dedup_hits(0), dedup_bytes_saved(0), shader_variants(0), shader_fallbacks(0) {}
 };
 
 struct hwShadowParamBuffer
@@ -108,16 +408,37 @@ public:
     bool valid() const;
 
     bool initialize(hwDevice *d3d_device);
+    // takes ownership of backend. the null backend lets everything above the GPU and the SDK run headless.
+    bool initialize(hwBackend *backend);
     void finalize();
     void move(hwContext &from);
 
     hwHShader       shaderLoadFromFile(const std::string &path);
+    // data is only read during the call. shaders from memory can't be reloaded
+    hwHShader       shaderLoadFromMemory(const void *data, size_t size);
     void            shaderRelease(hwHShader hs);
+    // reloads are double-buffered: the file is read by a worker, and what is made of it replaces the loaded shader or
+    // asset at the next beginFrame() that starts a frame, only if it could be made. the loaded one is used until then,
+    // and kept if the reload fails. instances are recreated against a reloaded asset with their descriptor and textures.
     void            shaderReload(hwHShader hs);
 
     hwHAsset        assetLoadFromFile(const std::string &path, const hwConversionSettings *conv);
+    // returns a handle right away. the file is read by a worker and the asset is created by the game thread
+    // in beginFrame() or assetGetStatus() after that. cb (may be null) is called there, or right away if the asset
+    // is already loaded. instances created before then start rendering once it is.
+    hwHAsset        assetLoadFromFileAsync(const std::string &path, const hwConversionSettings *conv, hwAssetLoadCallback cb, void *userdata);
+    // data may be an APX or a cooked asset, and is only read during the call. shares the SDK asset of loads of the
+    // same contents like any load, but can't be reloaded
+    hwHAsset        assetLoadFromMemory(const void *data, size_t size, const hwConversionSettings *conv);
+    hwEAssetStatus  assetGetStatus(hwHAsset ha);
+    void            setAssetCacheDirectory(const std::string &dir);
+    bool            assetCook(const std::string &path, const hwConversionSettings *conv); // into the cache directory
+    // reloads the shaders and assets loaded from files when the files are written
+    void            setFileWatching(bool enabled);
     void            assetRelease(hwHAsset ha);
+    // a reload of a file whose geometry is the same only updates the default descriptor and the instances' descriptors
     void            assetReload(hwHAsset ha);
+    int             assetGetRevision(hwHAsset ha) const;
     int             assetGetNumBones(hwHAsset ha) const;
     const char*     assetGetBoneName(hwHAsset ha, int nth) const;
     void            assetGetBoneIndices(hwHAsset ha, hwFloat4 &o_indices) const;
@@ -131,6 +452,7 @@ public:
     void            instanceGetDescriptor(hwHInstance hi, hwHairDescriptor &desc) const;
     void            instanceSetDescriptor(hwHInstance hi, const hwHairDescriptor &desc);
     void            instanceSetTexture(hwHInstance hi, hwTextureType type, hwTexture *tex);
+    void            instanceSetEnvironment(hwHInstance hi, const hwEnvironmentData &env); // deferred like render()
     void            instanceUpdateSkinningMatrices(hwHInstance hi, int num_bones, hwMatrix *matrices);
     void            instanceUpdateSkinningDQs(hwHInstance hi, int num_bones, hwDQuaternion *dqs);
 
@@ -148,16 +470,74 @@ public:
 	void setReflectionProbe(ID3D11Resource *tex1, ID3D11Resource *tex2);
     void render(hwHInstance hi);
     void renderShadow(hwHInstance hi);
+    void renderBatch(int count, const hwHInstance *handles);
+    void renderShadowBatch(int count, const hwHInstance *handles);
     void stepSimulation(float dt);
-    void flush();
+    void beginFrame(int frame);
+    void submit(int view);
+    void setStaleFramePolicy(hwEStaleFramePolicy policy);
+    void setSortMode(hwESortMode mode);
+    void getStats(hwStats &o_stats) const;
+    void getBackendStats(hwBackendStats &o_stats) const;
+    void flush();                   // executes everything submitted so far
+    void flush(int frame, int view);// executes what was submitted for view (and hwSharedView) in frame. older frames are handled by the stale frame policy
+
+    bool captureBegin(const std::string &path);
+    void captureEnd();
 
 private:
-    hwShaderData&   newShaderData();
-    hwAssetData&    newAssetData();
-    hwInstanceData& newInstanceData();
-
-    typedef std::function<void()> DeferredCall;
-    void pushDeferredCall(const DeferredCall &c);
+    hwHShader       loadShader(const std::string &path);
+    hwHShader       createShader(const std::string &path, const void *data, size_t size);
+    bool            createShaderShared(hwShaderData &v, const void *data, size_t size);
+    void            startShaderReload(hwShaderData &v);
+    void            swapShader(hwShaderData &v, hwAssetLoadJob &job);
+    void            loadShaderVariants(hwShaderData &v);
+    void            releaseShaderVariants(hwShaderData &v);
+    hwHAsset        loadAsset(const std::string &path, const hwConversionSettings &settings, bool async = false);
+    hwHAsset        loadAssetFromMemory(const void *data, size_t size, const hwConversionSettings &settings);
+    void            collectAssetLoads();
+    void            finishAssetLoad(hwAssetData &v);
+    bool            createAssetShared(hwAssetData &v, hwAssetLoadJob &job);
+    bool            createAssetSDK(hwAssetData &v, hwAssetLoadJob &job);
+    void            releaseAsset(hwHAsset ha);  // assetRelease() without the capture
+    void            releaseAssetContent(hwAssetData &v);
+    void            releaseShaderContent(hwShaderData &v);
+    void            startAssetReload(hwAssetData &v);
+    void            swapAsset(hwAssetData &v, hwAssetLoadJob &job);
+    bool            swapAssetMaterial(hwAssetData &v, hwAssetLoadJob &job);
+    void            registerAssetSource(hwAssetData &v);
+    void            collectReloads();
+    void            pollFileWatcher();
+    bool            createInstanceSDK(hwInstanceData &v, const hwAssetData &a);
+    void            initInstanceSDK(hwInstanceData &v, const hwAssetData &a);
+    void            freeInstanceSlot(hwInstanceData &v);
+
+    template<class T> T* pushCommand(hwECommandType type, size_t extra = 0);
+    void submitCommands(int view);
+    bool executePendingPage(int page, int frame, int view);
+    void executeCommands(const hwCommandBuffer &commands, bool skip_draws = false);
+    void executeCommand(const hwCommandHeader &header, const void *data);
+    void executeDraws(const hwDrawState &last, hwESortMode mode);
+    void applyState(const hwDrawState &state);
+    uint64_t makeSortKey(const hwDrawItem &item, hwESortMode mode) const;
+    void beginExecuteFrame(int frame);
+    void updateShaderPrograms(const hwShaderData &v);  // game thread
+    void publishRenderState();              // game thread
+    void collectRenderState();              // render thread
+    const hwShaderPrograms* findShaderPrograms(hwHShader hs) const; // render thread
+    void retire(const hwRetiredObject &r);  // game thread
+    void retire(ID3D11DeviceChild *object); //
+    void retireAsset(hwAssetID aid);        //
+    void retireInstance(hwInstanceID iid);  //
+    void releaseRenderView(hwSRV *srv);     //
+    void handOffRetired();                  //
+    void collectRetired();                  // render thread
+    void releaseRetired(bool all);          // render thread
+    void releaseObject(const hwRetiredObject &r);
+    ID3D11DepthStencilState* getDepthState(bool reversed_z);
+    void handleStaleCommands(hwCommandBuffer &commands, bool count_frame);
+    void captureCommands();
+    template<class T> void captureCall(hwECaptureRecord type, const T &data, const void *extra = nullptr, size_t extra_size = 0);
     void setViewProjectionImpl(const hwMatrix &view, const hwMatrix &proj, float fov);
     void setRenderTargetImpl(hwTexture *framebuffer, hwTexture *depthbuffer);
     void setShaderImpl(hwHShader hs);
@@ -165,51 +545,130 @@ private:
 	void setSphericalHarmonicsImpl(const hwFloat4 &Ar, const hwFloat4 &Ag, const hwFloat4 &Ab, const hwFloat4 &Br, const hwFloat4 &Bg, const hwFloat4 &Bb, const hwFloat4 &C);
 	void setGIParametersImpl(const hwFloat4 &Params);
 	void setReflectionProbeImpl(ID3D11Resource *tex1, ID3D11Resource *tex2);
+    void instanceSetEnvironmentImpl(hwHInstance hi, const hwEnvironmentData &env);
+    void updateEnvironment(hwEnvironmentData &dst, hwSRV *(&probes)[2], const hwEnvironmentData &src);
     void renderImpl(hwHInstance hi);
     void renderShadowImpl(hwHInstance hi);
+    void renderBatchImpl(int count, const hwHInstance *handles);
+    void renderShadowBatchImpl(int count, const hwHInstance *handles);
+    void beginDraws();
+    void drawInstance(hwHInstance hi);
+    uint32_t shaderFeatures(uint32_t flags, hwSRV *const *probes) const;
     void stepSimulationImpl(float dt);
-    hwSRV* getSRV(hwTexture *tex);
-    hwRTV* getRTV(hwTexture *tex);
+    ID3D11Buffer* createConstantBuffer(size_t size);
+    void uploadConstantBuffer(ID3D11Buffer *buf, const void *data, size_t size);
+    hwSRV* getSRV(hwTexture *tex, bool acquire = false);
+    hwRTV* getRTV(hwTexture *tex, bool acquire = false);
+    hwSRV* acquireCubeSRV(ID3D11Resource *tex);
 
 private:
-    typedef std::vector<hwShaderData>       ShaderCont;
-    typedef std::vector<hwAssetData>        AssetCont;
-    typedef std::vector<hwInstanceData>     InstanceCont;
-    typedef std::map<hwTexture*, hwSRV*>    SRVTable;
-    typedef std::map<hwTexture*, hwRTV*>    RTVTable;
-    typedef std::vector<DeferredCall>       DeferredCalls;
+    typedef hwHandlePool<hwShaderData>      ShaderCont;
+    typedef hwHandlePool<hwAssetData>       AssetCont;
+    typedef hwHandlePool<hwInstanceData>    InstanceCont;
 
-    std::mutex              m_mutex;
-
-    ID3D11Device            *m_d3ddev = nullptr;
-    ID3D11DeviceContext     *m_d3dctx = nullptr;
+    hwBackend               *m_backend = nullptr;
 
 	//const NvHair::TextureType::Enum textureTypes[4] = { NvHair::TextureType::ROOT_COLOR , NvHair::TextureType::TIP_COLOR, NvHair::TextureType::SPECULAR, NvHair::TextureType::STRAND };
 
-	nvidia::Common::ApiDevice m_dev_handle;
-	nvidia::Common::ApiContext m_ctx_handle;
-
     ShaderCont              m_shaders;
     AssetCont               m_assets;
     InstanceCont            m_instances;
-    SRVTable                m_srvtable;
-    RTVTable                m_rtvtable;
-    DeferredCalls           m_commands;
-    DeferredCalls           m_commands_back;
-
+    hwInstanceStore         m_instance_store;       // owned by the game thread. published when a submit finds it changed
+    hwTripleBuffer<hwInstanceStore> m_published_stores;
+    hwInstanceStore         m_render_store;         // owned by the render thread. merged from m_published_stores, updated and culled
+    std::vector<hwShaderPrograms> m_shader_programs;    // owned by the game thread. by hwHandleIndex() of the shader
+    bool                    m_shader_programs_changed = false;  // since they were last published
+    hwTripleBuffer<std::vector<hwShaderPrograms>> m_published_shaders; // the render thread reads front()
+    std::unordered_map<hwHInstance, hwInstanceEnvironment> m_instance_envs; // owned by the render thread
+    hwPathRegistry          m_shader_paths; // loaded shaders and assets by path, for sharing them
+    hwPathRegistry          m_asset_paths;  // tagged by the hash of the conversion settings
+    std::unordered_map<uint64_t, hwShaderContent> m_shader_contents;  // by hwHashContent() of the shader
+    std::unordered_map<uint64_t, hwAssetContent>  m_asset_contents;   // by hwHashContent() of the APX and the settings
+    std::unordered_map<std::string, std::weak_ptr<hwAssetSource>> m_asset_sources; // by normalized path
+    std::vector<hwHAsset>   m_loading_assets;       // owned by the game thread
+    std::vector<hwHShader>  m_reloading_shaders;    // owned by the game thread
+    std::vector<hwHAsset>   m_reloading_assets;     // owned by the game thread
+    hwFileWatcher           m_watcher;              // owned by the game thread. has the files loaded since file watching was enabled
+    bool                    m_file_watching = false;
+    hwWorkerPool            m_workers;
+    hwAssetCache            m_asset_cache;
+    // each thread has a view cache of its own, so the render thread never waits for the game thread.
+    // views of released instances' probes go back to the render thread as retired objects.
+    hwViewCache             m_views;                // owned by the game thread. instance textures and the shadow views
+    hwViewCache             m_render_views;         // owned by the render thread. reflection probes
+    hwSPSCQueue<hwRetiredObject, hwMaxRetiredObjects> m_retired;
+    std::vector<hwRetiredObject> m_retired_pending; // owned by the game thread. didn't fit in m_retired
+    std::vector<hwRetiredObject> m_retired_waiting; // owned by the render thread. taken from m_retired, their frame not passed yet
+    int                     m_newest_frame = 0;     // owned by the render thread. newest frame it has flushed or taken a page of
+    // command pages are handed from the game thread (producer) to the render thread (consumer)
+    // through two wait-free rings: submitted pages go to flush(), executed pages come back through m_free_pages.
+    typedef hwSPSCQueue<int, hwNumCommandPages> PageQueue;
+    hwCommandPage           m_command_pages[hwNumCommandPages];
+    PageQueue               m_submitted_pages;
+    PageQueue               m_free_pages;
+    int                     m_recording_page = 0;   // owned by the game thread
+    int                     m_recording_frame = 0;  // owned by the game thread
+    std::vector<int>        m_pending_pages;        // owned by the render thread. taken from m_submitted_pages, waiting for their view's flush
+    int                     m_last_executed_frame = -1; // owned by the render thread
+    int                     m_last_stale_frame = -1;    // owned by the render thread
+    hwStateCache            m_state_cache;              // owned by the render thread
+    int                     m_stats_frame = -1;                 // owned by the render thread. frame the counters below are for
+    int                     m_commands_eliminated_current = 0;  // owned by the render thread
+    int                     m_bytes_uploaded_current = 0;       // owned by the render thread
+    int                     m_instances_culled_current = 0;     // owned by the render thread
+    int                     m_shader_fallbacks_current = 0;     // owned by the render thread
+    std::vector<hwDrawItem> m_draw_items;           // owned by the render thread
+    std::vector<hwSortItem> m_sort_items;           // owned by the render thread
+    std::vector<hwSortItem> m_sort_tmp;             // owned by the render thread
+    std::vector<uint32_t>   m_draw_stamps;          // owned by the render thread. by hwHandleIndex(): m_draw_stamp if m_draw_items draws the instance
+    uint32_t                m_draw_stamp = 1;       // owned by the render thread. changes when m_draw_items is executed
+    const hwCommandHeader  *m_applied_state[hwNumStateCommandTypes] = {};  // owned by the render thread
+
+    std::atomic<hwEStaleFramePolicy> m_stale_frame_policy = { hwEStaleFramePolicy_Coalesce };
+    std::atomic<hwESortMode> m_sort_mode = { hwESortMode_StateFirst };
+    std::atomic<int>        m_frames_executed = { 0 };
+    std::atomic<int>        m_frames_dropped = { 0 };
+    std::atomic<int>        m_frames_coalesced = { 0 };
+    std::atomic<int>        m_commands_eliminated = { 0 };
+    std::atomic<int>        m_bytes_uploaded = { 0 };
+    std::atomic<int>        m_instances_culled = { 0 };
+    std::atomic<int>        m_dedup_hits = { 0 };
+    std::atomic<int>        m_dedup_bytes_saved = { 0 };
+    std::atomic<int>        m_shader_variants = { 0 };
+    std::atomic<int>        m_shader_fallbacks = { 0 };
+
+    // deferred commands are captured lazily from the recording page, before the next call that isn't deferred.
+    // m_capture_times holds when each of them was recorded.
+    hwCaptureWriter         m_capture;
+    size_t                  m_capture_cursor = 0;   // owned by the game thread
+    std::vector<uint64_t>   m_capture_times;        // owned by the game thread
+
+    // state objects are owned by m_states. the pointers below are resolved once and stay valid until finalize().
+    hwStateObjectCache      m_states;
     ID3D11DepthStencilState *m_rs_enable_depth = nullptr;
-    ID3D11Buffer            *m_rs_constant_buffer = nullptr;
-
-    hwConstantBuffer        m_cb;
-
-	ID3D11Resource *reflectionTexture1 = nullptr;
-	ID3D11Resource *reflectionTexture2 = nullptr;
-
-	
-	ID3D11ShaderResourceView* reflectionSRV1 = nullptr;
-	ID3D11ShaderResourceView* reflectionSRV2 = nullptr;
-
-	ID3D11Texture2D *shadowTexture = nullptr;
+    ID3D11SamplerState      *m_rs_sampler_texture = nullptr;
+    ID3D11SamplerState      *m_rs_sampler_shadow = nullptr;
+    ID3D11Buffer            *m_rs_frame_cb = nullptr;
+    ID3D11Buffer            *m_rs_instance_cb = nullptr;
+    ID3D11Buffer            *m_rs_legacy_cb = nullptr;
+
+    hwFrameConstantBuffer   m_frame_cb;
+    bool                    m_frame_cb_dirty = true;
+    uint32_t                m_light_features = 0;   // hwEShaderFeature bits of m_frame_cb's lights
+    hwHShader               m_bound_shader = hwNullHandle;  // by the last setShaderImpl(). draws pick its variants
+    ID3D11PixelShader      *m_bound_ps = nullptr;   // bound by a draw since beginDraws(). null: unknown
+    hwInstanceConstantBuffer m_instance_cb;         // contents of m_rs_instance_cb
+    bool                    m_instance_cb_valid = false;
+    hwLegacyConstantBuffer  m_legacy_cb;            // contents of m_rs_legacy_cb
+    bool                    m_legacy_cb_valid = false;
+    bool                    m_legacy_cb_bound = false; // b0 holds m_rs_legacy_cb instead of m_rs_frame_cb
+
+    // environment of the instances that don't have their own (hwSetSphericalHarmonics() etc.)
+    hwEnvironmentData       m_env = {};
+    hwSRV                  *m_env_probes[2] = {};   // acquired from m_render_views
+    hwSRV                  *m_bound_probes[2] = {}; // bound to t9 and t10 since beginDraws()
+
+	// views below are acquired from m_views
 	ID3D11ShaderResourceView *shadowSRV =  nullptr;
 
 	ID3D11Buffer *shadowBuffer = nullptr;
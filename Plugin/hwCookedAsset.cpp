@@ -0,0 +1,121 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwApxReader.h"
+#include "hwCookedAsset.h"
+
+static size_t hwAlignCooked(size_t v)
+{
+    return (v + (hwCookedAlign - 1)) & ~(size_t)(hwCookedAlign - 1);
+}
+
+void hwCookAsset(const hwApxAsset &apx, const hwHairDescriptor *desc, uint64_t source_hash, uint64_t source_geometry_hash, uint64_t source_mtime, uint64_t source_size, std::string &o_bin)
+{
+    struct Src { const void *data; uint32_t element_size; size_t count; };
+    Src src[hwECookedSection_Count] = {
+        { apx.vertices.data(),              sizeof(hwFloat3),           apx.vertices.size() },
+        { apx.end_indices.data(),           sizeof(uint32_t),           apx.end_indices.size() },
+        { apx.face_indices.data(),          sizeof(uint32_t),           apx.face_indices.size() },
+        { apx.face_uvs.data(),              sizeof(gfsdk_float2),       apx.face_uvs.size() },
+        { apx.bone_indices.data(),          sizeof(hwFloat4),           apx.bone_indices.size() },
+        { apx.bone_weights.data(),          sizeof(hwFloat4),           apx.bone_weights.size() },
+        { apx.bone_names.data(),            sizeof(char),               apx.bone_names.size() },
+        { apx.bind_poses.data(),            sizeof(hwMatrix),           apx.bind_poses.size() },
+        { apx.bone_parents.data(),          sizeof(int32_t),            apx.bone_parents.size() },
+        { apx.bone_spheres.data(),          sizeof(hwApxBoneSphere),    apx.bone_spheres.size() },
+        { apx.bone_capsule_indices.data(),  sizeof(uint32_t),           apx.bone_capsule_indices.size() },
+        { apx.pin_constraints.data(),       sizeof(hwApxBoneSphere),    apx.pin_constraints.size() },
+        { desc,                             sizeof(hwHairDescriptor),   desc ? 1u : 0u },
+    };
+
+    hwCookedHeader header = {};
+    header.magic = hwCookedMagic;
+    header.version = hwCookedVersion;
+    header.num_sections = hwECookedSection_Count;
+    header.descriptor_size = sizeof(hwHairDescriptor);
+    header.sdk_version = NV_HAIR_VERSION;
+    header.source_hash = source_hash;
+    header.source_geometry_hash = source_geometry_hash;
+    header.source_mtime = source_mtime;
+    header.source_size = source_size;
+    header.num_guide_hairs = apx.num_guide_hairs;
+    header.num_bones = (uint32_t)apx.bind_poses.size();
+    header.scene_unit = apx.scene_unit;
+    header.up_axis = apx.up_axis;
+    header.handedness = apx.handedness;
+
+    hwCookedSection sections[hwECookedSection_Count];
+    size_t pos = hwAlignCooked(sizeof(header) + sizeof(sections));
+    for (int i = 0; i < hwECookedSection_Count; ++i) {
+        sections[i].type = i;
+        sections[i].element_size = src[i].element_size;
+        sections[i].offset = pos;
+        sections[i].count = src[i].count;
+        pos = hwAlignCooked(pos + src[i].element_size * src[i].count);
+    }
+
+    o_bin.assign(pos, '\0');
+    memcpy(&o_bin[0], &header, sizeof(header));
+    memcpy(&o_bin[sizeof(header)], sections, sizeof(sections));
+    for (int i = 0; i < hwECookedSection_Count; ++i) {
+        if (src[i].count > 0) {
+            memcpy(&o_bin[(size_t)sections[i].offset], src[i].data, src[i].element_size * src[i].count);
+        }
+    }
+}
+
+bool hwReadCookedAsset(const void *data, size_t size, hwCookedAsset &o)
+{
+    memset(&o, 0, sizeof(o));
+    if (size < sizeof(hwCookedHeader)) { return false; }
+
+    auto *header = (const hwCookedHeader*)data;
+    if (header->magic != hwCookedMagic || header->version != hwCookedVersion) { return false; }
+    if (size < sizeof(hwCookedHeader) + sizeof(hwCookedSection) * (uint64_t)header->num_sections) { return false; }
+
+    auto *sections = (const hwCookedSection*)(header + 1);
+    for (uint32_t i = 0; i < header->num_sections; ++i) {
+        auto &s = sections[i];
+        if (s.type >= hwECookedSection_Count) { continue; } // from a later version
+        uint64_t bytes = s.element_size * s.count;
+        if (s.offset % hwCookedAlign != 0 || s.offset > size || bytes > size - s.offset) { return false; }
+        if (s.count > 0) {
+            o.data[s.type] = (const char*)data + s.offset;
+            o.count[s.type] = (size_t)s.count;
+        }
+    }
+    o.header = header;
+    return true;
+}
+
+void hwMakeAssetDescriptor(const hwCookedAsset &c, hwAssetDescriptor &o)
+{
+    memset(&o, 0, sizeof(o));
+    o.m_numGuideHairs = c.header->num_guide_hairs;
+    o.m_numVertices = (uint32_t)c.count[hwECookedSection_Vertices];
+    o.m_vertices = (gfsdk_float3*)c.data[hwECookedSection_Vertices];
+    o.m_endIndices = (uint32_t*)c.data[hwECookedSection_EndIndices];
+    o.m_numFaces = (uint32_t)c.count[hwECookedSection_FaceIndices] / 3;
+    o.m_faceIndices = (uint32_t*)c.data[hwECookedSection_FaceIndices];
+    o.m_faceUvs = (gfsdk_float2*)c.data[hwECookedSection_FaceUVs];
+    o.m_numBones = c.header->num_bones;
+    o.m_boneIndices = (gfsdk_float4*)c.data[hwECookedSection_BoneIndices];
+    o.m_boneWeights = (gfsdk_float4*)c.data[hwECookedSection_BoneWeights];
+    o.m_boneNames = (char*)c.data[hwECookedSection_BoneNames];
+    o.m_bindPoses = (gfsdk_float4x4*)c.data[hwECookedSection_BindPoses];
+    o.m_boneParents = (int32_t*)c.data[hwECookedSection_BoneParents];
+    o.m_numBoneSpheres = (uint32_t)c.count[hwECookedSection_BoneSpheres];
+    o.m_boneSpheres = (decltype(o.m_boneSpheres))c.data[hwECookedSection_BoneSpheres];
+    o.m_numBoneCapsules = (uint32_t)c.count[hwECookedSection_BoneCapsuleIndices] / 2;
+    o.m_boneCapsuleIndices = (uint32_t*)c.data[hwECookedSection_BoneCapsuleIndices];
+    o.m_numPinConstraints = (uint32_t)c.count[hwECookedSection_PinConstraints];
+    o.m_pinConstraints = (decltype(o.m_pinConstraints))c.data[hwECookedSection_PinConstraints];
+    o.m_sceneUnit = c.header->scene_unit;
+    o.m_upAxis = (NvHair::AxisHint::Enum)c.header->up_axis;
+    o.m_handedness = (NvHair::HandednessHint::Enum)c.header->handedness;
+}
+
+const hwHairDescriptor* hwGetCookedDescriptor(const hwCookedAsset &c)
+{
+    if (c.header->sdk_version != NV_HAIR_VERSION || c.header->descriptor_size != sizeof(hwHairDescriptor)) { return nullptr; }
+    return (const hwHairDescriptor*)c.data[hwECookedSection_InstanceDescriptor];
+}
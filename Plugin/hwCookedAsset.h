@@ -0,0 +1,75 @@
+﻿#pragma once
+
+// cooked hair asset: the HairAssetDescriptor arrays of an APX file in binary, ready to be handed to the SDK as they are.
+//
+// [hwCookedHeader][hwCookedSection x num_sections][arrays]
+// every array starts at a multiple of hwCookedAlign. all values are little-endian, the byte order of every platform
+// the plugin runs on. a file written in another byte order fails the magic check.
+// the instance descriptor section is the SDK's hwHairDescriptor as is, so it is only used by the SDK version that cooked it.
+
+struct hwApxAsset;
+
+#define hwCookedMagic   0x41435748  // "HWCA"
+#define hwCookedVersion 3  // 2: source_hash is hwHashContent() 3: source_geometry_hash
+#define hwCookedAlign   16
+
+enum hwECookedSection
+{
+    hwECookedSection_Vertices,
+    hwECookedSection_EndIndices,
+    hwECookedSection_FaceIndices,
+    hwECookedSection_FaceUVs,
+    hwECookedSection_BoneIndices,
+    hwECookedSection_BoneWeights,
+    hwECookedSection_BoneNames,
+    hwECookedSection_BindPoses,
+    hwECookedSection_BoneParents,
+    hwECookedSection_BoneSpheres,
+    hwECookedSection_BoneCapsuleIndices,
+    hwECookedSection_PinConstraints,
+    hwECookedSection_InstanceDescriptor,
+    hwECookedSection_Count,
+};
+
+struct hwCookedHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_sections;
+    uint32_t descriptor_size;   // sizeof(hwHairDescriptor) of the plugin that cooked it
+    uint64_t source_hash;       // hwHashContent() of the APX file
+    uint64_t source_mtime;      // of the APX file, see hwAssetCache
+    uint64_t source_size;       //
+    uint32_t num_guide_hairs;
+    uint32_t num_bones;
+    float    scene_unit;
+    uint32_t up_axis;
+    uint32_t handedness;
+    uint32_t sdk_version;       // NV_HAIR_VERSION of the plugin that cooked it
+    uint64_t source_geometry_hash; // hwApxSectionHashes::geometry of the APX file
+};
+
+struct hwCookedSection
+{
+    uint32_t type;          // hwECookedSection
+    uint32_t element_size;
+    uint64_t offset;        // from the start of the file
+    uint64_t count;
+};
+
+// views into cooked data. valid as long as the data is
+struct hwCookedAsset
+{
+    const hwCookedHeader *header;
+    const void *data[hwECookedSection_Count];   // null for sections that are missing or empty
+    size_t count[hwECookedSection_Count];
+};
+
+// desc: the default instance descriptor of the asset. may be null
+void hwCookAsset(const hwApxAsset &apx, const hwHairDescriptor *desc, uint64_t source_hash, uint64_t source_geometry_hash, uint64_t source_mtime, uint64_t source_size, std::string &o_bin);
+// false if data isn't a cooked asset of this version or a section is out of bounds
+bool hwReadCookedAsset(const void *data, size_t size, hwCookedAsset &o_asset);
+// the pointers of o_desc point into c's data
+void hwMakeAssetDescriptor(const hwCookedAsset &c, hwAssetDescriptor &o_desc);
+// null if c has none or it was cooked with another SDK
+const hwHairDescriptor* hwGetCookedDescriptor(const hwCookedAsset &c);
@@ -0,0 +1,187 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwPathRegistry.h"
+#include "hwFileWatcher.h"
+
+struct hwFileWatcher::Dir
+{
+    std::string path;   // normalized. "." for the current directory
+#ifdef hwWindows
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    OVERLAPPED overlapped = {};
+    bool pending = false;           // a read is in flight: it writes to buffer until it completes or is cancelled
+    DWORD buffer[16 * 1024];        // FILE_NOTIFY_INFORMATION records, which are DWORD aligned
+
+    bool listen()
+    {
+        pending = ::ReadDirectoryChangesW(handle, buffer, sizeof(buffer), FALSE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE, nullptr, &overlapped, nullptr) != FALSE;
+        return pending;
+    }
+
+    ~Dir()
+    {
+        if (pending) {
+            DWORD bytes;
+            ::CancelIoEx(handle, &overlapped);
+            ::GetOverlappedResult(handle, &overlapped, &bytes, TRUE);
+        }
+        if (handle != INVALID_HANDLE_VALUE) { ::CloseHandle(handle); }
+        if (overlapped.hEvent) { ::CloseHandle(overlapped.hEvent); }
+    }
+#else
+    int wd = -1;
+#endif
+};
+
+// npath: normalized
+static std::string hwDirectoryOf(const std::string &npath)
+{
+    size_t sep = npath.find_last_of('/');
+    if (sep == std::string::npos) { return "."; }
+    if (sep == 0) { return "/"; }
+    return npath.substr(0, sep);
+}
+
+
+hwFileWatcher::hwFileWatcher()
+#ifndef hwWindows
+    : m_fd(-1)
+#endif
+{
+}
+
+hwFileWatcher::~hwFileWatcher()
+{
+    clear();
+}
+
+bool hwFileWatcher::add(const std::string &path)
+{
+    std::string npath = hwPathRegistry::normalize(path);
+    if (std::find(m_files.begin(), m_files.end(), npath) != m_files.end()) { return true; }
+
+    std::string dpath = hwDirectoryOf(npath);
+    auto it = std::find_if(m_dirs.begin(), m_dirs.end(), [&](const std::unique_ptr<Dir> &d) { return d->path == dpath; });
+    if (it == m_dirs.end()) {
+        std::unique_ptr<Dir> d(new Dir());
+        d->path = dpath;
+#ifdef hwWindows
+        d->handle = ::CreateFileA(dpath.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+            OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        d->overlapped.hEvent = ::CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        if (d->handle == INVALID_HANDLE_VALUE || !d->overlapped.hEvent || !d->listen()) {
+            hwLog("hwFileWatcher: can't watch \"%s\".\n", dpath.c_str());
+            return false;
+        }
+#else
+        if (m_fd < 0 && (m_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+            hwLog("hwFileWatcher: inotify_init1() failed.\n");
+            return false;
+        }
+        if ((d->wd = ::inotify_add_watch(m_fd, dpath.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO)) < 0) {
+            hwLog("hwFileWatcher: can't watch \"%s\".\n", dpath.c_str());
+            return false;
+        }
+#endif
+        m_dirs.push_back(std::move(d));
+    }
+    m_files.push_back(npath);
+    return true;
+}
+
+void hwFileWatcher::clear()
+{
+    m_dirs.clear(); // cancels the reads in flight
+    m_files.clear();
+    m_changed.clear();
+#ifndef hwWindows
+    if (m_fd >= 0) {
+        ::close(m_fd); // and the watches with it
+        m_fd = -1;
+    }
+#endif
+}
+
+void hwFileWatcher::poll(std::vector<std::string> &o_changed)
+{
+    if (m_dirs.empty()) { return; }
+
+    readEvents();
+    auto now = Clock::now();
+    for (auto it = m_changed.begin(); it != m_changed.end(); ) {
+        if (now - it->second >= std::chrono::milliseconds(hwFileWatcherSettleMs)) {
+            o_changed.push_back(it->first);
+            it = m_changed.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void hwFileWatcher::readEvents()
+{
+#ifdef hwWindows
+    for (auto &d : m_dirs) {
+        DWORD bytes = 0;
+        if (d->pending && !::GetOverlappedResult(d->handle, &d->overlapped, &bytes, FALSE)) {
+            continue; // ERROR_IO_INCOMPLETE: nothing happened yet
+        }
+
+        if (d->pending && bytes == 0) {
+            onChanged(*d, std::string()); // more changes than the buffer holds
+        }
+        else if (d->pending) {
+            auto *p = (const char*)d->buffer;
+            for (;;) {
+                auto *info = (const FILE_NOTIFY_INFORMATION*)p;
+                if (info->Action != FILE_ACTION_REMOVED && info->Action != FILE_ACTION_RENAMED_OLD_NAME) {
+                    char name[MAX_PATH * 3];
+                    int len = ::WideCharToMultiByte(CP_ACP, 0, info->FileName, (int)(info->FileNameLength / sizeof(WCHAR)), name, sizeof(name), nullptr, nullptr);
+                    if (len > 0) { onChanged(*d, std::string(name, len)); }
+                }
+                if (info->NextEntryOffset == 0) { break; }
+                p += info->NextEntryOffset;
+            }
+        }
+        d->listen();
+    }
+#else
+    alignas(inotify_event) char buf[16 * 1024];
+    for (;;) {
+        ssize_t n = ::read(m_fd, buf, sizeof(buf));
+        if (n <= 0) { break; } // EAGAIN: read them all
+
+        for (char *p = buf; p < buf + n; ) {
+            auto *e = (const inotify_event*)p;
+            if (e->mask & IN_Q_OVERFLOW) {
+                for (auto &d : m_dirs) { onChanged(*d, std::string()); }
+            }
+            else if (e->len > 0) {
+                for (auto &d : m_dirs) {
+                    if (d->wd == e->wd) { onChanged(*d, e->name); }
+                }
+            }
+            p += sizeof(inotify_event) + e->len;
+        }
+    }
+#endif
+}
+
+void hwFileWatcher::onChanged(const Dir &dir, const std::string &name)
+{
+    auto now = Clock::now();
+    if (name.empty()) {
+        // the events were lost: any file of the directory may have changed
+        for (auto &f : m_files) {
+            if (hwDirectoryOf(f) == dir.path) { m_changed[f] = now; }
+        }
+        return;
+    }
+
+    std::string npath = hwPathRegistry::normalize(dir.path == "." ? name : dir.path + "/" + name);
+    if (std::find(m_files.begin(), m_files.end(), npath) != m_files.end()) {
+        m_changed[npath] = now;
+    }
+}
@@ -0,0 +1,41 @@
+﻿#pragma once
+
+// reports files that have been written, so that shaders and assets can be reloaded when they change on disk.
+// watches the directories of the files added: ReadDirectoryChangesW on Windows, inotify elsewhere.
+// editors and exporters tend to write a file in several steps, so a file is reported only once poll() has seen no change
+// to it for hwFileWatcherSettleMs. poll() never blocks and is meant to be called every frame.
+// not thread safe: run by the game thread only.
+
+#define hwFileWatcherSettleMs   200
+
+class hwFileWatcher
+{
+public:
+    hwFileWatcher();
+    ~hwFileWatcher();
+
+    // false if the file's directory can't be watched
+    bool add(const std::string &path);
+    void clear();
+    bool empty() const { return m_files.empty(); }
+
+    // appends the files that changed since the last poll(), normalized (see hwPathRegistry::normalize())
+    void poll(std::vector<std::string> &o_changed);
+
+private:
+    struct Dir;
+    typedef std::chrono::steady_clock Clock;
+
+    hwFileWatcher(const hwFileWatcher&) = delete;
+    hwFileWatcher& operator=(const hwFileWatcher&) = delete;
+
+    void readEvents();
+    void onChanged(const Dir &dir, const std::string &name); // name: empty if the events of dir were lost
+
+    std::vector<std::unique_ptr<Dir>>   m_dirs;
+    std::vector<std::string>            m_files;    // normalized paths added
+    std::map<std::string, Clock::time_point> m_changed; // not reported yet, by the time of their last change
+#ifndef hwWindows
+    int m_fd;   // inotify instance of all the directories
+#endif
+};
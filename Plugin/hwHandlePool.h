@@ -0,0 +1,162 @@
+﻿#pragma once
+
+// slot map behind shader, asset and instance handles.
+// a handle is the slot index in the low hwHandleIndexBits bits and the slot's generation above them.
+// the generation changes every time the slot is freed, so get() rejects handles that outlived their object
+// even after the slot has been reused. alloc() and free() go through a free list, get() is an index and a compare.
+//
+// T needs a handle member and must be default-constructible. freed slots are reset to T().
+// not thread safe: handles are created and released by the game thread only.
+
+#define hwHandleIndexBits       20
+#define hwHandleIndexMask       ((1u << hwHandleIndexBits) - 1)
+#define hwHandleGenerationMask  (0xFFFFFFFFu >> hwHandleIndexBits)
+#define hwHandleMaxSlots        hwHandleIndexMask // the last index is left out so no handle equals hwNullHandle
+
+inline uint32_t hwHandleIndex(uint32_t h) { return h & hwHandleIndexMask; }
+
+struct hwHandlePoolStats
+{
+    int slots;      // used and free
+    int used;
+    int allocated;  // since the pool was created
+    int freed;      //
+    int stale;      // get()s rejected because the handle's object has been freed
+};
+
+template<class T>
+class hwHandlePool
+{
+public:
+    hwHandlePool() : m_free_head(NullIndex), m_used(0), m_allocated(0), m_freed(0), m_stale(0) {}
+
+    // returns nullptr if all hwHandleMaxSlots slots are used
+    T* alloc()
+    {
+        uint32_t i = m_free_head;
+        if (i != NullIndex) {
+            m_free_head = m_slots[i].next_free;
+        }
+        else {
+            if (m_slots.size() >= hwHandleMaxSlots) { return nullptr; }
+            i = (uint32_t)m_slots.size();
+            m_slots.push_back(Slot());
+            m_items.push_back(T());
+        }
+
+        auto &s = m_slots[i];
+        s.used = true;
+        s.next_free = NullIndex;
+        m_items[i].handle = (s.generation << hwHandleIndexBits) | i;
+        ++m_used;
+        ++m_allocated;
+        return &m_items[i];
+    }
+
+    void free(uint32_t h)
+    {
+        if (!get(h)) { return; }
+
+        uint32_t i = hwHandleIndex(h);
+        auto &s = m_slots[i];
+        s.used = false;
+        s.generation = (s.generation + 1) & hwHandleGenerationMask;
+        s.next_free = m_free_head;
+        m_free_head = i;
+        m_items[i] = T();
+        --m_used;
+        ++m_freed;
+    }
+
+    // nullptr for hwNullHandle, out of range and stale handles
+    T* get(uint32_t h)
+    {
+        return const_cast<T*>(static_cast<const hwHandlePool*>(this)->get(h));
+    }
+
+    const T* get(uint32_t h) const
+    {
+        uint32_t i = hwHandleIndex(h);
+        if (i >= m_slots.size()) { return nullptr; }
+
+        auto &s = m_slots[i];
+        if (!s.used || s.generation != (h >> hwHandleIndexBits)) {
+            if (h != hwNullHandle) { ++m_stale; }
+            return nullptr;
+        }
+        return &m_items[i];
+    }
+
+    // calls f for every used slot. f may free the slot it is given.
+    template<class F>
+    void each(const F &f)
+    {
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            if (m_slots[i].used) { f(m_items[i]); }
+        }
+    }
+
+    template<class Pred>
+    T* find(const Pred &pred)
+    {
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            if (m_slots[i].used && pred(m_items[i])) { return &m_items[i]; }
+        }
+        return nullptr;
+    }
+
+    // frees everything. generations are kept, so handles from before clear() stay stale.
+    void clear()
+    {
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            if (m_slots[i].used) { free(m_items[i].handle); }
+        }
+    }
+
+    void move(hwHandlePool &from)
+    {
+        m_items = std::move(from.m_items);
+        m_slots = std::move(from.m_slots);
+        m_free_head = from.m_free_head;
+        m_used = from.m_used;
+        m_allocated = from.m_allocated;
+        m_freed = from.m_freed;
+        m_stale = from.m_stale.load();
+
+        from.m_items.clear();
+        from.m_slots.clear();
+        from.m_free_head = NullIndex;
+        from.m_used = 0;
+    }
+
+    size_t size() const { return m_used; }
+
+    void getStats(hwHandlePoolStats &o_stats) const
+    {
+        o_stats.slots = (int)m_slots.size();
+        o_stats.used = (int)m_used;
+        o_stats.allocated = m_allocated;
+        o_stats.freed = m_freed;
+        o_stats.stale = m_stale;
+    }
+
+private:
+    static const uint32_t NullIndex = 0xFFFFFFFF;
+
+    struct Slot
+    {
+        uint32_t generation;
+        uint32_t next_free; // next slot of the free list, if this one is free
+        bool used;
+
+        Slot() : generation(0), next_free(NullIndex), used(false) {}
+    };
+
+    std::vector<T>      m_items;
+    std::vector<Slot>   m_slots;
+    uint32_t            m_free_head;
+    size_t              m_used;
+    int                 m_allocated;
+    int                 m_freed;
+    mutable std::atomic_int m_stale; // handles are looked up by the render thread too
+};
@@ -0,0 +1,65 @@
+﻿#pragma once
+
+// 64 bit FNV-1a. pass the previous result as h to hash data in several pieces.
+inline uint64_t hwHash64(const void *data, size_t size, uint64_t h = 0xcbf29ce484222325ULL)
+{
+    auto *p = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// 64 bit xxHash (XXH64), for file contents: several times faster than hwHash64() on anything but a few bytes.
+namespace hwXXH64 {
+    const uint64_t P1 = 11400714785074694791ULL;
+    const uint64_t P2 = 14029467366897019727ULL;
+    const uint64_t P3 = 1609587929392839161ULL;
+    const uint64_t P4 = 9650029242287828579ULL;
+    const uint64_t P5 = 2870177450012600261ULL;
+
+    inline uint64_t rotl(uint64_t v, int r) { return (v << r) | (v >> (64 - r)); }
+    inline uint64_t read64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+    inline uint32_t read32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+    inline uint64_t step(uint64_t acc, uint64_t v) { return rotl(acc + v * P2, 31) * P1; }
+    inline uint64_t mergeStep(uint64_t acc, uint64_t v) { return (acc ^ step(0, v)) * P1 + P4; }
+} // namespace hwXXH64
+
+inline uint64_t hwHashContent(const void *data, size_t size, uint64_t seed = 0)
+{
+    using namespace hwXXH64;
+    auto *p = (const uint8_t*)data;
+    auto *end = p + size;
+
+    uint64_t h;
+    if (size >= 32) {
+        uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+        for (; end - p >= 32; p += 32) {
+            v1 = step(v1, read64(p));
+            v2 = step(v2, read64(p + 8));
+            v3 = step(v3, read64(p + 16));
+            v4 = step(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeStep(mergeStep(mergeStep(mergeStep(h, v1), v2), v3), v4);
+    }
+    else {
+        h = seed + P5;
+    }
+    h += size;
+
+    for (; end - p >= 8; p += 8) { h = rotl(h ^ step(0, read64(p)), 27) * P1 + P4; }
+    if (end - p >= 4) {
+        h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; ++p) { h = rotl(h ^ (*p * P5), 11) * P1; }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,162 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwBackend.h"
+#include "hwHandlePool.h"
+#include "hwInstanceStore.h"
+
+uint32_t hwInstanceStore::add(hwHInstance hi, hwInstanceID iid, hwHAsset ha)
+{
+    hwAABB empty = {};
+    handles.push_back(hi);
+    iids.push_back(iid);
+    assets.push_back(ha);
+    bounds.push_back(empty);
+    flags.push_back(hwEInstanceFlag_Visible);
+    descriptor_hashes.push_back(0);
+    changed = true;
+    return (uint32_t)(handles.size() - 1);
+}
+
+hwHInstance hwInstanceStore::remove(uint32_t i)
+{
+    if (i >= handles.size()) { return hwNullHandle; }
+
+    size_t last = handles.size() - 1;
+    hwHInstance moved = hwNullHandle;
+    if (i != last) {
+        handles[i] = handles[last];
+        iids[i] = iids[last];
+        assets[i] = assets[last];
+        bounds[i] = bounds[last];
+        flags[i] = flags[last];
+        descriptor_hashes[i] = descriptor_hashes[last];
+        moved = handles[i];
+    }
+    handles.pop_back();
+    iids.pop_back();
+    assets.pop_back();
+    bounds.pop_back();
+    flags.pop_back();
+    descriptor_hashes.pop_back();
+    changed = true;
+    return moved;
+}
+
+void hwInstanceStore::clear()
+{
+    handles.clear();
+    iids.clear();
+    assets.clear();
+    bounds.clear();
+    indices.clear();
+    changed = true;
+    flags.clear();
+    descriptor_hashes.clear();
+}
+
+void hwInstanceStore::merge(const hwInstanceStore &src)
+{
+    size_t n = src.size();
+    std::vector<hwAABB> new_bounds(src.bounds);
+    std::vector<uint32_t> new_flags(src.flags);
+    for (size_t i = 0; i < n; ++i) {
+        int j = find(src.handles[i]);
+        if (j < 0) { continue; }
+        uint32_t render = flags[j] & hwEInstanceFlag_RenderMask;
+        if (render & hwEInstanceFlag_BoundsValid) { new_bounds[i] = bounds[j]; }
+        else { render |= src.flags[i] & hwEInstanceFlag_BoundsValid; } // the ones the game thread got at creation, if any
+        new_flags[i] = (src.flags[i] & ~hwEInstanceFlag_RenderMask) | render;
+    }
+
+    handles = src.handles;
+    iids = src.iids;
+    assets = src.assets;
+    bounds.swap(new_bounds);
+    flags.swap(new_flags);
+    descriptor_hashes.clear();
+
+    // handles of released instances are left behind. find() tells them apart by their generation
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t slot = hwHandleIndex(handles[i]);
+        if (slot >= indices.size()) { indices.resize(slot + 1, hwNullHandle); }
+        indices[slot] = (uint32_t)i;
+    }
+}
+
+int hwInstanceStore::find(hwHInstance hi) const
+{
+    uint32_t slot = hwHandleIndex(hi);
+    if (slot >= indices.size()) { return -1; }
+    uint32_t i = indices[slot];
+    return i < handles.size() && handles[i] == hi ? (int)i : -1;
+}
+
+void hwInstanceStore::updateBounds(hwBackend *backend)
+{
+    size_t n = size();
+    for (size_t i = 0; i < n; ++i) {
+        if (iids[i] == hwNullInstanceID) { continue; } // asset still loading
+        if (NV_SUCCEEDED(backend->getBounds(iids[i], bounds[i].bmin, bounds[i].bmax))) {
+            flags[i] |= hwEInstanceFlag_BoundsValid;
+        }
+        else {
+            flags[i] &= ~hwEInstanceFlag_BoundsValid;
+        }
+    }
+}
+
+// element (row, column) of a column major matrix
+static inline float hwAt(const hwMatrix &m, int r, int c)
+{
+    return ((const float*)&m)[c * 4 + r];
+}
+
+int hwInstanceStore::cull(const hwMatrix &view, const hwMatrix &proj)
+{
+    // frustum planes from the rows of proj * view (Gribb & Hartmann). points with dot(plane, (p, 1)) < 0 are outside.
+    // the near plane is the one of GL style projections, which also holds for D3D style ones.
+    float vp[4][4];
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            vp[r][c] = hwAt(proj, r, 0) * hwAt(view, 0, c) + hwAt(proj, r, 1) * hwAt(view, 1, c)
+                     + hwAt(proj, r, 2) * hwAt(view, 2, c) + hwAt(proj, r, 3) * hwAt(view, 3, c);
+        }
+    }
+    float planes[6][4];
+    for (int p = 0; p < 3; ++p) {
+        for (int c = 0; c < 4; ++c) {
+            planes[p * 2 + 0][c] = vp[3][c] + vp[p][c];
+            planes[p * 2 + 1][c] = vp[3][c] - vp[p][c];
+        }
+    }
+    int culled = 0;
+    size_t n = size();
+    for (size_t i = 0; i < n; ++i) {
+        if ((flags[i] & hwEInstanceFlag_BoundsValid) == 0) {
+            flags[i] |= hwEInstanceFlag_Visible;
+            continue;
+        }
+
+        auto &b = bounds[i];
+        bool inside = true;
+        for (auto &pl : planes) {
+            // the corner furthest along the plane normal
+            float x = pl[0] >= 0.0f ? b.bmax.x : b.bmin.x;
+            float y = pl[1] >= 0.0f ? b.bmax.y : b.bmin.y;
+            float z = pl[2] >= 0.0f ? b.bmax.z : b.bmin.z;
+            if (pl[0] * x + pl[1] * y + pl[2] * z + pl[3] < 0.0f) {
+                inside = false;
+                break;
+            }
+        }
+
+        if (inside) {
+            flags[i] |= hwEInstanceFlag_Visible;
+        }
+        else {
+            flags[i] &= ~hwEInstanceFlag_Visible;
+            ++culled;
+        }
+    }
+    return culled;
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+
+// per-instance state that passes over every instance read, in dense arrays (structure of arrays).
+// element i of every array belongs to the same instance. removing an instance moves the last one into its place,
+// so the arrays stay packed and a pass streams through exactly the live instances.
+//
+// each thread has a store of its own and is the only one that writes it. the game thread's adds and removes
+// instances and keeps their descriptor flags; hwInstanceData::index is the instance's element in it, which changes
+// when another instance is removed (see remove()). the render thread's is a copy of the game thread's, taken
+// through merge() when the game thread publishes a new version (see hwContext::publishRenderState()). it adds what
+// the render thread finds out, bounds and visibility, and is looked up by handle (see find()).
+
+class hwBackend;
+
+enum hwEInstanceFlags
+{
+    hwEInstanceFlag_CastShadow      = 1 << 0,
+    hwEInstanceFlag_ReceiveShadow   = 1 << 1,
+    hwEInstanceFlag_BoundsValid     = 1 << 2,
+    hwEInstanceFlag_Visible         = 1 << 3,   // inside the view frustum at the last cull()
+    hwEInstanceFlag_Glint           = 1 << 4,   // the descriptor has glint. its draws need hwEShaderFeature_Glint
+    hwEInstanceFlag_SpecularTexture = 1 << 5,   // has a specular texture. its draws need hwEShaderFeature_SpecularTexture
+
+    // what the render thread's store keeps of its own across merge()s
+    hwEInstanceFlag_RenderMask      = hwEInstanceFlag_BoundsValid | hwEInstanceFlag_Visible,
+};
+
+struct hwAABB
+{
+    hwFloat3 bmin;
+    hwFloat3 bmax;
+};
+
+struct hwInstanceStore
+{
+    std::vector<hwHInstance>    handles;
+    std::vector<hwInstanceID>   iids;
+    std::vector<hwHAsset>       assets;             // draws are sorted by them
+    std::vector<hwAABB>         bounds;             // world space. game thread: when the instance was created. render thread: as of the last updateBounds()
+    std::vector<uint32_t>       flags;              // hwEInstanceFlags
+    std::vector<uint64_t>       descriptor_hashes;  // of the last descriptor sent to the SDK. 0: unknown. game thread only
+    std::vector<uint32_t>       indices;            // element of each handle by its hwHandleIndex(). render thread only, see find()
+    bool                        changed = false;    // game thread: since the last time it was published
+
+    size_t      size() const { return handles.size(); }
+    // game thread. they set changed
+    uint32_t    add(hwHInstance hi, hwInstanceID iid, hwHAsset ha); // returns the index of the new instance
+    hwHInstance remove(uint32_t i);                     // returns the instance moved to i, hwNullHandle if none was
+    void        clear();
+
+    // render thread. the store becomes a copy of src, the game thread's. instances that were already here keep
+    // their bounds and visibility unless src has bounds and they don't.
+    void        merge(const hwInstanceStore &src);
+    // render thread. returns the element of hi, -1 if it isn't here (released, or created after the last merge())
+    int         find(hwHInstance hi) const;
+
+    // passes over all instances. both are run by the render thread.
+    void updateBounds(hwBackend *backend);
+    // sets or clears hwEInstanceFlag_Visible. returns the number of instances outside.
+    // view and proj as given to hwSetViewProjection(). instances without bounds are always visible.
+    int cull(const hwMatrix &view, const hwMatrix &proj);
+};
@@ -9,5 +9,6 @@
 
 void hwLogImpl(const char* fmt, ...);
 #define hwLog(...) hwLogImpl(__VA_ARGS__)
+bool hwFileToString(std::string &o_buf, const char *path);
 
 #include "HairWorksIntegration.h"
@@ -0,0 +1,61 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwHash.h"
+#include "hwPathRegistry.h"
+
+std::string hwPathRegistry::normalize(const std::string &path)
+{
+    std::string ret;
+    ret.reserve(path.size());
+    for (size_t i = 0; i < path.size(); ++i) {
+        char c = path[i];
+        if (c == '\\') { c = '/'; }
+        if (c == '/') {
+            // keep the leading "//" of UNC paths
+            if (!ret.empty() && ret.back() == '/' && ret.size() > 1) { continue; }
+            // "./"
+            if (ret.size() >= 2 && ret.back() == '.' && ret[ret.size() - 2] == '/') { ret.pop_back(); continue; }
+            if (ret.size() == 1 && ret[0] == '.') { ret.clear(); continue; }
+        }
+#ifdef hwWindows
+        if (c >= 'A' && c <= 'Z') { c = c - 'A' + 'a'; }
+#endif
+        ret.push_back(c);
+    }
+    return ret;
+}
+
+hwPathRegistry::Key hwPathRegistry::makeKey(const std::string &npath, uint64_t tag)
+{
+    Key key;
+    key.hash = hwHash64(npath.data(), npath.size(), hwHash64(&tag, sizeof(tag)));
+    key.tag = tag;
+    key.path = npath;
+    return key;
+}
+
+uint32_t hwPathRegistry::find(const std::string &npath, uint64_t tag) const
+{
+    auto i = m_table.find(makeKey(npath, tag));
+    return i != m_table.end() ? i->second : hwNullHandle;
+}
+
+void hwPathRegistry::add(const std::string &npath, uint64_t tag, uint32_t handle)
+{
+    m_table[makeKey(npath, tag)] = handle;
+}
+
+void hwPathRegistry::remove(const std::string &npath, uint64_t tag)
+{
+    m_table.erase(makeKey(npath, tag));
+}
+
+void hwPathRegistry::clear()
+{
+    m_table.clear();
+}
+
+size_t hwPathRegistry::size() const
+{
+    return m_table.size();
+}
@@ -0,0 +1,36 @@
+﻿#pragma once
+
+// maps files that have been loaded to their handle, so loading the same file again shares it.
+// keyed by the normalized path and a tag for anything else the loaded data depends on (the conversion settings
+// of assets). normalize() before calling the other functions.
+
+class hwPathRegistry
+{
+public:
+    // '\' becomes '/', repeated separators and "./" are dropped, and on Windows everything is lowercased:
+    // "Assets\\Hair//./Fur.apx" and "assets/hair/fur.apx" are the same file there.
+    static std::string normalize(const std::string &path);
+
+    uint32_t    find(const std::string &npath, uint64_t tag = 0) const; // hwNullHandle if not registered
+    void        add(const std::string &npath, uint64_t tag, uint32_t handle);
+    void        remove(const std::string &npath, uint64_t tag = 0);
+    void        clear();
+    size_t      size() const;
+
+private:
+    struct Key
+    {
+        uint64_t hash;
+        uint64_t tag;
+        std::string path;
+
+        bool operator==(const Key &v) const { return hash == v.hash && tag == v.tag && path == v.path; }
+    };
+    struct KeyHasher
+    {
+        size_t operator()(const Key &k) const { return (size_t)k.hash; }
+    };
+    static Key makeKey(const std::string &npath, uint64_t tag);
+
+    std::unordered_map<Key, uint32_t, KeyHasher> m_table;
+};
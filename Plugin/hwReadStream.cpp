@@ -0,0 +1,119 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwReadStream.h"
+
+hwMemoryReadStream::hwMemoryReadStream(const void *data, size_t size)
+    : m_data((const char*)data), m_size(size), m_pos(0)
+{
+}
+
+NvCo::Int64 hwMemoryReadStream::getPosition()
+{
+    return (NvCo::Int64)m_pos;
+}
+
+NvCo::Void hwMemoryReadStream::seek(NvCo::SeekOrigin::Enum origin, NvCo::Int64 offset)
+{
+    NvCo::Int64 base = 0;
+    switch (origin) {
+    case NvCo::SeekOrigin::START:   base = 0; break;
+    case NvCo::SeekOrigin::CURRENT: base = (NvCo::Int64)m_pos; break;
+    case NvCo::SeekOrigin::END:     base = (NvCo::Int64)m_size; break;
+    }
+    NvCo::Int64 pos = base + offset;
+    m_pos = pos < 0 ? 0 : std::min<size_t>((size_t)pos, m_size);
+}
+
+NvCo::Bool hwMemoryReadStream::isClosed()
+{
+    return m_data == nullptr;
+}
+
+NvCo::Bool hwMemoryReadStream::canSeek()
+{
+    return true;
+}
+
+NvCo::Void hwMemoryReadStream::close()
+{
+    m_data = nullptr;
+    m_size = m_pos = 0;
+}
+
+NvCo::SizeT hwMemoryReadStream::read(NvCo::Void *buffer, NvCo::SizeT num_bytes)
+{
+    size_t n = std::min<size_t>(num_bytes, m_size - m_pos);
+    if (n > 0) {
+        memcpy(buffer, m_data + m_pos, n);
+        m_pos += n;
+    }
+    return n;
+}
+
+NvCo::Bool hwMemoryReadStream::isEndOfStream()
+{
+    return m_pos >= m_size;
+}
+
+
+hwMappedFile::hwMappedFile() : m_data(nullptr), m_size(0)
+{
+}
+
+hwMappedFile::~hwMappedFile()
+{
+    close();
+}
+
+bool hwMappedFile::open(const char *path)
+{
+    close();
+
+#ifdef hwWindows
+    HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) { return false; }
+
+    LARGE_INTEGER size;
+    HANDLE mapping = nullptr;
+    if (::GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    ::CloseHandle(file); // the mapping keeps the file open
+    if (!mapping) { return false; }
+
+    void *view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    ::CloseHandle(mapping); // and the view keeps the mapping
+    if (!view) { return false; }
+    m_data = (const char*)view;
+    m_size = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) { return false; }
+
+    struct stat st;
+    void *view = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        view = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (view == MAP_FAILED) { return false; }
+    m_data = (const char*)view;
+    m_size = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+void hwMappedFile::close()
+{
+    if (!m_data) { return; }
+
+#ifdef hwWindows
+    ::UnmapViewOfFile(m_data);
+#else
+    ::munmap((void*)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
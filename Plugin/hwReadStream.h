@@ -0,0 +1,44 @@
+﻿#pragma once
+
+// ReadStream over a block of memory the caller keeps alive, to hand data read elsewhere to the SDK.
+class hwMemoryReadStream : public NvCo::ReadStream
+{
+public:
+    hwMemoryReadStream(const void *data, size_t size);
+
+    NvCo::Int64 getPosition() override;
+    NvCo::Void  seek(NvCo::SeekOrigin::Enum origin, NvCo::Int64 offset) override;
+    NvCo::Bool  isClosed() override;
+    NvCo::Bool  canSeek() override;
+    NvCo::Void  close() override;
+    NvCo::SizeT read(NvCo::Void *buffer, NvCo::SizeT num_bytes) override;
+    NvCo::Bool  isEndOfStream() override;
+
+private:
+    const char *m_data;
+    size_t      m_size;
+    size_t      m_pos;
+};
+
+// a file mapped read-only into memory. loads hand its pages to the parser or the SDK through hwMemoryReadStream,
+// so the file's bytes are not copied into a buffer of our own first.
+// the file can't be truncated while it is mapped, so keep the mapping only as long as the bytes are needed.
+class hwMappedFile
+{
+public:
+    hwMappedFile();
+    ~hwMappedFile();
+
+    // false if the file doesn't exist or is empty
+    bool open(const char *path);
+    void close();
+    const char* data() const { return m_data; }
+    size_t      size() const { return m_size; }
+
+private:
+    hwMappedFile(const hwMappedFile&) = delete;
+    hwMappedFile& operator=(const hwMappedFile&) = delete;
+
+    const char *m_data;
+    size_t      m_size;
+};
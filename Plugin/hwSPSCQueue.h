@@ -0,0 +1,54 @@
+﻿#pragma once
+
+// wait-free single producer / single consumer ring.
+// push() must only be called from one thread and pop() from one (other) thread.
+// Capacity must be a power of two.
+
+template<class T, size_t Capacity>
+class hwSPSCQueue
+{
+static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+public:
+    hwSPSCQueue() : m_head(0), m_tail(0) {}
+
+    // producer side. returns false if the queue is full.
+    bool push(const T &v)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity) { return false; }
+        m_items[tail & (Capacity - 1)] = v;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side. returns false if the queue is empty.
+    bool pop(T &o_v)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) { return false; }
+        o_v = m_items[head & (Capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side. same as pop() but leaves the item in the queue.
+    bool peek(T &o_v) const
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) { return false; }
+        o_v = m_items[head & (Capacity - 1)];
+        return true;
+    }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T m_items[Capacity];
+    // keep producer and consumer indices on separate cache lines
+    std::atomic<size_t> m_head;
+    char m_pad[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_tail;
+};
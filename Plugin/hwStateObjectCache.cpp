@@ -0,0 +1,80 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwHash.h"
+#include "hwBackend.h"
+#include "hwStateObjectCache.h"
+
+hwStateObjectCache::hwStateObjectCache()
+    : m_backend(nullptr)
+{
+}
+
+void hwStateObjectCache::initialize(hwBackend *backend)
+{
+    m_backend = backend;
+}
+
+void hwStateObjectCache::finalize()
+{
+    release(m_samplers);
+    release(m_depth_stencils);
+    release(m_rasterizers);
+    release(m_blends);
+    m_backend = nullptr;
+}
+
+template<class Desc, class State, class Create>
+State* hwStateObjectCache::get(Cont<Desc, State> &cont, const Desc &desc, const Create &create)
+{
+    uint64_t hash = hwHash64(&desc, sizeof(desc));
+    for (auto &e : cont) {
+        if (e.hash == hash && memcmp(&e.desc, &desc, sizeof(desc)) == 0) {
+            return e.state;
+        }
+    }
+
+    if (!m_backend) { return nullptr; }
+
+    State *state = create(desc);
+    if (!state) {
+        hwLog("hwStateObjectCache: failed to create state object.\n");
+        return nullptr;
+    }
+    Entry<Desc, State> e = { hash, desc, state };
+    cont.push_back(e);
+    return state;
+}
+
+template<class Desc, class State>
+void hwStateObjectCache::release(Cont<Desc, State> &cont)
+{
+    for (auto &e : cont) {
+        m_backend->release(e.state);
+    }
+    cont.clear();
+}
+
+ID3D11SamplerState* hwStateObjectCache::getSampler(const D3D11_SAMPLER_DESC &desc)
+{
+    return get(m_samplers, desc, [this](const D3D11_SAMPLER_DESC &d) { return m_backend->createSampler(d); });
+}
+
+ID3D11DepthStencilState* hwStateObjectCache::getDepthStencil(const D3D11_DEPTH_STENCIL_DESC &desc)
+{
+    return get(m_depth_stencils, desc, [this](const D3D11_DEPTH_STENCIL_DESC &d) { return m_backend->createDepthStencil(d); });
+}
+
+ID3D11RasterizerState* hwStateObjectCache::getRasterizer(const D3D11_RASTERIZER_DESC &desc)
+{
+    return get(m_rasterizers, desc, [this](const D3D11_RASTERIZER_DESC &d) { return m_backend->createRasterizer(d); });
+}
+
+ID3D11BlendState* hwStateObjectCache::getBlend(const D3D11_BLEND_DESC &desc)
+{
+    return get(m_blends, desc, [this](const D3D11_BLEND_DESC &d) { return m_backend->createBlend(d); });
+}
+
+size_t hwStateObjectCache::size() const
+{
+    return m_samplers.size() + m_depth_stencils.size() + m_rasterizers.size() + m_blends.size();
+}
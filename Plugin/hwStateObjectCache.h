@@ -0,0 +1,40 @@
+﻿#pragma once
+
+class hwBackend;
+
+// D3D11 state objects, created on first request and reused until finalize().
+// keyed by the hash of their descriptor. descriptors are compared bytewise, so zero them before filling them in.
+class hwStateObjectCache
+{
+public:
+    hwStateObjectCache();
+    void initialize(hwBackend *backend);
+    void finalize();
+
+    ID3D11SamplerState*         getSampler(const D3D11_SAMPLER_DESC &desc);
+    ID3D11DepthStencilState*    getDepthStencil(const D3D11_DEPTH_STENCIL_DESC &desc);
+    ID3D11RasterizerState*      getRasterizer(const D3D11_RASTERIZER_DESC &desc);
+    ID3D11BlendState*           getBlend(const D3D11_BLEND_DESC &desc);
+    size_t                      size() const;
+
+private:
+    template<class Desc, class State>
+    struct Entry
+    {
+        uint64_t hash;
+        Desc desc;
+        State *state;
+    };
+    template<class Desc, class State> using Cont = std::vector<Entry<Desc, State>>;
+
+    template<class Desc, class State, class Create>
+    State* get(Cont<Desc, State> &cont, const Desc &desc, const Create &create);
+    template<class Desc, class State>
+    void release(Cont<Desc, State> &cont);
+
+    hwBackend *m_backend;
+    Cont<D3D11_SAMPLER_DESC, ID3D11SamplerState>            m_samplers;
+    Cont<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState> m_depth_stencils;
+    Cont<D3D11_RASTERIZER_DESC, ID3D11RasterizerState>      m_rasterizers;
+    Cont<D3D11_BLEND_DESC, ID3D11BlendState>                m_blends;
+};
@@ -0,0 +1,36 @@
+﻿#pragma once
+
+// wait-free handoff of the latest version of a T from one thread (the writer) to another (the reader).
+// the writer fills back() and publish()es it, which hands it another buffer to fill. the reader acquire()s the
+// latest published version and reads front() until its next acquire(). versions published in between are skipped.
+// the three T are reused, so vectors in them keep their capacity.
+
+template<class T>
+class hwTripleBuffer
+{
+public:
+    hwTripleBuffer() : m_back(0), m_middle(1), m_front(2) {}
+
+    // writer side. back() holds whatever was published two versions ago: overwrite all of it.
+    T& back() { return m_items[m_back]; }
+    void publish()
+    {
+        m_back = m_middle.exchange(m_back | NewFlag, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    // reader side. returns false if nothing has been published since the last acquire(). front() stays as it is then.
+    bool acquire()
+    {
+        if ((m_middle.load(std::memory_order_relaxed) & NewFlag) == 0) { return false; }
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+    const T& front() const { return m_items[m_front]; }
+
+private:
+    enum { IndexMask = 3, NewFlag = 4 };
+    T m_items[3];
+    int m_back;                 // owned by the writer
+    std::atomic<int> m_middle;  // index of the buffer in between | NewFlag if the writer published it
+    int m_front;                // owned by the reader
+};
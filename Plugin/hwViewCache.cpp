@@ -0,0 +1,353 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwHash.h"
+#include "hwBackend.h"
+#include "hwViewCache.h"
+
+#define hwViewCacheInitialCapacity  64
+
+hwViewCache::hwViewCache()
+    : m_backend(nullptr)
+    , m_num_used(0)
+    , m_num_removed(0)
+    , m_clock(0)
+    , m_views_created(0)
+    , m_views_evicted(0)
+    , m_stats_views(0)
+    , m_stats_views_referenced(0)
+    , m_stats_views_created(0)
+    , m_stats_views_evicted(0)
+    , m_stats_memory(0)
+{
+}
+
+void hwViewCache::initialize(hwBackend *backend)
+{
+    m_backend = backend;
+    m_slots.assign(hwViewCacheInitialCapacity, Slot());
+    for (auto &s : m_slots) { s.state = ESlotState_Empty; }
+    m_num_used = m_num_removed = 0;
+    m_views_created = m_views_evicted = 0;
+    publishStats();
+}
+
+void hwViewCache::finalize()
+{
+    for (auto &s : m_slots) {
+        if (s.state == ESlotState_Used) { destroy(s.view); }
+    }
+    m_slots.clear();
+    m_num_used = m_num_removed = 0;
+    m_backend = nullptr;
+    publishStats();
+}
+
+void hwViewCache::move(hwViewCache &from)
+{
+    m_backend = from.m_backend;
+    m_slots = std::move(from.m_slots);
+    m_num_used = from.m_num_used;
+    m_num_removed = from.m_num_removed;
+    m_clock = from.m_clock;
+    m_views_created = from.m_views_created;
+    m_views_evicted = from.m_views_evicted;
+
+    from.m_backend = nullptr;
+    from.m_slots.clear();
+    from.m_num_used = from.m_num_removed = 0;
+    publishStats();
+    from.publishStats();
+}
+
+void hwViewCache::setReleaser(const std::function<void(ID3D11View*)> &releaser)
+{
+    m_releaser = releaser;
+}
+
+void hwViewCache::destroy(ID3D11View *view)
+{
+    if (m_releaser) { m_releaser(view); }
+    else { m_backend->release(view); }
+}
+
+
+hwViewCache::Key hwViewCache::makeKey(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC &desc)
+{
+    Key key;
+    memset(&key, 0, sizeof(key));
+    key.resource = resource;
+    key.type = EViewType_SRV;
+    key.format = desc.Format;
+    key.dimension = desc.ViewDimension;
+    switch (desc.ViewDimension) {
+    case D3D11_SRV_DIMENSION_BUFFER:
+        key.first = desc.Buffer.FirstElement;
+        key.count = desc.Buffer.ElementWidth;
+        break;
+    case D3D11_SRV_DIMENSION_TEXTURECUBE:
+        key.first = desc.TextureCube.MostDetailedMip;
+        key.count = desc.TextureCube.MipLevels;
+        break;
+    default:
+        // non-array textures all begin with MostDetailedMip and MipLevels. array slices are not part of the key.
+        key.first = desc.Texture2D.MostDetailedMip;
+        key.count = desc.Texture2D.MipLevels;
+        break;
+    }
+    return key;
+}
+
+hwViewCache::Key hwViewCache::makeKey(ID3D11Resource *resource, const D3D11_RENDER_TARGET_VIEW_DESC &desc)
+{
+    Key key;
+    memset(&key, 0, sizeof(key));
+    key.resource = resource;
+    key.type = EViewType_RTV;
+    key.format = desc.Format;
+    key.dimension = desc.ViewDimension;
+    switch (desc.ViewDimension) {
+    case D3D11_RTV_DIMENSION_UNKNOWN:
+        break;
+    case D3D11_RTV_DIMENSION_TEXTURE2D:
+        key.first = desc.Texture2D.MipSlice;
+        key.count = 1;
+        break;
+    default:
+        hwLog("hwViewCache: unsupported render target view dimension %d.\n", desc.ViewDimension);
+        break;
+    }
+    return key;
+}
+
+uint64_t hwViewCache::hashKey(const Key &key)
+{
+    return hwHash64(&key, sizeof(key));
+}
+
+int hwViewCache::find(const Key &key, uint64_t hash) const
+{
+    size_t mask = m_slots.size() - 1;
+    size_t i = (size_t)hash & mask;
+    int removed = -1;
+    for (size_t n = 0; n < m_slots.size(); ++n, i = (i + 1) & mask) {
+        auto &s = m_slots[i];
+        if (s.state == ESlotState_Empty) {
+            return removed != -1 ? removed : (int)i;
+        }
+        else if (s.state == ESlotState_Removed) {
+            if (removed == -1) { removed = (int)i; }
+        }
+        else if (s.hash == hash && memcmp(&s.key, &key, sizeof(key)) == 0) {
+            return (int)i;
+        }
+    }
+    return removed;
+}
+
+hwViewCache::Slot* hwViewCache::lookup(const Key &key)
+{
+    if (m_slots.empty()) { return nullptr; }
+    int i = find(key, hashKey(key));
+    return i != -1 && m_slots[i].state == ESlotState_Used ? &m_slots[i] : nullptr;
+}
+
+hwViewCache::Slot* hwViewCache::insert(const Key &key, ID3D11View *view)
+{
+    // keep the load factor, tombstones included, under 3/4
+    if ((m_num_used + m_num_removed + 1) * 4 > m_slots.size() * 3) {
+        size_t capacity = std::max<size_t>(m_slots.size(), hwViewCacheInitialCapacity);
+        if ((m_num_used + 1) * 2 > capacity) { capacity *= 2; }
+        rehash(capacity);
+    }
+
+    uint64_t hash = hashKey(key);
+    auto &s = m_slots[find(key, hash)];
+    if (s.state == ESlotState_Removed) { --m_num_removed; }
+    s.hash = hash;
+    s.key = key;
+    s.view = view;
+    s.last_used = m_clock;
+    s.refcount = 0;
+    s.state = ESlotState_Used;
+    ++m_num_used;
+    return &s;
+}
+
+void hwViewCache::remove(Slot &slot)
+{
+    destroy(slot.view);
+    slot.view = nullptr;
+    slot.state = ESlotState_Removed;
+    --m_num_used;
+    ++m_num_removed;
+}
+
+void hwViewCache::rehash(size_t capacity)
+{
+    std::vector<Slot> slots(capacity, Slot());
+    for (auto &s : slots) { s.state = ESlotState_Empty; }
+    slots.swap(m_slots);
+    m_num_removed = 0;
+
+    for (auto &s : slots) {
+        if (s.state == ESlotState_Used) {
+            m_slots[find(s.key, s.hash)] = s;
+        }
+    }
+}
+
+template<class View, class Create>
+View* hwViewCache::get(const Key &key, bool acquire, const Create &create)
+{
+    if (!m_backend || !key.resource) { return nullptr; }
+
+    Slot *slot = lookup(key);
+    if (!slot) {
+        View *view = create();
+        if (!view) {
+            hwLog("hwViewCache: failed to create view.\n");
+            return nullptr;
+        }
+        slot = insert(key, view);
+        ++m_views_created;
+    }
+    slot->last_used = m_clock;
+    if (acquire) { ++slot->refcount; }
+    return static_cast<View*>(slot->view);
+}
+
+ID3D11ShaderResourceView* hwViewCache::getSRV(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC &desc)
+{
+    return get<ID3D11ShaderResourceView>(makeKey(resource, desc), false,
+        [&]() { return m_backend->createSRV(resource, desc); });
+}
+
+ID3D11RenderTargetView* hwViewCache::getRTV(ID3D11Resource *resource, const D3D11_RENDER_TARGET_VIEW_DESC &desc)
+{
+    return get<ID3D11RenderTargetView>(makeKey(resource, desc), false,
+        [&]() { return m_backend->createRTV(resource, desc); });
+}
+
+ID3D11ShaderResourceView* hwViewCache::acquireSRV(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC &desc)
+{
+    return get<ID3D11ShaderResourceView>(makeKey(resource, desc), true,
+        [&]() { return m_backend->createSRV(resource, desc); });
+}
+
+ID3D11RenderTargetView* hwViewCache::acquireRTV(ID3D11Resource *resource, const D3D11_RENDER_TARGET_VIEW_DESC &desc)
+{
+    return get<ID3D11RenderTargetView>(makeKey(resource, desc), true,
+        [&]() { return m_backend->createRTV(resource, desc); });
+}
+
+void hwViewCache::releaseView(const Key &key)
+{
+    Slot *slot = lookup(key);
+    if (!slot || slot->refcount <= 0) {
+        hwLog("hwViewCache: released a view that was not acquired.\n");
+        return;
+    }
+    --slot->refcount;
+    slot->last_used = m_clock;
+}
+
+// views are looked up by their own descriptor. it is the one they were created with, so the key is the same.
+void hwViewCache::release(ID3D11ShaderResourceView *view)
+{
+    if (!view || !m_backend) { return; }
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC desc;
+    ID3D11Resource *resource = nullptr;
+    m_backend->getViewDesc(view, desc, resource);
+    releaseView(makeKey(resource, desc));
+}
+
+void hwViewCache::release(ID3D11RenderTargetView *view)
+{
+    if (!view || !m_backend) { return; }
+
+    D3D11_RENDER_TARGET_VIEW_DESC desc;
+    ID3D11Resource *resource = nullptr;
+    m_backend->getViewDesc(view, desc, resource);
+    releaseView(makeKey(resource, desc));
+}
+
+void hwViewCache::trim()
+{
+    ++m_clock;
+    if (m_num_used == 0) {
+        publishStats();
+        return;
+    }
+
+    // every view holds one reference to its resource. a resource referenced by our views only has been released
+    // by its owner, and its unreferenced views will never be looked up again.
+    // backends that can't tell the count (-1) keep the views until they go stale.
+    std::vector<ID3D11Resource*> resources;
+    resources.reserve(m_num_used);
+    for (auto &s : m_slots) {
+        if (s.state == ESlotState_Used) { resources.push_back(s.key.resource); }
+    }
+    std::sort(resources.begin(), resources.end());
+
+    // all the resources are inspected before any view is destroyed: destroying the last view of an orphaned resource
+    // destroys the resource too.
+    std::vector<size_t> expired;
+    std::vector<std::pair<uint64_t, size_t>> unreferenced; // (last_used, slot index)
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        auto &s = m_slots[i];
+        if (s.state != ESlotState_Used || s.refcount > 0) { continue; }
+
+        auto range = std::equal_range(resources.begin(), resources.end(), s.key.resource);
+        size_t views = range.second - range.first;
+        int refs = m_backend->getResourceRefs(s.key.resource);
+
+        if ((refs >= 0 && (size_t)refs <= views) || m_clock - s.last_used > hwViewCacheMaxIdleFrames) {
+            expired.push_back(i);
+        }
+        else {
+            unreferenced.push_back(std::make_pair(s.last_used, i));
+        }
+    }
+    for (size_t i : expired) {
+        remove(m_slots[i]);
+        ++m_views_evicted;
+    }
+
+    if (unreferenced.size() > hwViewCacheMaxUnreferenced) {
+        std::sort(unreferenced.begin(), unreferenced.end());
+        size_t excess = unreferenced.size() - hwViewCacheMaxUnreferenced;
+        for (size_t i = 0; i < excess; ++i) {
+            remove(m_slots[unreferenced[i].second]);
+            ++m_views_evicted;
+        }
+    }
+
+    // clear tombstones once they outnumber live entries, so probe chains stay short
+    if (m_num_removed > m_num_used) {
+        rehash(m_slots.size());
+    }
+    publishStats();
+}
+
+void hwViewCache::publishStats()
+{
+    int referenced = 0;
+    for (auto &s : m_slots) {
+        if (s.state == ESlotState_Used && s.refcount > 0) { ++referenced; }
+    }
+    m_stats_views = (int)m_num_used;
+    m_stats_views_referenced = referenced;
+    m_stats_views_created = m_views_created;
+    m_stats_views_evicted = m_views_evicted;
+    m_stats_memory = (int)(m_slots.capacity() * sizeof(Slot));
+}
+
+void hwViewCache::getStats(hwViewCacheStats &o_stats) const
+{
+    o_stats.views = m_stats_views;
+    o_stats.views_referenced = m_stats_views_referenced;
+    o_stats.views_created = m_stats_views_created;
+    o_stats.views_evicted = m_stats_views_evicted;
+    o_stats.memory = m_stats_memory;
+}
@@ -0,0 +1,108 @@
+﻿#pragma once
+
+// shader resource / render target views, shared by everything that views the same resource the same way.
+// keyed by (resource, format, dimension, mip or element range) in a flat open-addressing table.
+//
+// acquire*() takes a reference on the view and release() drops it. views nobody references are kept for reuse,
+// and trim() destroys them once they have been idle for a while (least recently used first), or right away when
+// the resource they view has been released by its owner. views returned by get*() are not referenced;
+// they stay valid as long as they are used at least once per trim() interval.
+//
+// not thread safe: a cache belongs to one thread. the game thread and the render thread each have their own
+// (see hwContext), so neither ever waits for the other. getStats() is the exception, see below.
+
+class hwBackend;
+
+#define hwViewCacheMaxIdleFrames    300 // unreferenced views not used for this many trim()s are destroyed
+#define hwViewCacheMaxUnreferenced  64  // above this many unreferenced views, the least recently used ones are destroyed
+
+struct hwViewCacheStats
+{
+    int views;              // views alive
+    int views_referenced;   // views alive that have been acquired and not released
+    int views_created;      // since initialize()
+    int views_evicted;      // since initialize()
+    int memory;             // bytes used by the table
+};
+
+class hwViewCache
+{
+public:
+    hwViewCache();
+    void initialize(hwBackend *backend);
+    void finalize();
+    void move(hwViewCache &from); // the releaser stays
+    // views the cache destroys go to releaser instead of hwBackend::release(), for an owner whose views may still
+    // be in use by another thread. null restores the default.
+    void setReleaser(const std::function<void(ID3D11View*)> &releaser);
+
+    ID3D11ShaderResourceView*   getSRV(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC &desc);
+    ID3D11RenderTargetView*     getRTV(ID3D11Resource *resource, const D3D11_RENDER_TARGET_VIEW_DESC &desc);
+    ID3D11ShaderResourceView*   acquireSRV(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC &desc);
+    ID3D11RenderTargetView*     acquireRTV(ID3D11Resource *resource, const D3D11_RENDER_TARGET_VIEW_DESC &desc);
+    void                        release(ID3D11ShaderResourceView *view); // null is ignored
+    void                        release(ID3D11RenderTargetView *view);   //
+
+    // destroys unreferenced views that are orphaned or stale. call once per frame.
+    void                        trim();
+    // the counts as of the last trim(). can be called from any thread.
+    void                        getStats(hwViewCacheStats &o_stats) const;
+
+private:
+    enum EViewType { EViewType_SRV, EViewType_RTV };
+
+    struct Key
+    {
+        ID3D11Resource *resource;
+        uint32_t type;      // EViewType
+        uint32_t format;    // DXGI_FORMAT
+        uint32_t dimension; // D3D11_SRV_DIMENSION or D3D11_RTV_DIMENSION
+        uint32_t first;     // most detailed mip / mip slice / first element
+        uint32_t count;     // mip levels / 1 / number of elements
+        uint32_t pad;
+    };
+
+    enum ESlotState : uint8_t { ESlotState_Empty, ESlotState_Used, ESlotState_Removed };
+    struct Slot
+    {
+        uint64_t hash;
+        Key key;
+        ID3D11View *view;
+        uint64_t last_used; // m_clock when it was last looked up or released
+        int refcount;
+        ESlotState state;
+    };
+
+    template<class View, class Create>
+    View* get(const Key &key, bool acquire, const Create &create);
+
+    static Key makeKey(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC &desc);
+    static Key makeKey(ID3D11Resource *resource, const D3D11_RENDER_TARGET_VIEW_DESC &desc);
+    static uint64_t hashKey(const Key &key);
+
+    // returns the slot holding key, or the slot it should be inserted into. -1 if the table is full.
+    int find(const Key &key, uint64_t hash) const;
+    Slot* lookup(const Key &key);
+    Slot* insert(const Key &key, ID3D11View *view);
+    void remove(Slot &slot);
+    void rehash(size_t capacity);
+    void releaseView(const Key &key);
+    void destroy(ID3D11View *view);
+    void publishStats();
+
+    hwBackend           *m_backend;
+    std::function<void(ID3D11View*)> m_releaser;
+    std::vector<Slot>   m_slots;        // capacity is a power of two
+    size_t              m_num_used;
+    size_t              m_num_removed;  // tombstones. they count towards the load factor until the next rehash
+    uint64_t            m_clock;
+    int                 m_views_created;
+    int                 m_views_evicted;
+
+    // published by publishStats() for getStats()
+    std::atomic<int>    m_stats_views;
+    std::atomic<int>    m_stats_views_referenced;
+    std::atomic<int>    m_stats_views_created;
+    std::atomic<int>    m_stats_views_evicted;
+    std::atomic<int>    m_stats_memory;
+};
@@ -0,0 +1,124 @@
+﻿#include "pch.h"
+#include "hwInternal.h"
+#include "hwWorkerPool.h"
+
+hwWorkerPool::hwWorkerPool() : m_head(0), m_num_threads(0), m_stop(false)
+{
+}
+
+hwWorkerPool::~hwWorkerPool()
+{
+    finalize();
+}
+
+void hwWorkerPool::setNumThreads(int n)
+{
+    m_num_threads = n;
+}
+
+void hwWorkerPool::run(Job job)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_threads.empty()) { start(); }
+        m_jobs.push_back(std::move(job));
+    }
+    m_cond.notify_one();
+}
+
+void hwWorkerPool::parallelFor(size_t n, const std::function<void(size_t)> &f)
+{
+    if (n == 0) { return; }
+    if (n == 1) {
+        f(0);
+        return;
+    }
+
+    // helpers that start after every index has been taken return without touching f,
+    // so only the indices have to outlive this call
+    struct State
+    {
+        const std::function<void(size_t)> *f;
+        size_t n;
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+        std::mutex mutex;
+        std::condition_variable cond;
+    };
+    auto state = std::make_shared<State>();
+    state->f = &f;
+    state->n = n;
+    state->next = 0;
+    state->done = 0;
+
+    auto take = [](State &s) {
+        for (;;) {
+            size_t i = s.next++;
+            if (i >= s.n) { break; }
+            (*s.f)(i);
+            if (++s.done == s.n) {
+                std::unique_lock<std::mutex> lock(s.mutex);
+                s.cond.notify_all();
+            }
+        }
+    };
+
+    size_t num_helpers = n - 1;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_threads.empty()) { start(); }
+        num_helpers = std::min(num_helpers, m_threads.size());
+        for (size_t i = 0; i < num_helpers; ++i) {
+            m_jobs.push_back([state, take]() { take(*state); });
+        }
+    }
+    m_cond.notify_all();
+
+    take(*state);
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cond.wait(lock, [&]() { return state->done == n; });
+}
+
+void hwWorkerPool::finalize()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_jobs.clear();
+        m_head = 0;
+    }
+    m_cond.notify_all();
+    for (auto &t : m_threads) { t.join(); }
+    m_threads.clear();
+    m_stop = false;
+}
+
+void hwWorkerPool::start()
+{
+    int n = m_num_threads;
+    if (n <= 0) {
+        n = std::min<int>(std::max<int>((int)std::thread::hardware_concurrency() - 1, 1), 4);
+    }
+    for (int i = 0; i < n; ++i) {
+        m_threads.emplace_back([this]() { work(); });
+    }
+}
+
+void hwWorkerPool::work()
+{
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]() { return m_stop || m_head < m_jobs.size(); });
+            if (m_stop) { return; }
+
+            job = std::move(m_jobs[m_head++]);
+            if (m_head == m_jobs.size()) {
+                m_jobs.clear();
+                m_head = 0;
+            }
+        }
+        job();
+    }
+}
@@ -0,0 +1,33 @@
+﻿#pragma once
+
+// a few threads that run jobs off the game and render threads (file I/O, parsing).
+// jobs must not touch the SDK or the device: results are handed back and used by the thread that owns those.
+class hwWorkerPool
+{
+public:
+    typedef std::function<void()> Job;
+
+    hwWorkerPool();
+    ~hwWorkerPool();
+
+    // threads are started by the first run(). 0: one less than the number of cores, at most 4
+    void setNumThreads(int n);
+    void run(Job job);
+    // calls f(0) ... f(n - 1) on the pool and the calling thread, and returns when all calls have returned.
+    // the calling thread takes indices too, so this is safe to call from a job.
+    void parallelFor(size_t n, const std::function<void(size_t)> &f);
+    // queued jobs are dropped, running ones are waited for
+    void finalize();
+
+private:
+    void start();
+    void work();
+
+    std::vector<std::thread>    m_threads;
+    std::vector<Job>            m_jobs;     // FIFO: taken from the front
+    size_t                      m_head;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_cond;
+    int                         m_num_threads;
+    bool                        m_stop;
+};
@@ -1,15 +1,44 @@
 ﻿#include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <memory>
 #include <functional>
 #include <fstream>
 #include <cstdint>
 #include <array>
+#include <type_traits>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <emmintrin.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
 
+// the D3D11 backend needs d3d11.h, the Windows SDK loader and Unity. a headless build (-DhwHeadless, see CMakeLists.txt)
+// only has the null backend and declares the few D3D11 types it passes around itself.
+#if defined(_WIN32) && !defined(hwHeadless)
+    #define hwWithD3D11
+#endif
+
+#ifdef hwWithD3D11
 #include <d3d11.h>
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <cstring>
+#include "hwHeadlessD3D11.h"
+#endif
 //#include <directXMath.h>
 
 #ifndef NDEBUG
@@ -17,16 +46,18 @@
 #endif // !NDEBUG
 
 
-#include <Nv\HairWorks\NvHairSdk.h>
-#include <Nv\HairWorks\NvHairCommon.h>
-#include <Nv\Core\1.0\NvAssert.h>
-#include <Nv\Core\1.0\NvDefines.h>
-#include <Nv\Core\1.0\NvResult.h>
-#include <Nv\Core\1.0\NvTypes.h>
-#include <Nv\HairWorks\Platform\Win\NvHairWinLoadSdk.h>
-#include <Nv\Common\NvCoMemoryAllocator.h>
-#include <Nv\Common\NvCoLogger.h>
-#include <Nv\Common\Platform\Dx11\NvCoDx11Handle.h>
-#include <Nv\Common\Platform\StdC\NvCoStdCFileReadStream.h>
+#include <Nv/HairWorks/NvHairSdk.h>
+#include <Nv/HairWorks/NvHairCommon.h>
+#include <Nv/Core/1.0/NvAssert.h>
+#include <Nv/Core/1.0/NvDefines.h>
+#include <Nv/Core/1.0/NvResult.h>
+#include <Nv/Core/1.0/NvTypes.h>
+#include <Nv/Common/NvCoMemoryAllocator.h>
+#include <Nv/Common/NvCoLogger.h>
+#include <Nv/Common/Platform/StdC/NvCoStdCFileReadStream.h>
+#ifdef hwWithD3D11
+#include <Nv/HairWorks/Platform/Win/NvHairWinLoadSdk.h>
+#include <Nv/Common/Platform/Dx11/NvCoDx11Handle.h>
 #include <IUnityGraphics.h>
 #include <IUnityGraphicsD3D11.h>
+#endif